@@ -165,11 +165,21 @@ AddFilterState::AddFilterState(Context &context, Controller &controller,
       { new Ctrl(KEY_BACKSPACE),[this](const IEvent& b) { m_invoker.create_and_execute<BackspaceCommand>(this);
                                                           m_invoker.create_and_execute<UpdateCurrentFilterEntry,
                                                                                        const std::string &,
-                                                                                       const IEvent &>(m_text, b); } },
+                                                                                       const std::string &,
+                                                                                       const IEvent &>(m_text, get_filter(), b); } },
       { new Ctrl(KEY_DC),       [this](const IEvent& b) { m_invoker.create_and_execute<DeleteCommand>(this);
                                                           m_invoker.create_and_execute<UpdateCurrentFilterEntry,
                                                                                        const std::string &,
-                                                                                       const IEvent &>(m_text, b); } },
+                                                                                       const std::string &,
+                                                                                       const IEvent &>(m_text, get_filter(), b); } },
+      // Ctrl+T, Ctrl+L and Ctrl+W toggle the case-insensitive, fixed string and
+      // whole word options
+      { new Ctrl(KEY_DC4),      [this](const IEvent& b) { m_invoker.create_and_execute<ToggleFilterFlag, AddFilterState *,
+                                                                                       bool filter_flags_t::*>(this, &filter_flags_t::icase); } },
+      { new Ctrl(KEY_FFD),      [this](const IEvent& b) { m_invoker.create_and_execute<ToggleFilterFlag, AddFilterState *,
+                                                                                       bool filter_flags_t::*>(this, &filter_flags_t::fixed); } },
+      { new Ctrl(KEY_EOT),      [this](const IEvent& b) { m_invoker.create_and_execute<ToggleFilterFlag, AddFilterState *,
+                                                                                       bool filter_flags_t::*>(this, &filter_flags_t::word); } },
       { new Arrow(KEY_LEFT),    [this](const IEvent& b) { m_invoker.create_and_execute<LeftCommand>(this); } },
       { new Arrow(KEY_RIGHT),   [this](const IEvent& b) { m_invoker.create_and_execute<RightCommand>(this); } },
       { new Arrow(C_KEY_LEFT),  [this](const IEvent& b) { m_invoker.create_and_execute<LeftWordCommand>(this); } },
@@ -179,8 +189,10 @@ AddFilterState::AddFilterState(Context &context, Controller &controller,
       { new Printable(KLEENE),  [this](const IEvent& b) { m_invoker.create_and_execute<EnterChar, const IEvent &>(b, this);
                                                           m_invoker.create_and_execute<UpdateCurrentFilterEntry,
                                                                                        const std::string &,
-                                                                                       const IEvent &>(m_text, b); } }
-    }, state_e::FILTER_STATE)
+                                                                                       const std::string &,
+                                                                                       const IEvent &>(m_text, get_filter(), b); } }
+    }, state_e::FILTER_STATE),
+  m_flags({ false, false, false })
 { }
 
 void AddFilterState::enter(const IEvent &e) {
@@ -210,12 +222,23 @@ void AddFilterState::exit(const IEvent &) {
 
 void AddFilterState::update() {
   LOGDBG("AddFilterState::update begin");
-  m_controller.set_prompt(ADD_FILTER_STATE_PROMPT + m_text);
+  // The options are displayed as the prefix of the filter
+  std::string filter = (*this).get_filter();
+  m_controller.set_prompt(ADD_FILTER_STATE_PROMPT + filter);
   pos curpos = m_cur_pos;
-  curpos.x += strlen(ADD_FILTER_STATE_PROMPT);
+  curpos.x += strlen(ADD_FILTER_STATE_PROMPT) + filter.size() - m_text.size();
   m_controller.set_prompt_cursor_position(curpos);
 }
 
+void AddFilterState::toggle_flag(bool filter_flags_t::*flag) {
+  m_flags.*flag = !(m_flags.*flag);
+  (*this).update();
+}
+
+std::string AddFilterState::get_filter() const {
+  return Matcher::format_flags(m_text, m_flags);
+}
+
 ErrorState::ErrorState(Context &context, Controller &controller,
                        IState *parent_state) :
   State(context, controller, parent_state,
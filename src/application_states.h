@@ -16,6 +16,7 @@
 #include "command.h"
 #include "state.h"
 #include "context.h"
+#include "matcher.h"
 #include "logmacros.h"
 
 /*
@@ -129,6 +130,12 @@ public:
   }
   void resume(const IEvent &);
   virtual void update();
+  /* Toggle an option of the filters entered, kept for the next ones */
+  void toggle_flag(bool filter_flags_t::*flag);
+  /* The filter entered, prefixed by its options */
+  std::string get_filter() const;
+private:
+  filter_flags_t m_flags;
 };
 
 /*
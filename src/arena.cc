@@ -0,0 +1,118 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "logmacros.h"
+#include "arena.h"
+
+Arena::Arena(size_t memory_budget) : m_data(nullptr),
+  m_memory_budget(memory_budget), m_spill_fd(-1), m_size(0),
+  m_committed_size(0), m_spilled_size(0)
+{
+}
+
+Arena::~Arena() {
+  // All the chunks are released at once
+  if (m_data) munmap(m_data, ARENA_RESERVED_SIZE);
+  if (m_spill_fd != -1) close(m_spill_fd);
+}
+
+char *Arena::get_write_area(size_t &available) {
+  if (m_size == m_committed_size && !(*this).commit_chunk()) {
+    available = 0;
+    return nullptr;
+  }
+  available = m_committed_size - m_size;
+  return m_data + m_size;
+}
+
+void Arena::commit(size_t size) {
+  m_size += size;
+  // A chunk is complete, check the budget
+  if (m_size == m_committed_size) (*this).spill();
+}
+
+bool Arena::append(const char *data, size_t size) {
+  while (size != 0) {
+    size_t available;
+    char *area = (*this).get_write_area(available);
+    if (area == nullptr) return false;
+    size_t count = std::min(size, available);
+    memcpy(area, data, count);
+    (*this).commit(count);
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+bool Arena::commit_chunk() {
+  // The address range is reserved on first use
+  if (m_data == nullptr) {
+    void *data = mmap(nullptr, ARENA_RESERVED_SIZE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (data == MAP_FAILED) {
+      LOGERR("cannot reserve the arena: " << strerror(errno));
+      return false;
+    }
+    m_data = (char *) data;
+  }
+  if (m_committed_size + ARENA_CHUNK_SIZE > ARENA_RESERVED_SIZE) {
+    LOGERR("arena full");
+    return false;
+  }
+  if (mmap(m_data + m_committed_size, ARENA_CHUNK_SIZE,
+           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+           -1, 0) == MAP_FAILED) {
+    LOGERR("cannot allocate an arena chunk: " << strerror(errno));
+    return false;
+  }
+#ifdef MADV_HUGEPAGE
+  // Fewer TLB misses when the filters scan the arena
+  madvise(m_data + m_committed_size, ARENA_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+  m_committed_size += ARENA_CHUNK_SIZE;
+  return true;
+}
+
+void Arena::spill() {
+  // Only complete chunks are spilled, the last one is still being written
+  while (m_committed_size - m_spilled_size > m_memory_budget &&
+         m_spilled_size + ARENA_CHUNK_SIZE <= m_size) {
+    if (m_spill_fd == -1) {
+      const char *tmpdir = getenv("TMPDIR");
+      std::string path = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp")
+        + "/ggrep.XXXXXX";
+      m_spill_fd = mkstemp(&path[0]);
+      if (m_spill_fd == -1) {
+        LOGERR("cannot create spill file " << path << ": " << strerror(errno));
+        return;
+      }
+      // The file disappears with the arena
+      unlink(path.c_str());
+    }
+    char *chunk = m_data + m_spilled_size;
+    size_t written = 0;
+    while (written < ARENA_CHUNK_SIZE) {
+      ssize_t n = pwrite(m_spill_fd, chunk + written,
+                         ARENA_CHUNK_SIZE - written, m_spilled_size + written);
+      if (n == -1 && errno == EINTR) continue;
+      if (n <= 0) {
+        LOGERR("cannot write spill file: " << strerror(errno));
+        return;
+      }
+      written += n;
+    }
+    // Replace the anonymous chunk by the file, with the same content, so the
+    // views on the chunk stay valid
+    if (mmap(chunk, ARENA_CHUNK_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED,
+             m_spill_fd, m_spilled_size) == MAP_FAILED) {
+      LOGERR("cannot map spill file: " << strerror(errno));
+      return;
+    }
+    m_spilled_size += ARENA_CHUNK_SIZE;
+  }
+}
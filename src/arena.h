@@ -0,0 +1,73 @@
+/*! \brief Contiguous storage for text copied in memory
+ *
+ * Text which cannot be mapped from a file (pipes, decompressed or transcoded
+ * input) is copied in an Arena. The bytes are packed one after the other so the
+ * lines are adjacent in memory, and the whole arena is released at once.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+
+// The arena is backed by memory in chunks of this size
+#define ARENA_CHUNK_SIZE (16 * 1024 * 1024)
+// Memory used by the chunks before the oldest ones spill to disk
+#define ARENA_MEMORY_BUDGET (512 * 1024 * 1024)
+// Address space reserved for an arena (1TB)
+#define ARENA_RESERVED_SIZE ((size_t) 1 << 40)
+
+/*
+ * The arena is a reserved address range, so its content is contiguous and
+ * never moves: views on it stay valid while it grows. The range is backed by
+ * anonymous memory chunk by chunk as data is added. When the chunks exceed the
+ * memory budget, the oldest ones are written to an unlinked temporary file
+ * which is mapped in their place. Their pages can then be evicted by the
+ * kernel.
+ * Only one thread may add data. The data already added can be read by any
+ * thread, provided the size was published to it.
+ */
+class Arena {
+public:
+  Arena(size_t memory_budget = ARENA_MEMORY_BUDGET);
+  ~Arena();
+  /* Beginning of the arena, nullptr until data is added */
+  inline const char *data() const { return m_data; }
+  /* Number of bytes added */
+  inline size_t size() const { return m_size; }
+  /*
+   * Return where to write the next bytes, and set available to the number of
+   * bytes which can be written there. Returns nullptr if the arena is full or
+   * no memory is available.
+   */
+  char *get_write_area(size_t &available);
+  /*
+   * Add the size bytes written in the write area to the arena
+   */
+  void commit(size_t size);
+  /*
+   * Copy size bytes at the end of the arena. Returns false if the arena is full.
+   */
+  bool append(const char *data, size_t size);
+
+private:
+  /* Back the next chunk with anonymous memory */
+  bool commit_chunk();
+  /* Move the oldest chunks to the spill file until the budget is respected */
+  void spill();
+
+private:
+  char    *m_data;
+  size_t  m_memory_budget;
+  int     m_spill_fd;
+  // Bytes added, backed by memory and backed by the spill file
+  size_t  m_size;
+  size_t  m_committed_size;
+  size_t  m_spilled_size;
+
+private:
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+};
+
+#endif // __ARENA_H__
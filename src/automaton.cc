@@ -0,0 +1,916 @@
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "logmacros.h"
+#include "automaton.h"
+
+// The previous byte is a word character
+#define DFA_FLAG_WORD 1
+// At the beginning of the text
+#define DFA_FLAG_BEGIN 2
+// The dead state, which has no instruction left, is always at offset 0
+#define DFA_DEAD_STATE 0
+// Largest count of a {n,m} quantifier
+#define REPEAT_MAX_COUNT 1000
+
+/* Thrown when a pattern cannot be compiled to a program */
+struct unsupported_pattern_t {};
+
+/*
+ * Node of the syntax tree of a pattern
+ */
+struct node_t {
+  enum class type_e { BYTES, CONCAT, ALTERNATE, REPEAT, ASSERT };
+  type_e                                  type;
+  std::bitset<256>                        bytes;
+  std::vector< std::unique_ptr<node_t> >  children;
+  int                                     min;
+  int                                     max;    // -1 if unbounded
+  bool                                    greedy;
+  assertion_e                             assertion;
+
+  node_t(type_e t) : type(t), min(0), max(0), greedy(true),
+    assertion(assertion_e::BEGIN_TEXT) {}
+};
+
+typedef std::unique_ptr<node_t> node_ptr;
+
+static inline bool is_word(unsigned char c) {
+  return isalnum(c) || c == '_';
+}
+
+/*
+ * Recursive descent parser of the ECMAScript grammar. Everything it does not
+ * understand is rejected, the pattern is then left to std::regex. With icase,
+ * the sets of bytes hold both cases of their letters, a negated class being
+ * folded before it is negated.
+ */
+class Parser {
+public:
+  Parser(const std::string &pattern, bool icase) : m_pattern(pattern),
+    m_pos(0), m_icase(icase) {}
+  node_ptr parse() {
+    node_ptr root = (*this).alternation();
+    // Unbalanced parenthesis
+    if (!(*this).eof()) throw unsupported_pattern_t();
+    return root;
+  }
+
+private:
+  inline bool eof() const { return m_pos == m_pattern.size(); }
+  inline char peek() const { return m_pattern[m_pos]; }
+  inline char next() {
+    if ((*this).eof()) throw unsupported_pattern_t();
+    return m_pattern[m_pos++];
+  }
+
+  node_ptr alternation() {
+    node_ptr first = (*this).concatenation();
+    if ((*this).eof() || (*this).peek() != '|') return first;
+    node_ptr node(new node_t(node_t::type_e::ALTERNATE));
+    node->children.push_back(std::move(first));
+    while (!(*this).eof() && (*this).peek() == '|') {
+      ++m_pos;
+      node->children.push_back((*this).concatenation());
+    }
+    return node;
+  }
+
+  node_ptr concatenation() {
+    node_ptr node(new node_t(node_t::type_e::CONCAT));
+    while (!(*this).eof() && (*this).peek() != '|' && (*this).peek() != ')')
+      node->children.push_back((*this).repetition());
+    return node;
+  }
+
+  int count() {
+    if ((*this).eof() || !isdigit((unsigned char) (*this).peek()))
+      throw unsupported_pattern_t();
+    int n = 0;
+    while (!(*this).eof() && isdigit((unsigned char) (*this).peek())) {
+      n = n * 10 + ((*this).next() - '0');
+      if (n > REPEAT_MAX_COUNT) throw unsupported_pattern_t();
+    }
+    return n;
+  }
+
+  node_ptr repetition() {
+    node_ptr atom = (*this).atom();
+    if ((*this).eof()) return atom;
+    int min, max;
+    switch ((*this).peek()) {
+      case '*': min = 0; max = -1; ++m_pos; break;
+      case '+': min = 1; max = -1; ++m_pos; break;
+      case '?': min = 0; max = 1; ++m_pos; break;
+      case '{':
+        ++m_pos;
+        min = max = (*this).count();
+        if ((*this).next() == ',') {
+          max = (*this).peek() == '}' ? -1 : (*this).count();
+          if ((*this).next() != '}') throw unsupported_pattern_t();
+        } else if (m_pattern[m_pos - 1] != '}') {
+          throw unsupported_pattern_t();
+        }
+        if (max != -1 && max < min) throw unsupported_pattern_t();
+        break;
+      default: return atom;
+    }
+    if (atom->type == node_t::type_e::ASSERT) throw unsupported_pattern_t();
+    node_ptr node(new node_t(node_t::type_e::REPEAT));
+    node->min = min;
+    node->max = max;
+    node->children.push_back(std::move(atom));
+    // Lazy quantifier
+    if (!(*this).eof() && (*this).peek() == '?') {
+      node->greedy = false;
+      ++m_pos;
+    }
+    if (!(*this).eof() && strchr("*+?{", (*this).peek()))
+      throw unsupported_pattern_t();
+    return node;
+  }
+
+  /* Add the other case of the letters of set */
+  void fold(std::bitset<256> &set) const {
+    if (!m_icase) return;
+    for (int c = 'a'; c <= 'z'; ++c)
+      if (set[c] || set[c - 'a' + 'A']) set.set(c).set(c - 'a' + 'A');
+  }
+
+  node_ptr bytes(std::bitset<256> set) {
+    (*this).fold(set);
+    node_ptr node(new node_t(node_t::type_e::BYTES));
+    node->bytes = set;
+    return node;
+  }
+
+  node_ptr assertion(assertion_e assertion) {
+    node_ptr node(new node_t(node_t::type_e::ASSERT));
+    node->assertion = assertion;
+    return node;
+  }
+
+  node_ptr atom() {
+    char c = (*this).next();
+    std::bitset<256> set;
+    switch (c) {
+      case '(': {
+        if (!(*this).eof() && (*this).peek() == '?') {
+          ++m_pos;
+          // Lookaheads are not supported
+          if ((*this).next() != ':') throw unsupported_pattern_t();
+        }
+        node_ptr node = (*this).alternation();
+        if ((*this).next() != ')') throw unsupported_pattern_t();
+        return node;
+      }
+      case '[': return (*this).bracket();
+      case '.':
+        set.set();
+        set.reset('\n');
+        set.reset('\r');
+        return (*this).bytes(set);
+      case '^': return (*this).assertion(assertion_e::BEGIN_TEXT);
+      case '$': return (*this).assertion(assertion_e::END_TEXT);
+      case '\\':
+        c = (*this).next();
+        if (c == 'b') return (*this).assertion(assertion_e::WORD_BOUNDARY);
+        if (c == 'B') return (*this).assertion(assertion_e::NOT_WORD_BOUNDARY);
+        if (!class_escape(c, set)) set.set((*this).character_escape(c));
+        return (*this).bytes(set);
+      case '*': case '+': case '?': case '{': case '}': case ']': case ')':
+        throw unsupported_pattern_t();
+      default:
+        set.set((unsigned char) c);
+        return (*this).bytes(set);
+    }
+  }
+
+  /*
+   * Add the bytes of the class escape c to set. Returns false if c is not a
+   * class escape.
+   */
+  static bool class_escape(char c, std::bitset<256> &set) {
+    std::bitset<256> escape;
+    for (int b = 0; b < 256; ++b) {
+      switch (tolower(c)) {
+        case 'd': escape[b] = isdigit(b); break;
+        case 'w': escape[b] = is_word(b); break;
+        case 's': escape[b] = b != 0 && strchr(" \t\n\v\f\r", b); break;
+        default: return false;
+      }
+    }
+    if (isupper(c)) escape.flip();
+    set |= escape;
+    return true;
+  }
+
+  int hexadecimal(int digits) {
+    int value = 0;
+    for (int i = 0; i < digits; ++i) {
+      char c = (*this).next();
+      if (!isxdigit((unsigned char) c)) throw unsupported_pattern_t();
+      value = value * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+    }
+    return value;
+  }
+
+  /*
+   * Return the byte the escape sequence \c stands for
+   */
+  int character_escape(char c) {
+    switch (c) {
+      case 'n': return '\n';
+      case 'r': return '\r';
+      case 't': return '\t';
+      case 'v': return '\v';
+      case 'f': return '\f';
+      case '0':
+        if (!(*this).eof() && isdigit((unsigned char) (*this).peek()))
+          throw unsupported_pattern_t();
+        return 0;
+      case 'x': return (*this).hexadecimal(2);
+      case 'u': {
+        int value = (*this).hexadecimal(4);
+        if (value > 255) throw unsupported_pattern_t();
+        return value;
+      }
+      case 'c':
+        c = (*this).next();
+        if (!isalpha((unsigned char) c)) throw unsupported_pattern_t();
+        return c % 32;
+      default:
+        // Identity escape. Back references (\1 to \9) are not supported.
+        if (isalnum((unsigned char) c) || c == '\0')
+          throw unsupported_pattern_t();
+        return (unsigned char) c;
+    }
+  }
+
+  /*
+   * Byte of a character class, the range operator excluded. Returns -1 if it
+   * is a class escape, whose bytes are added to set.
+   */
+  int class_byte(std::bitset<256> &set) {
+    char c = (*this).next();
+    // POSIX classes, collating elements and equivalence classes
+    if (c == '[' && !(*this).eof() && strchr(":.=", (*this).peek()))
+      throw unsupported_pattern_t();
+    if (c != '\\') return (unsigned char) c;
+    c = (*this).next();
+    if (c == 'b') return '\b';
+    if (class_escape(c, set)) return -1;
+    return (*this).character_escape(c);
+  }
+
+  node_ptr bracket() {
+    bool negate = !(*this).eof() && (*this).peek() == '^';
+    if (negate) ++m_pos;
+    // Empty class
+    if (!(*this).eof() && (*this).peek() == ']') throw unsupported_pattern_t();
+    std::bitset<256> set;
+    while ((*this).next() != ']') {
+      --m_pos;
+      int low = (*this).class_byte(set);
+      int high = low;
+      if (m_pos + 1 < m_pattern.size() && (*this).peek() == '-' &&
+          m_pattern[m_pos + 1] != ']') {
+        ++m_pos;
+        high = (*this).class_byte(set);
+        // Ranges of class escapes
+        if (low == -1 || high == -1 || high < low)
+          throw unsupported_pattern_t();
+      }
+      for (int b = low; b != -1 && b <= high; ++b) set.set(b);
+    }
+    if (negate) {
+      (*this).fold(set);
+      set.flip();
+    }
+    return (*this).bytes(set);
+  }
+
+private:
+  const std::string &m_pattern;
+  size_t            m_pos;
+  bool              m_icase;
+};
+
+/*
+ * Return true if node matches the empty string
+ */
+static bool is_nullable(const node_t &node) {
+  switch (node.type) {
+    case node_t::type_e::BYTES:
+      return false;
+    case node_t::type_e::CONCAT:
+      for (const node_ptr &child: node.children)
+        if (!is_nullable(*child)) return false;
+      return true;
+    case node_t::type_e::ALTERNATE:
+      for (const node_ptr &child: node.children)
+        if (is_nullable(*child)) return true;
+      return false;
+    case node_t::type_e::REPEAT:
+      return node.min == 0 || is_nullable(*node.children.front());
+    case node_t::type_e::ASSERT:
+      return true;
+  }
+  return false;
+}
+
+/*
+ * Thompson construction of the program. The nodes are compiled from the end:
+ * next is the instruction following the node, and the first instruction of the
+ * node is returned.
+ */
+class Compiler {
+public:
+  Compiler(program_t &program, bool reverse) : m_program(program),
+    m_reverse(reverse) {}
+
+  int push(inst_t::op_e op, int x = -1, int y = -1) {
+    if (m_program.insts.size() >= PROGRAM_MAX_SIZE)
+      throw unsupported_pattern_t();
+    m_program.insts.emplace_back(op, x, y);
+    return m_program.insts.size() - 1;
+  }
+
+  int emit(const node_t &node, int next) {
+    switch (node.type) {
+      case node_t::type_e::BYTES: {
+        int pc = (*this).push(inst_t::op_e::BYTE, next);
+        m_program.insts[pc].bytes = node.bytes;
+        return pc;
+      }
+      case node_t::type_e::CONCAT:
+        // A reversed concatenation matches the reversed strings
+        if (m_reverse) {
+          for (const node_ptr &child: node.children)
+            next = (*this).emit(*child, next);
+        } else {
+          for (auto child = node.children.rbegin();
+               child != node.children.rend(); ++child)
+            next = (*this).emit(**child, next);
+        }
+        return next;
+      case node_t::type_e::ALTERNATE: {
+        int pc = (*this).emit(*node.children.back(), next);
+        for (size_t i = node.children.size() - 1; i-- > 0; )
+          pc = (*this).push(inst_t::op_e::SPLIT,
+                            (*this).emit(*node.children[i], next), pc);
+        return pc;
+      }
+      case node_t::type_e::REPEAT:
+        return (*this).repeat(node, next);
+      case node_t::type_e::ASSERT: {
+        int pc = (*this).push(inst_t::op_e::ASSERT, next);
+        assertion_e assertion = node.assertion;
+        // The beginning of a reversed text is its end
+        if (m_reverse && assertion == assertion_e::BEGIN_TEXT)
+          assertion = assertion_e::END_TEXT;
+        else if (m_reverse && assertion == assertion_e::END_TEXT)
+          assertion = assertion_e::BEGIN_TEXT;
+        if (assertion == assertion_e::WORD_BOUNDARY ||
+            assertion == assertion_e::NOT_WORD_BOUNDARY)
+          m_program.word_assertions = true;
+        m_program.insts[pc].assertion = assertion;
+        return pc;
+      }
+    }
+    return next;
+  }
+
+private:
+  /* SPLIT preferring body if greedy, next otherwise */
+  int split(bool greedy, int body, int next) {
+    return greedy ? (*this).push(inst_t::op_e::SPLIT, body, next)
+                  : (*this).push(inst_t::op_e::SPLIT, next, body);
+  }
+
+  int repeat(const node_t &node, int next) {
+    const node_t &child = *node.children.front();
+    // ECMAScript stops repeating the optional iterations once one matches the
+    // empty string, the threads of the program do not
+    if (node.max != node.min && is_nullable(child))
+      m_program.empty_loops = true;
+    int pc = next;
+    int min = node.min;
+    if (node.max == -1) {
+      // Loop on the child, the SPLIT is patched once the child is compiled
+      int loop = (*this).push(inst_t::op_e::SPLIT);
+      int body = (*this).emit(child, loop);
+      m_program.insts[loop].x = node.greedy ? body : next;
+      m_program.insts[loop].y = node.greedy ? next : body;
+      // x+ is compiled as x followed by the loop
+      if (min > 0) {
+        pc = body;
+        --min;
+      } else {
+        pc = loop;
+      }
+    } else {
+      // x{n,m} is compiled as n x followed by m - n nested optional x
+      for (int i = node.min; i < node.max; ++i)
+        pc = (*this).split(node.greedy, (*this).emit(child, pc), next);
+    }
+    for (int i = 0; i < min; ++i) pc = (*this).emit(child, pc);
+    return pc;
+  }
+
+private:
+  program_t &m_program;
+  bool      m_reverse;
+};
+
+/*
+ * Split the bytes in classes of bytes accepted by the same instructions
+ */
+static void compute_byte_classes(program_t &program) {
+  std::bitset<256> boundaries;
+  boundaries.set(0);
+  for (const inst_t &inst: program.insts) {
+    if (inst.op != inst_t::op_e::BYTE) continue;
+    for (int b = 1; b < 256; ++b)
+      if (inst.bytes[b] != inst.bytes[b - 1]) boundaries.set(b);
+  }
+  // The word boundaries depend on the class of the bytes around them
+  if (program.word_assertions)
+    for (int b = 1; b < 256; ++b)
+      if (is_word(b) != is_word(b - 1)) boundaries.set(b);
+  program.nb_classes = 0;
+  for (int b = 0; b < 256; ++b) {
+    if (boundaries[b]) {
+      program.class_bytes.push_back(b);
+      ++program.nb_classes;
+    }
+    program.byte_classes[b] = program.nb_classes - 1;
+  }
+}
+
+/*
+ * Compile the alternation of patterns, whose matches are tagged with tags
+ */
+static std::shared_ptr<const program_t> compile_program(
+  const std::vector<std::string> &patterns, const std::vector<int> &tags,
+  const std::vector<bool> &icase, bool reverse, bool tagged)
+{
+  try {
+    std::shared_ptr<program_t> program = std::make_shared<program_t>();
+    program->word_assertions = false;
+    program->empty_loops = false;
+    program->tagged = tagged;
+    Compiler compiler(*program, reverse);
+    program->start = -1;
+    for (size_t i = patterns.size(); i-- > 0; ) {
+      node_ptr root = Parser(patterns[i], icase[i]).parse();
+      int match = compiler.push(inst_t::op_e::MATCH);
+      program->insts[match].pattern = tags[i];
+      int entry = compiler.emit(*root, match);
+      program->start = program->start == -1 ? entry :
+        compiler.push(inst_t::op_e::SPLIT, entry, program->start);
+    }
+    if (!reverse) {
+      // Unanchored search: a lazy .* before the pattern, so the matches
+      // beginning first have priority
+      int loop = compiler.push(inst_t::op_e::SPLIT, program->start);
+      int any = compiler.push(inst_t::op_e::BYTE, loop);
+      program->insts[any].bytes.set();
+      program->insts[loop].y = any;
+      program->start = loop;
+    }
+    compute_byte_classes(*program);
+    return program;
+  } catch (const unsupported_pattern_t &) {
+    return nullptr;
+  }
+}
+
+std::shared_ptr<const program_t> compile_program(const std::string &pattern,
+                                                 bool reverse, bool icase) {
+  std::shared_ptr<const program_t> program = compile_program(
+    std::vector<std::string>(1, pattern), std::vector<int>(1, 0),
+    std::vector<bool>(1, icase), reverse, false);
+  if (!program) {
+    LOGDBG("pattern " << pattern << " not supported by the automata");
+  }
+  return program;
+}
+
+std::shared_ptr<const program_t> compile_program(
+  const std::vector<std::string> &patterns, const std::vector<int> &tags,
+  const std::vector<bool> &icase)
+{
+  return compile_program(patterns, tags, icase, false, true);
+}
+
+LazyDfa::LazyDfa(std::shared_ptr<const program_t> program,
+                 bool leftmost_first) : m_program(program),
+  m_leftmost_first(leftmost_first), m_stride(program->nb_classes + 1),
+  m_memory_size(0), m_nb_flushes(0), m_visited(program->insts.size(), 0),
+  m_added(program->insts.size(), 0), m_generation(0)
+{
+  (*this).flush();
+}
+
+LazyDfa::LazyDfa(const LazyDfa &other) :
+  LazyDfa(other.m_program, other.m_leftmost_first)
+{
+}
+
+void LazyDfa::flush() {
+  if (m_memory_size != 0) {
+    LOGDBG("flush " << m_states.size() << " states");
+  }
+  m_states.clear();
+  m_transitions.clear();
+  m_index.clear();
+  m_memory_size = 0;
+  for (int &start: m_starts) start = -1;
+  // The dead state has no instruction and loops on itself
+  (*this).find_state(std::vector<int>(), 0);
+  std::fill(m_transitions.begin(), m_transitions.end(),
+            DFA_DEAD_STATE << 1);
+}
+
+int LazyDfa::find_state(const std::vector<int> &insts, uint8_t flags,
+                        const std::vector<int> &matches) {
+  std::string key(1, (char) flags);
+  uint32_t nb_insts = insts.size();
+  key.append((const char *) &nb_insts, sizeof (nb_insts));
+  key.append((const char *) insts.data(), insts.size() * sizeof (int));
+  key.append((const char *) matches.data(), matches.size() * sizeof (int));
+  auto it = m_index.find(key);
+  if (it != m_index.end()) return it->second;
+  size_t memory_size = m_stride * sizeof (int) + 2 * key.size() +
+    sizeof (state_t);
+  if (m_memory_size + memory_size > DFA_CACHE_SIZE) {
+    // The transitions pointing to the states are lost, the scan goes on from
+    // the state being added
+    (*this).flush();
+    ++m_nb_flushes;
+  }
+  int offset = m_transitions.size();
+  m_states.push_back(state_t());
+  m_states.back().insts = insts;
+  m_states.back().flags = flags;
+  m_states.back().matches = matches;
+  m_transitions.resize(m_transitions.size() + m_stride, -1);
+  m_index[key] = offset;
+  m_memory_size += memory_size;
+  return offset;
+}
+
+int LazyDfa::start(uint8_t flags) {
+  if (m_starts[flags] == -1)
+    m_starts[flags] = (*this).find_state(
+      std::vector<int>(1, m_program->start), flags);
+  return m_starts[flags];
+}
+
+int LazyDfa::transition(int offset, int c) {
+  const program_t &program = *m_program;
+  // Copied as the state might be flushed
+  state_t state = m_states[offset / m_stride];
+  bool end_of_text = c == program.nb_classes;
+  bool next_word = program.word_assertions && !end_of_text &&
+    is_word(program.class_bytes[c]);
+  bool prev_word = state.flags & DFA_FLAG_WORD;
+  if (++m_generation == 0) {
+    std::fill(m_visited.begin(), m_visited.end(), 0);
+    std::fill(m_added.begin(), m_added.end(), 0);
+    m_generation = 1;
+  }
+  // Follow the threads of the state in priority order, up to the instructions
+  // consuming a byte
+  bool match = false;
+  m_next.clear();
+  m_matches.clear();
+  for (int pc: state.insts) {
+    m_stack.push_back(pc);
+    while (!m_stack.empty()) {
+      pc = m_stack.back();
+      m_stack.pop_back();
+      if (m_visited[pc] == m_generation) continue;
+      m_visited[pc] = m_generation;
+      const inst_t &inst = program.insts[pc];
+      switch (inst.op) {
+        case inst_t::op_e::BYTE:
+          if (!end_of_text && inst.bytes[program.class_bytes[c]] &&
+              m_added[inst.x] != m_generation) {
+            m_added[inst.x] = m_generation;
+            m_next.push_back(inst.x);
+          }
+          break;
+        case inst_t::op_e::SPLIT:
+          m_stack.push_back(inst.y);
+          m_stack.push_back(inst.x);
+          break;
+        case inst_t::op_e::JMP:
+          m_stack.push_back(inst.x);
+          break;
+        case inst_t::op_e::ASSERT: {
+          bool holds = false;
+          switch (inst.assertion) {
+            case assertion_e::BEGIN_TEXT:
+              holds = state.flags & DFA_FLAG_BEGIN;
+              break;
+            case assertion_e::END_TEXT:
+              holds = end_of_text;
+              break;
+            case assertion_e::WORD_BOUNDARY:
+              holds = prev_word != next_word;
+              break;
+            case assertion_e::NOT_WORD_BOUNDARY:
+              holds = prev_word == next_word;
+              break;
+          }
+          if (holds) m_stack.push_back(inst.x);
+          break;
+        }
+        case inst_t::op_e::MATCH:
+          match = true;
+          if (program.tagged &&
+              std::find(m_matches.begin(), m_matches.end(), inst.pattern) ==
+                m_matches.end())
+            m_matches.push_back(inst.pattern);
+          // A backtracking engine would stop here
+          if (m_leftmost_first) m_stack.clear();
+          break;
+      }
+    }
+    if (match && m_leftmost_first) break;
+  }
+  // The order of the threads only matters for leftmost-first
+  if (!m_leftmost_first) std::sort(m_next.begin(), m_next.end());
+  std::sort(m_matches.begin(), m_matches.end());
+  size_t nb_flushes = m_nb_flushes;
+  // The tags of the matches are kept by the next state, even if it is dead
+  int next = m_next.empty() && m_matches.empty() ? DFA_DEAD_STATE :
+    (*this).find_state(m_next, next_word ? DFA_FLAG_WORD : 0, m_matches);
+  int result = (next << 1) | (match ? 1 : 0);
+  // Not stored if the states were flushed, the source state is gone
+  if (m_nb_flushes == nb_flushes) m_transitions[offset + c] = result;
+  return result;
+}
+
+bool LazyDfa::search_forward(const char *text, size_t size,
+                             size_t &match_end, size_t from) {
+  const uint8_t *bytes = (const uint8_t *) text;
+  const uint8_t *classes = m_program->byte_classes;
+  uint8_t flags = from == 0 ? DFA_FLAG_BEGIN : 0;
+  if (m_program->word_assertions && from > 0 && is_word(bytes[from - 1]))
+    flags |= DFA_FLAG_WORD;
+  int state = (*this).start(flags);
+  bool found = false;
+  size_t i = from;
+  for (; i < size; ++i) {
+    int c = classes[bytes[i]];
+    int t = m_transitions[state + c];
+    if (t < 0) t = (*this).transition(state, c);
+    if (t & 1) {
+      found = true;
+      match_end = i;
+    }
+    state = t >> 1;
+    if (state == DFA_DEAD_STATE) return found;
+  }
+  int t = m_transitions[state + m_program->nb_classes];
+  if (t < 0) t = (*this).transition(state, m_program->nb_classes);
+  if (t & 1) {
+    found = true;
+    match_end = size;
+  }
+  return found;
+}
+
+bool LazyDfa::search_backward(const char *text, size_t size, size_t end,
+                              size_t &match_start, size_t from) {
+  const uint8_t *bytes = (const uint8_t *) text;
+  const uint8_t *classes = m_program->byte_classes;
+  // The text after end is the beginning of the reversed text
+  uint8_t flags = end == size ? DFA_FLAG_BEGIN : 0;
+  if (m_program->word_assertions && end < size && is_word(bytes[end]))
+    flags |= DFA_FLAG_WORD;
+  int state = (*this).start(flags);
+  bool found = false;
+  size_t i = end;
+  for (; i > from; --i) {
+    int c = classes[bytes[i - 1]];
+    int t = m_transitions[state + c];
+    if (t < 0) t = (*this).transition(state, c);
+    if (t & 1) {
+      found = true;
+      match_start = i;
+    }
+    state = t >> 1;
+    if (state == DFA_DEAD_STATE) return found;
+  }
+  // Whether a match begins at from depends on the byte before it, if any
+  int c = from == 0 ? m_program->nb_classes : classes[bytes[from - 1]];
+  int t = m_transitions[state + c];
+  if (t < 0) t = (*this).transition(state, c);
+  if (t & 1) {
+    found = true;
+    match_start = from;
+  }
+  return found;
+}
+
+void LazyDfa::search_all(const char *text, size_t size, tag_set_t &matched) {
+  const uint8_t *bytes = (const uint8_t *) text;
+  const uint8_t *classes = m_program->byte_classes;
+  // Add the tags kept by the state reached by the transition t
+  auto report = [&](int t) {
+    for (int tag: m_states[(t >> 1) / m_stride].matches) matched.insert(tag);
+  };
+  int state = (*this).start(DFA_FLAG_BEGIN);
+  for (size_t i = 0; i < size; ++i) {
+    int c = classes[bytes[i]];
+    int t = m_transitions[state + c];
+    if (t < 0) t = (*this).transition(state, c);
+    if (t & 1) report(t);
+    state = t >> 1;
+  }
+  int t = m_transitions[state + m_program->nb_classes];
+  if (t < 0) t = (*this).transition(state, m_program->nb_classes);
+  if (t & 1) report(t);
+}
+
+// A literal ends at the node reached by the transition, or at a suffix of it
+#define AC_OUTPUT_BIT 0x80000000u
+
+AhoCorasick::AhoCorasick(const std::vector<std::string> &literals,
+                         const std::vector<int> &tags)
+{
+  if (!AhoCorasick::fits(literals))
+    throw std::length_error("too many literals for an Aho-Corasick automaton");
+  // The bytes which do not occur in the literals share the class 0
+  std::fill(std::begin(m_byte_classes), std::end(m_byte_classes), 0);
+  m_stride = 1;
+  for (const std::string &literal: literals)
+    for (unsigned char b: literal)
+      if (m_byte_classes[b] == 0) m_byte_classes[b] = m_stride++;
+  // Build the trie with lists of children, 0 being the root and the end of a
+  // list
+  std::vector<uint32_t> first_child(1, 0);
+  std::vector<uint32_t> next_sibling(1, 0);
+  std::vector<uint16_t> node_class(1, 0);
+  std::vector<uint32_t> literal_nodes(literals.size());
+  for (size_t i = 0; i < literals.size(); ++i) {
+    uint32_t node = 0;
+    for (unsigned char b: literals[i]) {
+      uint16_t c = m_byte_classes[b];
+      uint32_t child = first_child[node];
+      while (child != 0 && node_class[child] != c)
+        child = next_sibling[child];
+      if (child == 0) {
+        child = first_child.size();
+        first_child.push_back(0);
+        next_sibling.push_back(first_child[node]);
+        node_class.push_back(c);
+        first_child[node] = child;
+      }
+      node = child;
+    }
+    literal_nodes[i] = node;
+  }
+  size_t nb_nodes = first_child.size();
+  // Number the nodes breadth first, so the nodes closest to the root come
+  // first and the suffix of a node comes before it. The children of each node
+  // are stored sorted by class.
+  std::vector<uint32_t> order(1, 0);
+  std::vector<uint32_t> ids(nb_nodes, 0);
+  std::vector<edge_t> edges;
+  std::vector<uint32_t> first_edge(1, 0);
+  order.reserve(nb_nodes);
+  edges.reserve(nb_nodes - 1);
+  first_edge.reserve(nb_nodes + 1);
+  for (size_t i = 0; i < order.size(); ++i) {
+    size_t begin = edges.size();
+    for (uint32_t child = first_child[order[i]]; child != 0;
+         child = next_sibling[child]) {
+      ids[child] = order.size();
+      order.push_back(child);
+      edges.push_back({ node_class[child], ids[child] });
+    }
+    std::sort(edges.begin() + begin, edges.end(),
+              [](const edge_t &a, const edge_t &b) { return a.c < b.c; });
+    first_edge.push_back(edges.size());
+  }
+  std::vector<uint32_t>().swap(first_child);
+  std::vector<uint32_t>().swap(next_sibling);
+  std::vector<uint16_t>().swap(node_class);
+  std::vector<uint32_t>().swap(order);
+  // Flatten the tags, in the order of the literals
+  m_first_tag.assign(nb_nodes + 1, 0);
+  for (uint32_t node: literal_nodes) ++m_first_tag[ids[node] + 1];
+  for (size_t n = 0; n < nb_nodes; ++n) m_first_tag[n + 1] += m_first_tag[n];
+  m_tags.resize(literals.size());
+  std::vector<uint32_t> filled(m_first_tag.begin(), m_first_tag.end() - 1);
+  for (size_t i = 0; i < literals.size(); ++i)
+    m_tags[filled[ids[literal_nodes[i]]]++] = tags[i];
+  std::vector<uint32_t>().swap(filled);
+  std::vector<uint32_t>().swap(ids);
+  // Failure and output links, breadth first so the ones of the suffixes are
+  // known first. The suffix of a node is found by following the failure links
+  // of its parent, which is linear in the size of the trie overall.
+  std::vector<uint32_t> failure(nb_nodes, 0);
+  m_output_links.assign(nb_nodes, 0);
+  auto child = [&](uint32_t node, uint32_t c) -> uint32_t {
+    const edge_t *first = edges.data() + first_edge[node];
+    const edge_t *last = edges.data() + first_edge[node + 1];
+    const edge_t *edge = std::lower_bound(
+      first, last, c, [](const edge_t &e, uint32_t v) { return e.c < v; });
+    return (edge != last && edge->c == c) ? edge->next : 0;
+  };
+  for (uint32_t node = 0; node < nb_nodes; ++node) {
+    for (uint32_t e = first_edge[node]; e < first_edge[node + 1]; ++e) {
+      uint32_t next = edges[e].next;
+      uint32_t suffix = 0;
+      if (node != 0) {
+        for (suffix = failure[node];; suffix = failure[suffix]) {
+          uint32_t suffix_child = child(suffix, edges[e].c);
+          if (suffix_child != 0 || suffix == 0) {
+            suffix = suffix_child;
+            break;
+          }
+        }
+      }
+      failure[next] = suffix;
+      m_output_links[next] = m_first_tag[suffix] != m_first_tag[suffix + 1] ?
+        suffix : m_output_links[suffix];
+    }
+  }
+  auto output = [&](uint32_t node) -> uint32_t {
+    return (m_first_tag[node] != m_first_tag[node + 1] ||
+            m_output_links[node] != 0) ? AC_OUTPUT_BIT : 0;
+  };
+  // The rows of the nodes closest to the root, completed with the rows of
+  // their suffixes
+  m_nb_dense = std::min<size_t>(
+    nb_nodes, std::max<size_t>(1, AC_DENSE_SIZE / (m_stride * 4)));
+  m_transitions.assign((size_t) m_nb_dense * m_stride, 0);
+  for (uint32_t node = 0; node < m_nb_dense; ++node) {
+    uint32_t *row = &m_transitions[(size_t) node * m_stride];
+    if (node != 0) {
+      const uint32_t *suffix_row = &m_transitions[(size_t) failure[node] *
+                                                  m_stride];
+      std::copy(suffix_row, suffix_row + m_stride, row);
+    }
+    for (uint32_t e = first_edge[node]; e < first_edge[node + 1]; ++e)
+      row[edges[e].c] = edges[e].next | output(edges[e].next);
+  }
+  // The other nodes keep their children and their failure links
+  uint32_t base = first_edge[m_nb_dense];
+  m_first_edge.assign(first_edge.begin() + m_nb_dense, first_edge.end());
+  for (uint32_t &e: m_first_edge) e -= base;
+  m_edges.assign(edges.begin() + base, edges.end());
+  for (edge_t &edge: m_edges) edge.next |= output(edge.next);
+  m_failure.assign(failure.begin() + m_nb_dense, failure.end());
+  LOGDBG("Aho-Corasick automaton of " << literals.size() << " literals: "
+         << nb_nodes << " nodes, " << m_nb_dense << " in the DFA, "
+         << m_stride << " byte classes");
+}
+
+bool AhoCorasick::fits(const std::vector<std::string> &literals) {
+  size_t size = 0;
+  for (const std::string &literal: literals) size += literal.size();
+  return size <= AC_MAX_LITERALS_SIZE;
+}
+
+void AhoCorasick::report(uint32_t node, tag_set_t &matched) const {
+  do {
+    for (uint32_t i = m_first_tag[node]; i < m_first_tag[node + 1]; ++i)
+      matched.insert(m_tags[i]);
+    node = m_output_links[node];
+  } while (node != 0);
+}
+
+uint32_t AhoCorasick::next(uint32_t node, uint32_t c) const {
+  // The deeper nodes fall back to their suffixes until one has a child on c
+  // or is in the DFA
+  while (node >= m_nb_dense) {
+    const edge_t *first = m_edges.data() + m_first_edge[node - m_nb_dense];
+    const edge_t *last = m_edges.data() + m_first_edge[node - m_nb_dense + 1];
+    const edge_t *edge = std::lower_bound(
+      first, last, c, [](const edge_t &e, uint32_t v) { return e.c < v; });
+    if (edge != last && edge->c == c) return edge->next;
+    node = m_failure[node - m_nb_dense];
+  }
+  return m_transitions[(size_t) node * m_stride + c];
+}
+
+void AhoCorasick::search(const char *text, size_t size,
+                         tag_set_t &matched) const {
+  const uint8_t *bytes = (const uint8_t *) text;
+  // The empty literals, which end at the root, occur in any text
+  (*this).report(0, matched);
+  uint32_t node = 0;
+  for (size_t i = 0; i < size; ++i) {
+    uint32_t t = (*this).next(node, m_byte_classes[bytes[i]]);
+    node = t & ~AC_OUTPUT_BIT;
+    if (t & AC_OUTPUT_BIT) (*this).report(node, matched);
+  }
+}
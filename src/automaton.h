@@ -0,0 +1,270 @@
+/*! \brief Regex automata
+ *
+ * Regular expressions compiled to a NFA, and a DFA built lazily from it which
+ * finds the matches in a time linear in the length of the lines, whatever the
+ * pattern.
+ */
+
+#ifndef __AUTOMATON_H__
+#define __AUTOMATON_H__
+
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "types.h"
+
+// Maximum number of instructions of a program, the repetitions being expanded
+#define PROGRAM_MAX_SIZE 8192
+// Memory used by the states of a lazy DFA before they are flushed
+#define DFA_CACHE_SIZE (1024 * 1024)
+// Memory of the complete transitions of the nodes of an Aho-Corasick automaton
+// closest to its root, the other nodes only have their children
+#define AC_DENSE_SIZE (4 * 1024 * 1024)
+// Total size of the literals of an Aho-Corasick automaton, which takes about
+// 32 bytes per byte of the literals
+#define AC_MAX_LITERALS_SIZE (16 * 1024 * 1024)
+
+/* Zero-width assertions */
+enum class assertion_e {
+  BEGIN_TEXT,
+  END_TEXT,
+  WORD_BOUNDARY,
+  NOT_WORD_BOUNDARY
+};
+
+/*
+ * Instruction of a NFA program. The threads of a SPLIT following x have
+ * priority over the ones following y, which gives the leftmost-first
+ * (ECMAScript) semantic of the alternations and quantifiers.
+ */
+struct inst_t {
+  enum class op_e { BYTE, SPLIT, JMP, MATCH, ASSERT };
+  op_e              op;
+  int               x;          // next instruction
+  int               y;          // alternative next instruction of a SPLIT
+  int               pattern;    // pattern whose match is found by a MATCH
+  assertion_e       assertion;
+  std::bitset<256>  bytes;      // bytes accepted by a BYTE instruction
+
+  inst_t(op_e o, int nx, int ny = -1) : op(o), x(nx), y(ny), pattern(0),
+    assertion(assertion_e::BEGIN_TEXT) {}
+};
+
+/*
+ * A NFA program. The bytes are split in classes of bytes no instruction can
+ * tell apart, so the DFA has one transition per class instead of one per byte.
+ */
+struct program_t {
+  std::vector<inst_t> insts;
+  int                 start;
+  uint8_t             byte_classes[256];
+  int                 nb_classes;
+  // A byte of each class
+  std::vector<uint8_t> class_bytes;
+  bool                word_assertions;
+  // A repetition may iterate over the empty string: the program matches the
+  // same strings as the patterns, but not always at the same positions
+  bool                empty_loops;
+  // The program matches several patterns and tells which of them matched
+  bool                tagged;
+};
+
+/*
+ * Set of the tags of the patterns found in a text, which is cleared in a time
+ * proportional to the number of tags it contains
+ */
+struct tag_set_t {
+  std::vector<bool> contains;   // indexed by tag
+  std::vector<int>  tags;       // in the order they were found
+
+  inline void insert(int tag) {
+    if (contains[tag]) return;
+    contains[tag] = true;
+    tags.push_back(tag);
+  }
+  inline void clear() {
+    for (int tag: tags) contains[tag] = false;
+    tags.clear();
+  }
+  inline bool empty() const { return tags.empty(); }
+};
+
+/*
+ * Compile pattern (ECMAScript grammar) to a program. If reverse, the program
+ * matches the reversed strings, anchored at their beginning. Otherwise a match
+ * may begin anywhere in the text. If icase, the ASCII letters match both
+ * cases.
+ * Returns nullptr if the pattern is invalid or uses a construct an automaton
+ * cannot match (back references, lookaheads, POSIX classes).
+ */
+std::shared_ptr<const program_t> compile_program(const std::string &pattern,
+                                                 bool reverse,
+                                                 bool icase = false);
+/*
+ * Compile patterns to a single forward program matching any of them. The
+ * matches of patterns[i] are reported as tags[i], its letters match both cases
+ * if icase[i].
+ * Returns nullptr if one of the patterns cannot be compiled.
+ */
+std::shared_ptr<const program_t> compile_program(
+  const std::vector<std::string> &patterns, const std::vector<int> &tags,
+  const std::vector<bool> &icase);
+
+/*
+ * DFA whose states are built from the program as the text is scanned. Each
+ * byte costs one table lookup once its transition is known. A transition is
+ * computed in a time bounded by the size of the program, so the search stays
+ * linear when the states are flushed.
+ * The states are cached up to DFA_CACHE_SIZE bytes, then flushed.
+ * A LazyDfa shall only be used by one thread. Copies share the program but not
+ * the states.
+ */
+class LazyDfa {
+public:
+  /*
+   * With leftmost_first, the threads of lower priority than a match are
+   * dropped, as a backtracking engine would never try them
+   */
+  LazyDfa(std::shared_ptr<const program_t> program, bool leftmost_first);
+  LazyDfa(const LazyDfa &other);
+  /*
+   * Scan [text + from, text + size) with a forward program and set match_end
+   * to the end of the leftmost-first match beginning at or after from. The
+   * byte before from is the context of the assertions. Returns false if there
+   * is no match.
+   */
+  bool search_forward(const char *text, size_t size, size_t &match_end,
+                      size_t from = 0);
+  /*
+   * Scan [text + from, text + end) backward, from end, with a reverse program
+   * and set match_start to the lowest position, not before from, where a match
+   * ending at end begins. size is the size of the whole text, to evaluate the
+   * assertions at end. Returns false if there is no match.
+   */
+  bool search_backward(const char *text, size_t size, size_t end,
+                       size_t &match_start, size_t from = 0);
+  /*
+   * Scan [text, text + size) with a tagged program and add the tags of the
+   * patterns matching to matched
+   */
+  void search_all(const char *text, size_t size, tag_set_t &matched);
+
+private:
+  /*
+   * A state is the list of the instructions to execute on the next byte. The
+   * tags of the matches found by the transition leading to the state are
+   * kept with it for tagged programs.
+   */
+  struct state_t {
+    std::vector<int>  insts;
+    uint8_t           flags;
+    std::vector<int>  matches;
+  };
+  /* Offset in the transition table of the state to start with */
+  int start(uint8_t flags);
+  /*
+   * Compute the transition of the state at offset on the byte class c (or at
+   * the end of the text if c is nb_classes) and store it in the table. Returns
+   * the offset of the next state shifted left by one, with the lowest bit set
+   * if a match ends before the byte.
+   */
+  int transition(int offset, int c);
+  /* Offset of the state, which is created if it does not exist yet */
+  int find_state(const std::vector<int> &insts, uint8_t flags,
+                 const std::vector<int> &matches = std::vector<int>());
+  /* Drop all the states */
+  void flush();
+
+private:
+  std::shared_ptr<const program_t>      m_program;
+  bool                                  m_leftmost_first;
+  // Number of transitions per state, one per byte class and the end of text
+  int                                   m_stride;
+  std::vector<state_t>                  m_states;
+  std::vector<int>                      m_transitions;
+  std::unordered_map<std::string, int>  m_index;
+  int                                   m_starts[4];
+  size_t                                m_memory_size;
+  size_t                                m_nb_flushes;
+  // Work areas of transition()
+  std::vector<int>                      m_stack;
+  std::vector<int>                      m_next;
+  std::vector<int>                      m_matches;
+  std::vector<uint32_t>                 m_visited;
+  std::vector<uint32_t>                 m_added;
+  uint32_t                              m_generation;
+};
+
+/*
+ * Aho-Corasick automaton finding which of a set of literal strings occur in a
+ * text, in one pass whatever the number of strings. The nodes of the trie
+ * closest to its root, where most of the bytes of a text lead, are compiled
+ * to a complete DFA on the classes of the bytes of the strings, so each byte
+ * costs one table lookup. The deeper nodes only keep their children and follow
+ * their failure links to a node of the DFA, so the memory stays proportional
+ * to the size of the strings.
+ * The automaton is not modified by the searches and may be shared by threads.
+ */
+class AhoCorasick {
+public:
+  /*
+   * The occurrences of literals[i] are reported as tags[i]. Throws
+   * std::length_error if the literals do not fit (see fits()).
+   */
+  AhoCorasick(const std::vector<std::string> &literals,
+              const std::vector<int> &tags);
+  /*
+   * Return true if the literals are small enough to be compiled together, up
+   * to AC_MAX_LITERALS_SIZE bytes. Larger sets shall be searched one by one.
+   */
+  static bool fits(const std::vector<std::string> &literals);
+  /*
+   * Add the tags of the literals occurring in [text, text + size) to matched
+   */
+  void search(const char *text, size_t size, tag_set_t &matched) const;
+  inline size_t get_number_of_nodes() const { return m_output_links.size(); }
+  /* Number of the nodes compiled to the DFA */
+  inline size_t get_number_of_dense_nodes() const { return m_nb_dense; }
+
+private:
+  /* Child of a deeper node, the highest bit set as in m_transitions */
+  struct edge_t {
+    uint32_t  c;
+    uint32_t  next;
+  };
+  /*
+   * Next node of node on the byte class c, the highest bit set if a literal
+   * ends there
+   */
+  inline uint32_t next(uint32_t node, uint32_t c) const;
+  /* Add the tags of the literals ending at the node and its suffixes */
+  void report(uint32_t node, tag_set_t &matched) const;
+
+private:
+  uint16_t              m_byte_classes[256];
+  uint32_t              m_stride;
+  // The nodes are numbered breadth first. The nodes below m_nb_dense have a
+  // row of m_stride transitions, the next node of each byte class. The highest
+  // bit is set if a literal ends at the next node or at one of its suffixes.
+  uint32_t              m_nb_dense;
+  std::vector<uint32_t> m_transitions;
+  // Children of the other nodes, by class: node n has the edges
+  // m_edges[m_first_edge[n - m_nb_dense]] to
+  // m_edges[m_first_edge[n - m_nb_dense + 1] - 1]
+  std::vector<uint32_t> m_first_edge;
+  std::vector<edge_t>   m_edges;
+  // Longest proper suffix of the other nodes in the trie
+  std::vector<uint32_t> m_failure;
+  // Tags of the literals ending at each node: m_tags[m_first_tag[n]] to
+  // m_tags[m_first_tag[n + 1] - 1]
+  std::vector<uint32_t> m_first_tag;
+  std::vector<int>      m_tags;
+  // Longest proper suffix of each node at which a literal ends, 0 if none
+  std::vector<uint32_t> m_output_links;
+};
+
+#endif // __AUTOMATON_H__
@@ -9,37 +9,51 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <thread>
 #include <memory>
-#include <fstream>
 #include <iostream>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 #include <exception>
 #include <algorithm>
 
 #include "logmacros.h"
 #include "types.h"
 #include "model.h"
+#include "line_index.h"
+#include "index_cache.h"
 
-#define LINE_STATIC_SIZE 256
+// Size of the head of the file indexed first, so the first screen can be
+// displayed right away
+#define FIRST_LOAD_BLOCK_SIZE (1024 * 1024)
+// Size indexed by each core on every subsequent load
+#define LOAD_BLOCK_SIZE_PER_THREAD (32 * 1024 * 1024)
+// Address space reserved after the end of a followed file so the mapping can
+// grow in place (1TB, only address space, no memory is allocated)
+#define FOLLOW_RESERVED_SIZE ((size_t) 1 << 40)
+// Maximum time waited for the followed file to grow, in milliseconds. Also
+// used as the polling period when inotify is not available.
+#define FOLLOW_POLL_INTERVAL 100
 
 /*
- * This structure describes the text attributes to apply to a certain contiguous
- * text zone
+ * A line of text as a view into the memory of the buffer. The text is NOT null
+ * terminated and does not contain the end of line character(s).
  */
-struct tattr_t {
-  int attrs_mask;
-  uint start_pos;
-  uint end_pos;
+struct line_t {
+  const char *text;
+  size_t length;
 
-  tattr_t() : attrs_mask(0), start_pos(0), end_pos(0) {}
-  tattr_t(int am, uint sp, uint ep) : attrs_mask(am), start_pos(sp), end_pos(ep) {}
+  line_t() : text(nullptr), length(0) {}
+  line_t(const char *t, size_t l) : text(t), length(l) {}
 };
 
-/*
- * An array of array
- */
-typedef tattr_t *attr_list_t;
-
 /*
  * Custom exception raised when an error occurs on opening a file
  */
@@ -66,6 +80,14 @@ private:
   const std::string  m_reason;
 };
 
+/*
+ * How a buffer is going to be accessed, see IBuffer::advise
+ */
+enum class access_e {
+  SEQUENTIAL_ACCESS,  // scanned from the beginning to the end
+  RANDOM_ACCESS       // browsed
+};
+
 class IBuffer {
 public:
   /*!
@@ -73,126 +95,237 @@ public:
    */
   virtual bool is_binary() = 0;
   /*!
-   * Provide a pointer to a pointer to the text.
-   * Increment this pointer to get the next line.
+   * Provide a view on the line at index i. No copy of the text is made, the
+   * view points directly into the buffer memory.
    * Didn't use iterator to have no overhead at all.
    */
-  virtual char **get_text() const = 0;
+  virtual line_t get_line(lineno_t i) const = 0;
+  /*!
+   * Provide a view on the text of the lines [begin, end) when they are
+   * contiguous in the buffer memory, with the end of line characters between
+   * them. The text is nullptr if the buffer does not keep them contiguous.
+   */
+  virtual line_t get_block(lineno_t begin, lineno_t end) const = 0;
   /*!
    * Get/Set the number of lines in the buffer.
    */
-  virtual uint get_number_of_line() const = 0;
-  virtual void set_number_of_line(uint) = 0;
+  virtual lineno_t get_number_of_line() const = 0;
+  virtual void set_number_of_line(lineno_t) = 0;
   /*!
-   * Get/Set attributes of the buffer
+   * Index of the line i in the buffer the lines are taken from, e.g. the file
+   * buffer for a buffer of filtered lines
    */
-  virtual attr_list_t get_attrs() = 0;
-  virtual void clear_attrs() = 0;
+  virtual lineno_t get_original_line(lineno_t i) const = 0;
   /*!
    * Get/Set the current pointer (first line displayed) of the buffer
    */
-  virtual uint get_first_line_displayed() const = 0;
-  virtual void set_first_line_displayed(uint) = 0;
+  virtual lineno_t get_first_line_displayed() const = 0;
+  virtual void set_first_line_displayed(lineno_t) = 0;
+  /*!
+   * Load the next part of the buffer. It is called repeatedly by a background
+   * thread and the lines already loaded can be accessed in the meantime.
+   * Returns false once the whole buffer is loaded.
+   */
+  virtual bool load_more() = 0;
+  /*!
+   * Get the percentage of the buffer loaded
+   */
+  virtual uint get_loading_progress() const = 0;
+  /*!
+   * Tell the system how the buffer is going to be accessed
+   */
+  virtual void advise(access_e access) = 0;
+  /*!
+   * Start reading the text of the lines [i, i + count) in the background, so
+   * they can be displayed without waiting for the disk.
+   */
+  virtual void prefetch(lineno_t i, lineno_t count) = 0;
 };
 
 class Buffer : public IBuffer {
 public:
   Buffer() : m_first_line_displayed(0) {  }
-  virtual attr_list_t get_attrs() { return m_attrs; }
-  virtual uint get_first_line_displayed() const { return m_first_line_displayed; }
-  virtual void set_first_line_displayed(uint i) { m_first_line_displayed = i; }
-protected:
-  attr_list_t m_attrs;
+  /* By default, a buffer holds its own lines */
+  virtual lineno_t get_original_line(lineno_t i) const { return i; }
+  /* By default, the lines are not contiguous */
+  virtual line_t get_block(lineno_t, lineno_t) const { return line_t(); }
+  virtual lineno_t get_first_line_displayed() const { return m_first_line_displayed.load(); }
+  virtual void set_first_line_displayed(lineno_t i) { m_first_line_displayed.store(i); }
+  /* By default, a buffer is loaded on construction */
+  virtual bool load_more() { return false; }
+  virtual uint get_loading_progress() const { return 100; }
+  /* By default, a buffer is in memory and needs no hint */
+  virtual void advise(access_e) {}
+  virtual void prefetch(lineno_t, lineno_t) {}
 private:
-  uint m_first_line_displayed;
+  // Set by the view, and shifted by the FilterEngine when lines are added in
+  // front of the filtered ones
+  std::atomic<lineno_t> m_first_line_displayed;
 };
 
+/*
+ * A FileBuffer maps the file in memory and keeps an index of the offset at
+ * which each line starts. Lines are served as views into the mapping so no
+ * copy of the text is ever made.
+ * The index is built incrementally by load_more(), starting with the head of
+ * the file, so the lines can be displayed before the whole file is indexed.
+ * In follow mode, load_more() then waits for data to be appended to the file
+ * and indexes only the new tail, like tail -f.
+ * If an IndexCache is provided, the index is restored from it and saved into
+ * it once the whole file is indexed.
+ */
 class FileBuffer : public Buffer {
 public:
-  FileBuffer(const std::string &filepath) : Buffer(), m_filepath(filepath) {
+  FileBuffer(const std::string &filepath, bool follow = false,
+             std::shared_ptr<IndexCache> index_cache = nullptr) : Buffer(),
+    m_filepath(filepath), m_follow(follow), m_fd(-1), m_inotify_fd(-1),
+    m_data(nullptr), m_size(0), m_reserved_size(0), m_advice(MADV_NORMAL),
+    m_index_cache(index_cache), m_indexed_size(0), m_nb_lines(0)
+  {
     LOGDBG("FileBuffer constructor " << this);
+    // Open and map the file
+    (*this).map();
     // Check the file type (binary or text)
-    if (is_binary())
+    if (is_binary()) {
+      (*this).unmap();
       throw OpenFileException(m_filepath, "unsupported file type: binary");
-    // If text open it
-    m_file.open(m_filepath);
-    if (!m_file.is_open()) throw OpenFileException(m_filepath);
-    // Allocate the buffer
-    m_nb_lines = get_number_of_line();
-    // Null terimated string of pointers to char *
-    m_buffer = new char*[m_nb_lines + 1];
-    memset(m_buffer, 0, (m_nb_lines + 1) * sizeof (char*));
-    m_buffer[m_nb_lines] = 0;
-    // Load the whole file
-    (*this).load({0, -1});
-    // Initialize attrs array
-    m_attrs = new tattr_t[m_nb_lines + 1];
-    (*this).clear_attrs();
-    LOGINF("FileBuffer loaded (" << this << ")");
+    }
+    // Watch the file for appended data
+    if (m_follow) (*this).watch();
+    // The first line starts at the beginning of the file
+    m_line_offsets.push_back(0);
+    LOGINF("FileBuffer opened (" << this << ")");
   }
 
   ~FileBuffer() {
     LOGDBG("FileBuffer destructor " << this);
-    m_file.close();
-    for (uint i = 0; i < m_nb_lines; ++i)
-      if (m_buffer[i]) delete m_buffer[i];
-    delete[] m_buffer;
-    delete[] m_attrs;
+    (*this).unmap();
   }
 
   /*
-   * Get pointers to the line indicated by line_number
+   * Get a view on the line indicated by line_number
    */
-  char** get_text() const {
-    LOGDBG("get_text");
-    return m_buffer;
+  line_t get_line(lineno_t line_number) const {
+    // Each offset points to the beginning of a line. The next offset is one
+    // character past the \n of the line (see index()).
+    offset_t begin = m_line_offsets[line_number];
+    size_t length = m_line_offsets[line_number + 1] - begin - 1;
+    // Strip the \r of files with DOS line endings
+    if (length > 0 && m_data[begin + length - 1] == '\r') --length;
+    return line_t(m_data + begin, length);
   }
 
   /*
-   * Reset the attributes array
+   * Get a view on the lines [begin, end), which are contiguous in the mapping
    */
-  virtual void clear_attrs() {
-    memset(m_attrs, 0, (m_nb_lines + 1) * sizeof (tattr_t));
+  line_t get_block(lineno_t begin, lineno_t end) const {
+    offset_t first = m_line_offsets[begin];
+    // The \n of the last line is not part of the block
+    return line_t(m_data + first, m_line_offsets[end] - first - 1);
   }
 
   /*
-   * Get the number of lines of the text file.
-   * At the end of this call, file header is at the beginning of the file
-   * This function is a memoizer.
+   * Get the number of lines of the text file indexed so far.
    */
-  uint get_number_of_line() const {
-    static uint line_count = get_number_of_line_();
-    return line_count;
+  lineno_t get_number_of_line() const {
+    return m_nb_lines.load(std::memory_order_acquire);
   }
 
-  uint get_number_of_line_() const {
-    std::ifstream ifs(m_filepath);
-    // new lines will be skipped unless we stop it from happening:
-    //m_file.unsetf(std::ios_base::skipws); really ???
-    // count the newlines
-    uint line_count = 0;
-    while (!ifs.eof()) {
-      int c = ifs.get();
-      if (c == '\n') line_count++;
+  /*
+   * Index the next block of the file. The first block is small and indexed on
+   * the calling thread, the following ones are split between all the cores.
+   */
+  bool load_more() {
+    size_t indexed_size = m_indexed_size.load(std::memory_order_relaxed);
+    if (indexed_size >= m_size) {
+      if (!m_follow) return false;
+      // Everything is indexed, wait for the file to grow
+      (*this).wait_for_data();
+      (*this).grow();
+      return m_follow;
+    }
+    // Restore the index from the cache on the first call
+    if (indexed_size == 0 && m_index_cache) {
+      indexed_size = m_index_cache->load(m_fd, m_data, m_size, m_line_offsets);
+      if (indexed_size != 0) {
+        m_nb_lines.store(m_line_offsets.size() - 1, std::memory_order_release);
+        m_indexed_size.store(indexed_size, std::memory_order_release);
+        // The index is up to date if only an unterminated line is left, no
+        // need to save it again then
+        if (!memchr(m_data + indexed_size, '\n', m_size - indexed_size))
+          m_index_cache.reset();
+        return true;
+      }
     }
-    return line_count;
+    size_t block_size = FIRST_LOAD_BLOCK_SIZE;
+    if (indexed_size != 0)
+      block_size = (size_t) LOAD_BLOCK_SIZE_PER_THREAD *
+        std::max(1u, std::thread::hardware_concurrency());
+    block_size = std::min(block_size, m_size - indexed_size);
+    index_lines_parallel(m_data + indexed_size, block_size, indexed_size,
+                         m_line_offsets);
+    indexed_size += block_size;
+    // Last line is not terminated by a \n. When following the file, the line
+    // is published once its \n is written.
+    if (!m_follow && indexed_size == m_size && m_line_offsets.back() != m_size)
+      m_line_offsets.push_back(m_size + 1);
+    // Publish the new lines. The last offset is the beginning of a line not
+    // completely indexed yet (or the sentinel).
+    m_nb_lines.store(m_line_offsets.size() - 1, std::memory_order_release);
+    m_indexed_size.store(indexed_size, std::memory_order_release);
+    // Save the index once the whole file is indexed
+    if (indexed_size == m_size && m_index_cache) {
+      m_index_cache->save(m_fd, m_data, m_size, m_line_offsets);
+      m_index_cache.reset();
+    }
+    return m_follow || indexed_size < m_size;
+  }
+
+  uint get_loading_progress() const {
+    size_t size = m_size.load(std::memory_order_acquire);
+    if (size == 0) return 100;
+    return m_indexed_size.load(std::memory_order_acquire) * 100 / size;
+  }
+
+  /*
+   * Set the paging policy of the mapping: read ahead aggressively while the
+   * file is scanned, only read the pages needed while it is browsed.
+   */
+  void advise(access_e access) {
+    m_advice = (access == access_e::SEQUENTIAL_ACCESS) ? MADV_SEQUENTIAL
+                                                       : MADV_RANDOM;
+    size_t size = m_size.load(std::memory_order_acquire);
+    if (m_data && size) madvise((void *) m_data, size, m_advice);
+  }
+
+  /*
+   * Ask the kernel to read the pages of the lines [i, i + count) in the
+   * background
+   */
+  void prefetch(lineno_t i, lineno_t count) {
+    lineno_t nb_lines = (*this).get_number_of_line();
+    if (i >= nb_lines || count == 0) return;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    offset_t begin = m_line_offsets[i] & ~(page_size - 1);
+    offset_t end = std::min((offset_t) m_size.load(std::memory_order_acquire),
+                            m_line_offsets[std::min(i + count, nb_lines)]);
+    if (begin < end)
+      madvise((void *) (m_data + begin), end - begin, MADV_WILLNEED);
   }
 
   /*
    * This functions does nothing on a file buffer
    */
-  void set_number_of_line(uint) { /* Not applicable */ };
+  void set_number_of_line(lineno_t) { /* Not applicable */ };
 
   /*
    * This method is just an heuristic. Could be completely wrong.
    * If it is, there is a bigger chance that it returns false instead of true,
    * which is acceptable. We can always open binary file as text, but not being
    * able to open legitimate text file would be a problem.
-   * This function is a memoizer.
    */
   bool is_binary() {
-    static bool is_bin = is_file_binary(m_filepath, 100);
-    return is_bin;
+    return is_data_binary(m_data, std::min((size_t) 100, m_size.load()));
   }
 
   /*
@@ -201,29 +334,8 @@ public:
   inline const std::string &get_filepath() const { return (*this).m_filepath; }
 
 protected:
-  bool is_file_binary(const std::string &filepath, size_t test_len) {
-    // Open the file in bniary
-    std::ifstream ifs(filepath, std::ifstream::binary);
-    // Check file is opened
-    if (!ifs.is_open()) throw OpenFileException(filepath);
-    // get pointer to associated buffer object
-    std::filebuf* pbuf = ifs.rdbuf();
-    // get file size using buffer's members
-    std::size_t size = pbuf->pubseekoff(0, ifs.end, ifs.in);
-    pbuf->pubseekpos(0, ifs.in);
-    // Read at most test_len bytes, that should be enougth
-    std::size_t read_size = std::min(test_len, size);
-    // allocate memory to contain file data
-    char* buffer = new char[read_size];
-    // get file data
-    pbuf->sgetn(buffer, read_size);
-    // Get the answer
-    bool is_bin = (*this).is_data_binary(buffer, read_size);
-    delete[] buffer;
-    return is_bin;
-  }
-
   bool is_data_binary(const void *data, size_t len) {
+    if (data == nullptr) return false;
     const char *pc = (const char *) memchr(data, '\0', len);
     if (pc != NULL) {
       LOGERR("found character \\0 at "
@@ -233,75 +345,140 @@ protected:
   }
 
   /*
-   * Load the interval from the file into the buffer
+   * Open the file and map it in memory. An empty file is not mapped, unless it
+   * is followed. A followed file is mapped at the beginning of a reserved
+   * address range so it can grow without being moved (see grow()).
    */
-  bool load(std::pair<uint, uint> interval) {
-    // put read head at the beginning of the file
-    m_file.seekg(m_file.beg);
-    // pass the first lines
-    char line[LINE_STATIC_SIZE];
-    for (uint i = 0; i < interval.first && !m_file.eof(); ) {
-      m_file.getline(line, LINE_STATIC_SIZE, '\n');
-      // Did we return because we found a carriage return or because the line is
-      // too long ?
-      if (!m_file.fail()) i++;
+  void map() {
+    m_fd = open(m_filepath.c_str(), O_RDONLY);
+    if (m_fd == -1) throw OpenFileException(m_filepath, strerror(errno));
+    struct stat st;
+    if (fstat(m_fd, &st) == -1) {
+      int err = errno;
+      (*this).unmap();
+      throw OpenFileException(m_filepath, strerror(err));
+    }
+    if (!S_ISREG(st.st_mode)) {
+      (*this).unmap();
+      throw OpenFileException(m_filepath, "not a regular file");
     }
-    // load lines up to line interval.second.
-    // If pass -1, the we suppose 2^32-1 is the maximum of number of lines for
-    // the file we manage
-    for (uint i = 0; i < interval.second && !m_file.eof() && !m_file.fail(); ++i)
-    {
-      // Get next line size
-      uint next_line_size = get_next_line_size();
-      // Allocate the new string + 1 for the carriage return
-      char *newline = new char[next_line_size];
-      // retrieve it
-      m_file.getline(newline, next_line_size);
-      // set it in the buffer
-      m_buffer[i] = newline;
+    m_size = st.st_size;
+    void *data = nullptr;
+    if (m_follow) {
+      m_reserved_size = m_size + FOLLOW_RESERVED_SIZE;
+      data = mmap(nullptr, m_reserved_size, PROT_NONE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (data != MAP_FAILED) {
+        m_data = (const char *) data;
+        if (m_size != 0)
+          data = mmap(data, m_size, PROT_READ, MAP_SHARED | MAP_FIXED, m_fd, 0);
+      }
+    } else if (m_size != 0) {
+      data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
     }
-    return true;
+    if (data == MAP_FAILED) {
+      int err = errno;
+      (*this).unmap();
+      throw OpenFileException(m_filepath, strerror(err));
+    }
+    m_data = (const char *) data;
+  }
+
+  void unmap() {
+    if (m_data) munmap((void *) m_data, m_reserved_size ? m_reserved_size
+                                                         : m_size.load());
+    if (m_fd != -1) close(m_fd);
+    if (m_inotify_fd != -1) close(m_inotify_fd);
+    m_data = nullptr;
+    m_fd = -1;
+    m_inotify_fd = -1;
   }
 
   /*
-   * Get the size of the next line (up to the character \n or eof)
+   * Register the file to inotify. If it fails, the file size is polled.
    */
-  uint get_next_line_size() {
-    // If already end of file, return 0
-    if (m_file.eof()) return 0;
-    // Get current position
-    std::streampos pos = m_file.tellg();
-    // Statically allocate the receiving memory
-    char line[LINE_STATIC_SIZE];
-    // block_count is used if several getline are necessary to get the full line
-    // up to the next \n ot eof.
-    uint block_count = 0;
-    bool found_new_line = false;
-    while (!m_file.eof() && !found_new_line) {
-      m_file.getline(line, LINE_STATIC_SIZE, '\n');
-      // as long as we don't find a \n (fail) or end of file (eof)
-      found_new_line = !m_file.fail();
-      // Reset the fail bit so ifstream can continue to read...
-      m_file.clear(m_file.rdstate() & ~std::ios::failbit);
-      if (!found_new_line) block_count++;
+  void watch() {
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd != -1 &&
+        inotify_add_watch(m_inotify_fd, m_filepath.c_str(), IN_MODIFY) == -1) {
+      close(m_inotify_fd);
+      m_inotify_fd = -1;
+    }
+    if (m_inotify_fd == -1)
+      LOGERR("inotify not available (" << strerror(errno) << "), polling "
+             << m_filepath);
+  }
+
+  /*
+   * Wait for the file to be modified, FOLLOW_POLL_INTERVAL at most so the
+   * loading thread can be interrupted.
+   */
+  void wait_for_data() {
+    if (m_inotify_fd == -1) {
+      poll(nullptr, 0, FOLLOW_POLL_INTERVAL);
+      return;
+    }
+    struct pollfd pfd = { m_inotify_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, FOLLOW_POLL_INTERVAL) > 0) {
+      // Drain the events, we only need to know something changed
+      char events[4096];
+      while (read(m_inotify_fd, events, sizeof (events)) > 0);
+    }
+  }
+
+  /*
+   * Extend the mapping to the current size of the file. The new pages are
+   * mapped in the reserved range right after the previous ones so the views
+   * already handed out stay valid.
+   * Following stops if the file is truncated (e.g. log rotation) or outgrows
+   * the reserved range.
+   */
+  void grow() {
+    struct stat st;
+    if (fstat(m_fd, &st) == -1) {
+      LOGERR("fstat failed on " << m_filepath << ": " << strerror(errno));
+      return;
+    }
+    size_t size = m_size.load(std::memory_order_relaxed);
+    size_t new_size = st.st_size;
+    if (new_size == size) return;
+    if (new_size < size || new_size > m_reserved_size) {
+      LOGERR(m_filepath << " truncated or too big, stop following");
+      m_follow = false;
+      return;
+    }
+    // Remap from the last partial page, the file offset must be page aligned
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t offset = size & ~(page_size - 1);
+    if (mmap((void *) (m_data + offset), new_size - offset, PROT_READ,
+             MAP_SHARED | MAP_FIXED, m_fd, offset) == MAP_FAILED) {
+      LOGERR("mmap failed on " << m_filepath << ": " << strerror(errno));
+      m_follow = false;
+      return;
     }
-    // Total number of count for the line
-    uint char_count = m_file.gcount() + block_count * LINE_STATIC_SIZE;
-    // reset position where is used to be.
-    // Since c++11, ifstreams can seekg away from eof.
-    // However, if no character has been read and eof is reached, don't seek back.
-    if (char_count != 0 || !m_file.eof()) m_file.seekg(pos);
-    return char_count;
+    // The new pages get the paging policy of the rest of the file
+    madvise((void *) (m_data + offset), new_size - offset, m_advice);
+    m_size.store(new_size, std::memory_order_release);
   }
 
 protected:
-  std::string         m_filepath;
-  std::ifstream       m_file;
-  char                **m_buffer;
-  uint                m_nb_lines;
+  std::string                 m_filepath;
+  bool                        m_follow;
+  int                         m_fd;
+  int                         m_inotify_fd;
+  const char                  *m_data;
+  std::atomic<size_t>         m_size;
+  size_t                      m_reserved_size;
+  std::atomic<int>            m_advice;
+  // Released once the index is saved
+  std::shared_ptr<IndexCache> m_index_cache;
+  // The index is built by the loading thread
+  LineIndex                   m_line_offsets;
+  std::atomic<size_t>         m_indexed_size;
+  std::atomic<lineno_t>       m_nb_lines;
 
 private:
   FileBuffer(const FileBuffer &b) = delete;
 };
 
-#endif // __BUFFER_H__
\ No newline at end of file
+#endif // __BUFFER_H__
@@ -11,6 +11,7 @@
 
 #include "logmacros.h"
 #include "buffer.h"
+#include "stream_buffer.h"
 
 /*!
  * Factory for IBuffer objects.
@@ -25,13 +26,39 @@ public:
 
 /*!
  * Implementation of the IBufferFactory interface.
+ * If follow is true, the buffers created follow the data appended to their
+ * file. The line indexes are cached in the default IndexCache directory.
+ * The filepath "-" designates the standard input, provided as stdin_fd as the
+ * application reads the terminal on its own standard input. It can only be
+ * opened once. Named pipes are read as streams too.
  */
 class BufferFactory : public IBufferFactory {
+public:
+  BufferFactory(bool follow = false, int stdin_fd = -1) : m_follow(follow),
+    m_stdin_fd(stdin_fd),
+    m_index_cache(std::make_shared<IndexCache>(IndexCache::default_directory()))
+  {}
   std::unique_ptr<IBuffer> create_buffer(const std::string &filepath) {
     LOGDBG("Create buffer with filepath: " << filepath);
+    if (filepath == "-") {
+      if (m_stdin_fd == -1)
+        throw OpenFileException(filepath, "standard input already read");
+      int fd = m_stdin_fd;
+      m_stdin_fd = -1;
+      return std::unique_ptr<IBuffer>(new StreamBuffer(fd, filepath));
+    }
+    struct stat st;
+    if (stat(filepath.c_str(), &st) == 0 && S_ISFIFO(st.st_mode))
+      return std::unique_ptr<IBuffer>(new StreamBuffer(filepath));
 //    return std::make_unique<IBuffer>(filepath);
-    return std::unique_ptr<IBuffer>(new FileBuffer(filepath));
+    return std::unique_ptr<IBuffer>(new FileBuffer(filepath, m_follow,
+                                                   m_index_cache));
   }
+private:
+  bool m_follow;
+  int  m_stdin_fd;
+  // Shared with the buffers which save their index from their loading thread
+  std::shared_ptr<IndexCache> m_index_cache;
 };
 
 #endif // __BUFFER_H__
\ No newline at end of file
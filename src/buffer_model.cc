@@ -1,94 +1,158 @@
 #include <mutex>
 #include <cstring>
+#include <algorithm>
 /* TODO: Probably not a good idea to include that here */
-#include <curses.h>
 #include "logmacros.h"
 #include "buffer.h"
 #include "buffer_model.h"
 #include "processor.h"
 
-BufferModel::BufferModel(std::shared_ptr<IBuffer> &&buffer) :
-  m_display_attributes(true), m_filter(*this),
-  m_file_buffer(std::dynamic_pointer_cast<FileBuffer>(buffer))
+BufferModel::BufferModel(std::shared_ptr<IBuffer> &&buffer,
+                         std::shared_ptr<MatcherCache> matcher_cache,
+                         std::shared_ptr<WorkerPool> workers) :
+  m_display_attributes(true),
+  m_loading_progress(0), m_filter(*this, workers),
+  m_loader(*this),
+  m_file_buffer(buffer), m_view_shift(0),
+  m_matcher_cache(matcher_cache ? matcher_cache :
+                  std::make_shared<MatcherCache>()),
+  m_filter_processing_progress(100), m_filtering_changed(false),
+  m_nb_scans(0)
 {
   LOGDBG("BufferModel creator " << this);
   // Set the current buffer as the file buffer
-  set_current_buffer(std::dynamic_pointer_cast<IBuffer>(m_file_buffer));
+  set_current_buffer(m_file_buffer);
   // By default, we will OR the filtering matches
   m_filter_set.land = false;
   // Before starting the filter thread, initialize the FilteredBuffer which will
   // be zeroed by the thread. This is not optimal as we will allocate memory
   // that we won't be using now if ever.
   m_filtered_buffer = std::make_shared<FilteredBuffer>(buffer);
+  m_pending_buffer = m_filtered_buffer;
   // Should be started elsewhere. In the controller ?
   m_filter.start();
+  // Load the file in the background
+  m_loader.start();
 }
 
 BufferModel::~BufferModel() {
   LOGDBG("BufferModel desctructor " << this);
+  // Stop the threads before the buffers they use are released
+  m_loader.join();
+  m_filter.join();
 }
 
 void BufferModel::set_current_buffer(std::shared_ptr<IBuffer> buffer) {
-  m_current_buffer = buffer;
+  {
+    std::lock_guard<std::mutex> lock(m_buffer_mutex);
+    std::atomic_store(&m_current_buffer, buffer);
+  }
   notify_observers();
 }
 
-char ** BufferModel::get_text() {
-  return m_current_buffer->get_text();
+std::shared_ptr<IBuffer> BufferModel::get_current_buffer() const {
+  return std::atomic_load(&m_current_buffer);
+}
+
+line_t BufferModel::get_line(lineno_t i) const {
+  return (*this).get_current_buffer()->get_line(i);
 }
 
-uint BufferModel::get_number_of_line() const {
-  return m_current_buffer->get_number_of_line();
+lineno_t BufferModel::get_number_of_line() const {
+  return (*this).get_current_buffer()->get_number_of_line();
 }
 
-void BufferModel::set_number_of_line(uint i) {
-  return m_current_buffer->set_number_of_line(i);
+void BufferModel::set_number_of_line(lineno_t i) {
+  return (*this).get_current_buffer()->set_number_of_line(i);
   notify_observers();
 }
 
-uint BufferModel::get_first_line_displayed() const {
-  return m_current_buffer->get_first_line_displayed();
+lineno_t BufferModel::get_first_line_displayed() const {
+  return (*this).get_current_buffer()->get_first_line_displayed();
 }
 
-void BufferModel::set_first_line_displayed(uint i) {
-  m_current_buffer->set_first_line_displayed(i);
+void BufferModel::set_first_line_displayed(lineno_t i) {
+  std::shared_ptr<IBuffer> buffer = (*this).get_current_buffer();
+  {
+    // Not to be interleaved with a shift of the filtered lines displayed
+    std::lock_guard<std::mutex> lock(m_view_mutex);
+    buffer->set_first_line_displayed(i);
+    if (buffer == m_pending_buffer) m_view_shift = 0;
+  }
+  // Read the lines around the new position in the background, so scrolling
+  // does not wait for the disk
+  lineno_t first = (i > BUFFER_PREFETCH_LINES) ? i - BUFFER_PREFETCH_LINES : 0;
+  buffer->prefetch(first, i - first + 2 * BUFFER_PREFETCH_LINES);
   notify_observers();
 }
 
-attr_list_t BufferModel::get_attrs() {
-  return m_current_buffer->get_attrs();
+Highlighter &BufferModel::get_highlighter() {
+  return m_highlighter;
 }
 
-void BufferModel::clear_attrs() {
-  m_current_buffer->clear_attrs();
-  notify_observers();
+std::unique_lock<std::mutex> BufferModel::lock_view() {
+  return std::unique_lock<std::mutex>(m_view_mutex);
 }
 
 void BufferModel::clear_filtered_line() {
-  m_filtered_buffer->clear();
+  (*this).set_filtered_buffer(std::make_shared<FilteredBuffer>(m_file_buffer));
   notify_observers();
 }
 
-void BufferModel::add_filtered_line(char *line) {
-  m_filtered_buffer->add_line(line);
+void BufferModel::new_filtered_buffer(
+  const std::vector< std::shared_ptr<Matcher> > &filters) {
+  std::lock_guard<std::mutex> lock(m_view_mutex);
+  m_pending_buffer = std::make_shared<FilteredBuffer>(m_file_buffer);
+  m_pending_filters = filters;
+  m_view_shift = 0;
+}
+
+void BufferModel::publish_filtered_buffer() {
+  if (std::atomic_load(&m_filtered_buffer) == m_pending_buffer) return;
+  (*this).set_filtered_buffer(m_pending_buffer);
+  // The lines displayed are highlighted with the filters they matched
+  m_highlighter.set_filters(m_pending_filters);
+  m_filtering_changed = true;
+}
+
+void BufferModel::set_filtered_buffer(std::shared_ptr<FilteredBuffer> buffer) {
+  {
+    std::lock_guard<std::mutex> lock(m_buffer_mutex);
+    // The filtered view displays the new buffer at once
+    if (std::atomic_load(&m_current_buffer) == m_filtered_buffer)
+      std::atomic_store(&m_current_buffer,
+                        std::static_pointer_cast<IBuffer>(buffer));
+    std::atomic_store(&m_filtered_buffer, buffer);
+  }
 }
 
 void BufferModel::enable_filtering() {
   LOGDBG("switch buffer to filtered view");
-  m_current_buffer = m_filtered_buffer;
+  {
+    std::lock_guard<std::mutex> lock(m_buffer_mutex);
+    std::atomic_store(&m_current_buffer,
+                      std::static_pointer_cast<IBuffer>(m_filtered_buffer));
+  }
   notify_observers();
 }
 
 void BufferModel::disable_filtering() {
   LOGDBG("switch buffer to UNfiltered view");
-  m_current_buffer = m_file_buffer;
+  {
+    std::lock_guard<std::mutex> lock(m_buffer_mutex);
+    std::atomic_store(&m_current_buffer, m_file_buffer);
+  }
   notify_observers();
 }
 
-std::shared_ptr<FileBuffer> BufferModel::get_file_buffer() {
+std::shared_ptr<IBuffer> BufferModel::get_file_buffer() {
   return m_file_buffer;
 }
 
+std::shared_ptr<MatcherCache> BufferModel::get_matcher_cache() {
+  return m_matcher_cache;
+}
+
 void BufferModel::retrieve_filter_set(filter_set_t &filter_set) {
   std::lock_guard<std::mutex> lock(m_filter_set_mutex);
   filter_set = m_filter_set;
@@ -96,13 +160,25 @@ void BufferModel::retrieve_filter_set(filter_set_t &filter_set) {
 
 void BufferModel::add_filter(const std::string &filter) {
   std::lock_guard<std::mutex> lock(m_filter_set_mutex);
-  // Add the new regex to the set of filters of the current buffer
+  // Add the new regex to the set of filters of the current buffer. It is
+  // compiled by the filtering thread, not to delay the user input.
   set_filter_set().update().filters.emplace_back(
-    std::make_pair(filter, std::regex(filter)));
+    std::make_pair(filter, nullptr));
   // Signal the filtering processor
   m_filter.signal();
 }
 
+void BufferModel::add_filters(const std::vector<std::string> &filters) {
+  std::lock_guard<std::mutex> lock(m_filter_set_mutex);
+  {
+    Update<filter_set_t> update = set_filter_set();
+    for (const std::string &filter: filters)
+      update.update().filters.emplace_back(std::make_pair(filter, nullptr));
+  }
+  // Signal the filtering processor once for all the filters
+  m_filter.signal();
+}
+
 void BufferModel::update_last_filter(const std::string &filter) {
   std::lock_guard<std::mutex> lock(m_filter_set_mutex);
   {
@@ -110,8 +186,7 @@ void BufferModel::update_last_filter(const std::string &filter) {
     // Remove the current filter...
     update.update().filters.pop_back();
     // ... and replace it with the new value.
-    update.update().filters.emplace_back(
-      std::make_pair(filter, std::regex(filter)));
+    update.update().filters.emplace_back(std::make_pair(filter, nullptr));
   }
   // Signal the filtering processor
   m_filter.signal();
@@ -124,16 +199,93 @@ void BufferModel::remove_last_filter() {
   m_filter.signal();
 }
 
-void BufferModel::add_match(char *line, uint filtered_line_index,
-                            uint start_pos, uint end_pos) {
-  (*this).add_filtered_line(line);
-  // Add the matching information as attributes
-  m_current_buffer->get_attrs()[filtered_line_index].start_pos = start_pos;
-  m_current_buffer->get_attrs()[filtered_line_index].end_pos = end_pos;
-  // Set the attribute at the end as it is the key to determine if an attribute
-  // is set and we don't want the view thread to consider the attribute set when
-  // the position are not yet set
-  m_current_buffer->get_attrs()[filtered_line_index].attrs_mask = A_REVERSE;
-  LOGDBG("add attr line " << filtered_line_index);
+void BufferModel::begin_scan() {
+  std::lock_guard<std::mutex> lock(m_scan_mutex);
+  if (m_nb_scans++ == 0) m_file_buffer->advise(access_e::SEQUENTIAL_ACCESS);
+}
+
+void BufferModel::end_scan() {
+  std::lock_guard<std::mutex> lock(m_scan_mutex);
+  if (--m_nb_scans == 0) m_file_buffer->advise(access_e::RANDOM_ACCESS);
+}
+
+void BufferModel::get_filtered_lines(std::vector<lineno_t> &lines) const {
+  m_pending_buffer->get_filtered_lines(lines);
+}
+
+void BufferModel::set_filter_processing_progress(uint progress) {
+  if (m_filter_processing_progress.exchange(progress) != progress)
+    m_filtering_changed = true;
+}
+
+std::chrono::milliseconds BufferModel::notify_filtering(bool now) {
+  using namespace std::chrono;
+  if (!m_filtering_changed) return milliseconds(0);
+  steady_clock::time_point time = steady_clock::now();
+  milliseconds elapsed =
+    duration_cast<milliseconds>(time - m_filtering_notified);
+  if (!now && elapsed < milliseconds(BUFFER_FRAME_INTERVAL_MS))
+    return milliseconds(BUFFER_FRAME_INTERVAL_MS) - elapsed;
+  m_filtering_changed = false;
+  m_filtering_notified = time;
   notify_observers();
+  return milliseconds(0);
+}
+
+void BufferModel::add_filtered_lines(const std::vector<lineno_t> &lines,
+                                     lineno_t origin) {
+  if (lines.empty()) return;
+  // The lines matched again by narrower filters are added in order, the ones
+  // before the line displayed too
+  lineno_t nb_before = std::lower_bound(lines.begin(), lines.end(), origin) -
+    lines.begin();
+  {
+    std::lock_guard<std::mutex> lock(m_view_mutex);
+    m_pending_buffer->add_lines(lines.data(), lines.size());
+    (*this).shift_view(nb_before);
+  }
+  LOGDBG("add " << lines.size() << " filtered lines");
+  // The first lines of a new filtering replace the previous ones in the view
+  (*this).publish_filtered_buffer();
+  m_filtering_changed = true;
+}
+
+void BufferModel::add_filtered_lines_front(
+  const std::vector<lineno_t> &lines) {
+  if (lines.empty()) return;
+  // The lines are added in front, the last one first
+  std::vector<lineno_t> reversed(lines.rbegin(), lines.rend());
+  {
+    // The pending buffer might be displayed already, and scrolled meanwhile.
+    // The view sees the lines added with the shift keeping it on its line.
+    std::lock_guard<std::mutex> lock(m_view_mutex);
+    m_pending_buffer->add_lines_front(reversed.data(), reversed.size());
+    (*this).shift_view(lines.size());
+  }
+  LOGDBG("add " << lines.size() << " filtered lines in front");
+  (*this).publish_filtered_buffer();
+  m_filtering_changed = true;
+}
+
+void BufferModel::shift_view(lineno_t nb) {
+  // The view stays on the last line until the lines after the ones added
+  // before it are filtered
+  lineno_t first = m_pending_buffer->get_first_line_displayed() + nb +
+    m_view_shift;
+  lineno_t last = m_pending_buffer->get_number_of_line() - 1;
+  m_view_shift = (first > last) ? first - last : 0;
+  m_pending_buffer->set_first_line_displayed(std::min(first, last));
+}
+
+lineno_t BufferModel::get_file_line_displayed() const {
+  std::shared_ptr<IBuffer> current = (*this).get_current_buffer();
+  std::shared_ptr<FilteredBuffer> filtered =
+    std::atomic_load(&m_filtered_buffer);
+  lineno_t first = current->get_first_line_displayed();
+  if (current != filtered) return first;
+  lineno_t number_of_line = filtered->get_number_of_line();
+  // The filtered view is empty when the previous filters matched nothing
+  if (number_of_line == 0) return m_file_buffer->get_first_line_displayed();
+  return filtered->get_original_line(
+    std::min(first, number_of_line - 1));
 }
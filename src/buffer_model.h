@@ -6,8 +6,11 @@
 #define __BUFFER_MODEL_H__
 
 #include <list>
+#include <vector>
 #include <regex>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <fstream>
 
@@ -16,6 +19,13 @@
 #include "buffer.h"
 #include "processor.h"
 #include "filter_set.h"
+#include "highlighter.h"
+#include "matcher_cache.h"
+
+// Number of lines prefetched before and after the first line displayed
+#define BUFFER_PREFETCH_LINES 512
+// Minimum interval between two notifications of the filtered lines changes
+#define BUFFER_FRAME_INTERVAL_MS 16
 
 /*
  * Points to text hold by a Buffer and gives information as to where the model
@@ -24,54 +34,180 @@
 class BufferModel : public Model
 {
 public:
-  BufferModel(std::shared_ptr<IBuffer> &&buffer);
+  /*
+   * The matchers of the filters are taken from matcher_cache and the lines are
+   * filtered by workers, if provided
+   */
+  BufferModel(std::shared_ptr<IBuffer> &&buffer,
+              std::shared_ptr<MatcherCache> matcher_cache = nullptr,
+              std::shared_ptr<WorkerPool> workers = nullptr);
   ~BufferModel();
 
   DECLARE_ENTRY( BufferModel, filter_set, filter_set_t );
-  DECLARE_ENTRY( BufferModel, filter_processing_progress, uint );
   DECLARE_ENTRY( BufferModel, display_attributes, bool );
+  DECLARE_ENTRY( BufferModel, loading_progress, uint );
+public:
+  /*
+   * Percentage of the file buffer filtered. It is updated without notifying
+   * the view, which reads it when the filtered lines are notified.
+   */
+  inline uint get_filter_processing_progress() const {
+    return m_filter_processing_progress.load(std::memory_order_relaxed);
+  }
+  void set_filter_processing_progress(uint progress);
+  /*
+   * Notify the view that the filtered lines or the progress changed, unless it
+   * was notified less than a frame ago or now is true. Returns the time until
+   * the notification is due if it is delayed, zero otherwise.
+   */
+  std::chrono::milliseconds notify_filtering(bool now);
 public:
   // Set the current visible buffer
   void set_current_buffer(std::shared_ptr<IBuffer>);
 public:
-  // Get/Set the text of the current buffer
-  char ** get_text();
+  /*
+   * Get the current buffer. The filtered buffer is replaced when the filters
+   * change, the view draws a screen from a single buffer.
+   */
+  std::shared_ptr<IBuffer> get_current_buffer() const;
+  // Get a view on a line of the current buffer
+  line_t get_line(lineno_t i) const;
   // Get/Set the number of lines in the current buffer
-  uint get_number_of_line() const ;
-  void set_number_of_line(uint i);
+  lineno_t get_number_of_line() const ;
+  void set_number_of_line(lineno_t i);
   // Get/Set the current pointer (first line displayed) of the current buffer
-  uint get_first_line_displayed() const ;
-  void set_first_line_displayed(uint i);
-  // Get/Set attributes of the current buffer
-  attr_list_t get_attrs();
-  void clear_attrs();
+  lineno_t get_first_line_displayed() const ;
+  void set_first_line_displayed(lineno_t i);
+  /*
+   * Spans of the matches of the filters in the lines displayed, used by the
+   * view only
+   */
+  Highlighter &get_highlighter();
+  /*
+   * Lock held by the view while it draws the current buffer. The filtered
+   * lines added in front of the ones displayed and the shift of the first line
+   * displayed are seen together.
+   */
+  std::unique_lock<std::mutex> lock_view();
 public:
   // Should we have the thread object in the model ? Looks ugly but I don't see
   // another easy and straighforward way... TODO: Improve this
   FilterEngine m_filter;
+  LoaderEngine m_loader;
   /*
    * Functions used by the FilterProcessor
    */
+  /** Replace the filtered lines displayed by an empty buffer */
   void clear_filtered_line();
-  void add_filtered_line(char *line);
+  /**
+   * Start a new buffer of the lines matching filters. The previous one is
+   * displayed until the new one is published, when lines are added to it.
+   */
+  void new_filtered_buffer(
+    const std::vector< std::shared_ptr<Matcher> > &filters);
+  /**
+   * Display the new buffer of filtered lines, even if it is empty, and
+   * highlight its filters
+   */
+  void publish_filtered_buffer();
   void enable_filtering();
   void disable_filtering();
-  std::shared_ptr<FileBuffer> get_file_buffer();
+  std::shared_ptr<IBuffer> get_file_buffer();
+  std::shared_ptr<MatcherCache> get_matcher_cache();
   void retrieve_filter_set(filter_set_t &filter_set);
-  /** Add the filtered line and an associated attribute */
-  void add_match(char *line, uint filtered_line_index, 
-                 uint start_pos, uint end_pos);
+  /*
+   * Functions used by the processors to tell when they scan the file buffer.
+   * The file buffer is advised accordingly (see IBuffer::advise).
+   */
+  void begin_scan();
+  void end_scan();
+  /** Copy the indexes in the file buffer of the filtered lines */
+  void get_filtered_lines(std::vector<lineno_t> &lines) const;
+  /**
+   * Add filtered lines, by their index in the file buffer. The lines before
+   * origin, the line of the file buffer the filtering started from, come
+   * before the line displayed: the filtered view is shifted so it keeps
+   * displaying the same lines.
+   */
+  void add_filtered_lines(const std::vector<lineno_t> &lines,
+                          lineno_t origin = 0);
+  /**
+   * Add filtered lines, preceding the ones already filtered, in front of them.
+   * The filtered view keeps displaying the same lines.
+   */
+  void add_filtered_lines_front(const std::vector<lineno_t> &lines);
+  /** Line of the file buffer displayed at the top of the current view */
+  lineno_t get_file_line_displayed() const;
   /*
    * Functions used to thread-safely manipulate the filter list
    */
   void add_filter(const std::string &filter);
+  /** Add several filters at once, the invalid ones are ignored */
+  void add_filters(const std::vector<std::string> &filters);
   void update_last_filter(const std::string &filter);
   void remove_last_filter();
 private:
-  std::shared_ptr<FileBuffer> m_file_buffer;
+  /*
+   * Shift the first line displayed of the pending buffer by nb lines, added
+   * before it, up to its last line. The view lock shall be held.
+   */
+  void shift_view(lineno_t nb);
+  /* Replace the filtered buffer, in the view too if it is displayed */
+  void set_filtered_buffer(std::shared_ptr<FilteredBuffer> buffer);
+private:
+  std::shared_ptr<IBuffer> m_file_buffer;
+  // The filtered buffer and the current one are replaced atomically, they are
+  // read without lock by the view
   std::shared_ptr<FilteredBuffer> m_filtered_buffer;
   std::shared_ptr<IBuffer> m_current_buffer;
+  std::mutex m_buffer_mutex;
+  // Held to draw the current buffer and to move its first line displayed
+  std::mutex m_view_mutex;
+  // Lines added before the line displayed of the pending buffer which it was
+  // not shifted by, as it was on its last line
+  lineno_t m_view_shift;
+  // Buffer filled by the FilterEngine, published on its first lines
+  std::shared_ptr<FilteredBuffer> m_pending_buffer;
+  // Filters of the pending buffer, highlighted once it is published
+  std::vector< std::shared_ptr<Matcher> > m_pending_filters;
   std::mutex m_filter_set_mutex;
+  // The filters are compiled by the FilterEngine, through this cache
+  std::shared_ptr<MatcherCache> m_matcher_cache;
+  // Given the filters of the filtered buffer when it is published
+  Highlighter m_highlighter;
+  std::atomic<uint> m_filter_processing_progress;
+  // The filtered lines or the progress changed since the last notification,
+  // only used by the FilterEngine
+  bool m_filtering_changed;
+  std::chrono::steady_clock::time_point m_filtering_notified;
+  // Number of processors scanning the file buffer
+  uint m_nb_scans;
+  std::mutex m_scan_mutex;
+};
+
+/*
+ * Scan of the file buffer by a processor, ended when the guard is destroyed if
+ * it was not before, so a processor interrupted never leaves the file buffer
+ * advised for a sequential access (see BufferModel::begin_scan)
+ */
+class ScanGuard {
+public:
+  ScanGuard(BufferModel &buffer_model) : m_buffer_model(buffer_model),
+    m_scanning(false) {}
+  ~ScanGuard() { (*this).end(); }
+  void begin() {
+    if (m_scanning) return;
+    m_buffer_model.begin_scan();
+    m_scanning = true;
+  }
+  void end() {
+    if (!m_scanning) return;
+    m_buffer_model.end_scan();
+    m_scanning = false;
+  }
+private:
+  BufferModel &m_buffer_model;
+  bool        m_scanning;
 };
 
 typedef std::list<std::unique_ptr<BufferModel> > buffer_list;
@@ -0,0 +1,116 @@
+/*! \brief Append only array readable while it grows
+ *
+ * Elements are stored in fixed size blocks which are never moved, so one
+ * thread can append elements while other threads read the elements already
+ * published, without any lock.
+ */
+
+#ifndef __CHUNKED_ARRAY_H__
+#define __CHUNKED_ARRAY_H__
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * T shall be a POD type. BLOCK_BITS is the log2 of the number of elements per
+ * block.
+ * Only one thread may modify the array (push_back, clear). Readers may only
+ * access the elements whose index is below size(). Blocks are released on
+ * destruction only, so an element read after a clear() is stale but valid
+ * memory.
+ */
+template <typename T, size_t BLOCK_BITS = 16>
+class ChunkedArray {
+public:
+  static const size_t BLOCK_SIZE = (size_t) 1 << BLOCK_BITS;
+  static const size_t BLOCK_MASK = BLOCK_SIZE - 1;
+
+  ChunkedArray() : m_top(nullptr), m_capacity(0), m_nb_blocks(0), m_size(0) {}
+  ~ChunkedArray() {
+    T **top = m_top.load();
+    for (size_t b = 0; b < m_nb_blocks; ++b) delete[] top[b];
+  }
+
+  inline const T &operator[](size_t i) const {
+    return m_top.load(std::memory_order_acquire)[i >> BLOCK_BITS][i & BLOCK_MASK];
+  }
+  /* Write access to an element already published. Writer thread only. */
+  inline T &operator[](size_t i) {
+    return m_top.load(std::memory_order_relaxed)[i >> BLOCK_BITS][i & BLOCK_MASK];
+  }
+  inline size_t size() const { return m_size.load(std::memory_order_acquire); }
+  inline bool empty() const { return size() == 0; }
+
+  /*
+   * Append an element and publish it to the readers
+   */
+  inline void push_back(const T &value) {
+    size_t size = m_size.load(std::memory_order_relaxed);
+    if ((size >> BLOCK_BITS) >= m_nb_blocks) (*this).add_block();
+    m_top.load(std::memory_order_relaxed)[size >> BLOCK_BITS][size & BLOCK_MASK] =
+      value;
+    m_size.store(size + 1, std::memory_order_release);
+  }
+
+  /*
+   * Append nb elements, copied block by block, and publish them to the readers
+   */
+  void append(const T *values, size_t nb) {
+    size_t size = m_size.load(std::memory_order_relaxed);
+    while (nb != 0) {
+      if ((size >> BLOCK_BITS) >= m_nb_blocks) (*this).add_block();
+      size_t count = std::min(nb, BLOCK_SIZE - (size & BLOCK_MASK));
+      memcpy(&m_top.load(std::memory_order_relaxed)[size >> BLOCK_BITS]
+                                                  [size & BLOCK_MASK],
+             values, count * sizeof (T));
+      values += count;
+      nb -= count;
+      size += count;
+      m_size.store(size, std::memory_order_release);
+    }
+  }
+
+  /*
+   * Forget all the elements. The memory is kept to be reused.
+   */
+  void clear() { m_size.store(0, std::memory_order_release); }
+
+  /* Memory used by the array in bytes */
+  size_t memory_size() const {
+    return m_nb_blocks * BLOCK_SIZE * sizeof (T) + m_capacity * sizeof (T *);
+  }
+
+private:
+  void add_block() {
+    T **top = m_top.load(std::memory_order_relaxed);
+    if (m_nb_blocks == m_capacity) {
+      // The table of blocks is full. Copy it in a bigger one, the old table is
+      // kept alive as a reader might still be using it.
+      size_t capacity = m_capacity ? m_capacity * 2 : 16;
+      T **new_top = new T*[capacity]();
+      for (size_t b = 0; b < m_nb_blocks; ++b) new_top[b] = top[b];
+      m_tops.emplace_back(new_top);
+      m_capacity = capacity;
+      top = new_top;
+    }
+    top[m_nb_blocks++] = new T[BLOCK_SIZE];
+    m_top.store(top, std::memory_order_release);
+  }
+
+private:
+  std::atomic<T **>                     m_top;
+  std::vector< std::unique_ptr<T*[]> >  m_tops;
+  size_t                                m_capacity;
+  size_t                                m_nb_blocks;
+  std::atomic<size_t>                   m_size;
+
+private:
+  ChunkedArray(const ChunkedArray &) = delete;
+  ChunkedArray &operator=(const ChunkedArray &) = delete;
+};
+
+#endif // __CHUNKED_ARRAY_H__
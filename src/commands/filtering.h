@@ -113,29 +113,30 @@ public:
 };
 
 /*
- * Update the current filter entry with the prompt value
+ * Update the current filter entry with the prompt value. text is the pattern
+ * typed, filter the pattern with the prefix of its options.
  */
 class UpdateCurrentFilterEntry : public Command {
 public:
   UpdateCurrentFilterEntry(Controller &controller, Invoker &invoker,
-                           IState *state, const std::string &filter,
-                           const IEvent &b) :
-    Command(controller, invoker, state), m_filter(filter),
+                           IState *state, const std::string &text,
+                           const std::string &filter, const IEvent &b) :
+    Command(controller, invoker, state), m_text(text), m_filter(filter),
     m_input(b.get_eventid()) {}
   virtual void execute() {
     // If the filter size is on the threshold and we added character, the filter
     // needs to be added
-    if (m_filter.size() == FILTER_STRING_MIN_SIZE
+    if (m_text.size() == FILTER_STRING_MIN_SIZE
         && m_input != KEY_BACKSPACE && m_input != KEY_DC) {
       m_controller.add_filter(m_filter);
       m_controller.set_filter_dynamic();
     }
     // If the filter size is greater then the threshold, then we just update it
-    else if (m_filter.size() > FILTER_STRING_MIN_SIZE)
+    else if (m_text.size() > FILTER_STRING_MIN_SIZE)
       m_controller.update_last_filter(m_filter);
     // If the filter size is below the threashold, we just removed a
     // character and we have a dynamic filter we need to remove the filter
-    else if (m_filter.size() <= FILTER_STRING_MIN_SIZE
+    else if (m_text.size() <= FILTER_STRING_MIN_SIZE
              && (m_input == KEY_BACKSPACE || m_input == KEY_DC)
              && m_controller.get_filter_dynamic()) {
       m_controller.remove_last_filter();
@@ -145,10 +146,36 @@ public:
   virtual void unexecute() { /* non unexecutable */ }
   virtual bool unexecutable() { return false; };
 private:
+  std::string m_text;
   std::string m_filter;
   Input m_input;
 };
 
+/*
+ * Toggle an option of the filter entered, and update the filter if it is
+ * already applied
+ */
+class ToggleFilterFlag : public Command {
+public:
+  ToggleFilterFlag(Controller &controller, Invoker &invoker, IState *state,
+                   AddFilterState *filter_state,
+                   bool filter_flags_t::*flag) :
+    Command(controller, invoker, state), m_filter_state(filter_state),
+    m_flag(flag) {}
+  virtual void execute() {
+    m_filter_state->toggle_flag(m_flag);
+    if (m_controller.get_filter_dynamic())
+      m_controller.update_last_filter(m_filter_state->get_filter());
+  }
+  virtual void unexecute() {
+    (*this).execute();
+  }
+  virtual bool unexecutable() { return true; };
+private:
+  AddFilterState *m_filter_state;
+  bool filter_flags_t::*m_flag;
+};
+
 /*
  * Remove the current filter from the filter list (the entry has been cancelled)
  */
@@ -23,6 +23,9 @@ Controller::Controller(BrowserModel &browser_model,
   _prompt_model(prompt_model),
   _state_model(state_model),
   _buffer_factory(buffer_factory),
+  _scan_order(scan_order_e::VIEWPORT_FIRST),
+  _matcher_cache(std::make_shared<MatcherCache>()),
+  _worker_pool(std::make_shared<WorkerPool>()),
   _context(Context(*this)),
   _user_event_producer(_event_queue),
   _processor_input_producer(_event_queue),
@@ -185,7 +188,9 @@ bool Controller::create_buffer(const std::string &filepath) {
     _context.inject(Event(FILE_OPENING));
     // Create the buffer model
     BufferModel *buffer_model =
-      new BufferModel(_buffer_factory.create_buffer(filepath));
+      new BufferModel(_buffer_factory.create_buffer(filepath),
+                      _matcher_cache, _worker_pool);
+    buffer_model->m_filter.set_scan_order(_scan_order);
     // Attach the controller observer to the newly created buffer
     buffer_model->register_observer(std::bind( &Controller::route_callback,
                                                this, REDRAW_BUFFER, _1 ));
@@ -310,6 +315,12 @@ void Controller::add_filter(const std::string &filter) {
   buffer->add_filter(filter);
 }
 
+void Controller::add_filters(const std::vector<std::string> &filters) {
+  const std::unique_ptr<BufferModel> &buffer =
+    (*_browser_model.get_current_buffer());
+  buffer->add_filters(filters);
+}
+
 void Controller::update_last_filter(const std::string &filter) {
   const std::unique_ptr<BufferModel> &buffer =
     (*_browser_model.get_current_buffer());
@@ -337,6 +348,8 @@ void Controller::clear_filtering_on_current_buffer() {
   // Clear the filter set
   buffer->set_filter_set().update().filters.clear();
   buffer->clear_filtered_line();
+  // Abandon the filtering in progress
+  buffer->m_filter.signal();
 }
 
 void Controller::switch_filter_type() {
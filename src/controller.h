@@ -92,6 +92,8 @@ public:
    * The StreamType is used by the Buffer class to read a file.
    */
   bool create_buffer(const std::string &filepath);
+  /* Set the order in which the buffers created next are filtered */
+  inline void set_scan_order(scan_order_e order) { _scan_order = order; }
   /*
    * Return the currently active buffer in the model (i.e. displayed buffer).
    */
@@ -133,6 +135,8 @@ public:
   /* Filter APIs */
   /** Add a new filter into the filter_set and signal the filter thread */
   void add_filter(const std::string &filter);
+  /** Add several filters at once, e.g. read from a file */
+  void add_filters(const std::vector<std::string> &filters);
   /**
     * Update the last filter added (which is the current edited filter in the
     * prompt)
@@ -191,6 +195,13 @@ private:
   StateModel          &_state_model;
   // The factory from which new buffer will be constructed
   IBufferFactory      &_buffer_factory;
+  // Order in which the lines of the new buffers are filtered
+  scan_order_e        _scan_order;
+  // The compiled filters, shared by the buffers
+  std::shared_ptr<MatcherCache> _matcher_cache;
+  // The workers filtering the lines of all the buffers, so opening more files
+  // does not start more threads than cores
+  std::shared_ptr<WorkerPool> _worker_pool;
   // The state machine
   Context             _context;
   // Factory generating inputs from keys
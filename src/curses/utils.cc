@@ -4,17 +4,18 @@
 #include <list>
 #include <algorithm>
 
-#include "buffer_model.h"
+#include "buffer.h"
+#include "highlighter.h"
 #include "utils.h"
 #include "range.h"
 
-uint print_line(WINDOW *w, const char *data, size_t max_char, uint xoffset) {
-  // Get the maximum character we can print
-  max_char = std::min(strlen(data), max_char);
-  // is \r the last character of the line (\n was stripped out by getline)
-  uint cr = data[max_char - 1] == '\r' ? 1 : 0;
+uint print_line(WINDOW *w, const char *data, size_t length, size_t max_char,
+                uint xoffset) {
+  // Get the maximum character we can print (end of line characters are not
+  // part of the line provided by the buffer)
+  max_char = std::min(length, max_char);
   // print the string
-  uint printed_char = wprintw(stdscr, "%.*s", max_char - cr, data);
+  uint printed_char = wprintw(stdscr, "%.*s", (int) max_char, data);
   // Clear the rest of the line
   wclrtoeol(stdscr);
   // Return the number of printed char
@@ -22,29 +23,32 @@ uint print_line(WINDOW *w, const char *data, size_t max_char, uint xoffset) {
 }
 
 template <typename range_type>
-void print_buffer(WINDOW *w, char * const *buffer, const range_type& r,
+void print_buffer(WINDOW *w, const IBuffer &buffer, const range_type& r,
                   uint first_column, uint lines, uint columns,
                   uint xoffset, bool wordwrap) {
   // We will print nlines - prompt - fbar
   uint nb_line = lines - 2; // TODO: don't assume two dead lines!
   // position on the screen
   uint screen_line = 1; // TODO: don't assume one line header!
-  for (int i : r) {
+  for (lineno_t i : r) {
     // Get the line to print
-    const char *line = buffer[i];
+    line_t line_view = buffer.get_line(i);
+    const char *line = line_view.text;
     // If the line is NULL, just move to the next line
     if (line != nullptr) {
       // Advance by the columns shift
-      line += first_column;
+      uint shift = std::min((size_t) first_column, line_view.length);
+      line += shift;
       // How much to print ?
-      uint char_to_print = strlen(line);
+      uint char_to_print = line_view.length - shift;
       // As long as the line is not completely printed
       uint printed_char = 0;
       do {
         // Move cursor at the beginning of the line
         wmove(w, screen_line, xoffset); // TODO: don't assume one line header
         // Print the line
-        printed_char += print_line(w, line, columns - xoffset, xoffset);
+        printed_char += print_line(w, line, char_to_print - printed_char,
+                                   columns - xoffset, xoffset);
         // Move the line header to the rest of the string
         line += printed_char;
         // Decrement the number of lines remaining on the screen
@@ -73,62 +77,66 @@ void print_buffer(WINDOW *w, char * const *buffer, const range_type& r,
  * Force the instanciation of print_buffer with two different types of range
  */
 template void print_buffer< std::list<uint> >
-                  (WINDOW *w, char * const *buffer, const std::list<uint>& r,
+                  (WINDOW *w, const IBuffer &buffer, const std::list<uint>& r,
                   uint first_column, uint lines, uint columns,
                   uint xoffset, bool wordwrap);
 template void print_buffer< range >
-                  (WINDOW *w, char * const *buffer, const range& r,
+                  (WINDOW *w, const IBuffer &buffer, const range& r,
                   uint first_column, uint lines, uint columns,
                   uint xoffset, bool wordwrap);
 
+void init_highlight_colors() {
+  if (!has_colors() || start_color() != OK) return;
+  static const short colors[HIGHLIGHT_COLORS] = {
+    COLOR_YELLOW, COLOR_GREEN, COLOR_CYAN, COLOR_MAGENTA, COLOR_RED, COLOR_BLUE
+  };
+  // Displayed in reverse video, the color is the one of the background
+  short background = use_default_colors() == OK ? -1 : COLOR_BLACK;
+  for (short i = 0; i < HIGHLIGHT_COLORS; ++i)
+    init_pair(i + 1, colors[i], background);
+}
+
 template <typename range_type>
-void print_attrs(WINDOW *w, attr_list_t attr_list, char * const *buffer,
+void print_attrs(WINDOW *w, const IBuffer &buffer, Highlighter &highlighter,
                  const range_type& r, uint first_column, uint lines,
                  uint columns, uint xoffset, bool wordwrap) {
   attr_t bkp_attrs;
   short bkp_pair;
   // backup the current attributes
-  wattr_get(w, &bkp_attrs, &bkp_pair, bkp_opts);
+  wattr_get(w, &bkp_attrs, &bkp_pair, nullptr);
+  bool colors = has_colors() && COLOR_PAIRS > HIGHLIGHT_COLORS;
+  // Same lines as print_buffer
+  uint nb_line = lines - 2; // TODO: don't assume two dead lines!
   // position on the screen
   uint screen_line = 1; // TODO: don't assume one line header!
-  // loop over the range
-  for (int i : r) {
-    LOGDBG_("print_attrs line: " << i);
-    // Check if an attribute is set
-    if (!attr_list[i].attrs_mask) continue;
-    // If the string is supposed to start after the end_pos, bail
-    if (first_column > attr_list[i].end_pos) continue;
-    LOGDBG_("line " << i << " has attributes");
-    // Where to start on the screen
-    uint screen_offset = std::max((int) attr_list[i].start_pos - (int) first_column,
-                                  0)
-                         + xoffset;
-    // Where to start in the string
-    uint string_offset = std::max((int) attr_list[i].start_pos - (int) first_column,
-                                  0);
-    // set the attributes
-    wattr_set(w, attr_list[i].attrs_mask, bkp_pair, bkp_opts);
-    // print the attributes string
-    LOGDBG_("i: " << i);
-    LOGDBG_("screen_line: " << screen_line);
-    LOGDBG_("attr_list[i].end_pos: " << attr_list[i].end_pos);
-    LOGDBG_("string_offset: " << string_offset);
-    LOGDBG_("attr_list[i].end_pos - string_offset: " << (attr_list[i].end_pos - string_offset));
-    LOGDBG_("buffer[i] size: " << strlen(buffer[i]));
-    mvwaddnstr(w, screen_line, screen_offset, &buffer[i][string_offset],
-               attr_list[i].end_pos - string_offset);
+  // The columns displayed are [first_column, last_column)
+  size_t last_column = first_column + columns - xoffset;
+  for (lineno_t i : r) {
+    if (!nb_line) break;
+    line_t line = buffer.get_line(i);
+    for (const span_t &span: highlighter.get_spans(
+           buffer.get_original_line(i), line)) {
+      // Clip the span to the columns displayed
+      size_t start = std::max((size_t) span.start_pos, (size_t) first_column);
+      size_t end = std::min((size_t) span.end_pos, last_column);
+      if (start >= end) continue;
+      short pair = colors ? span.filter % HIGHLIGHT_COLORS + 1 : bkp_pair;
+      wattr_set(w, A_REVERSE, pair, nullptr);
+      mvwaddnstr(w, screen_line, xoffset + start - first_column,
+                 line.text + start, end - start);
+    }
     // Move to next line in read buffer
     screen_line++;
+    nb_line--;
   }
-  wattr_set(w, bkp_attrs, bkp_pair, bkp_opts);
+  wattr_set(w, bkp_attrs, bkp_pair, nullptr);
 }
 
 template void print_attrs< std::list<uint> >
-                 (WINDOW *w, attr_list_t attr_list, char * const *buffer,
+                 (WINDOW *w, const IBuffer &buffer, Highlighter &highlighter,
                  const std::list<uint>& r, uint first_column, uint lines,
                  uint columns, uint xoffset, bool wordwrap);
 template void print_attrs< range >
-                 (WINDOW *w, attr_list_t attr_list, char * const *buffer,
+                 (WINDOW *w, const IBuffer &buffer, Highlighter &highlighter,
                  const range& r, uint first_column, uint lines,
                  uint columns, uint xoffset, bool wordwrap);
-
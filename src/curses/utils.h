@@ -8,20 +8,35 @@
 #include <memory>
 #include <curses.h>
 
+class IBuffer;
+class Highlighter;
+
+// Number of colors the filters are highlighted with, in turn
+#define HIGHLIGHT_COLORS 6
+
+/*! \brief initialize the colors of the filters
+ *
+ * Without colors, the matches of all the filters are displayed in reverse
+ * video.
+ */
+void init_highlight_colors();
+
 /*! \brief print a string to the window
  *
  * Print a string on the window where the cursor is positioned.
- * data represents a null terminated character string.
+ * data represents a character string of length characters (not necessarily
+ * null terminated).
  * max_char is the maximum number of char to print.
  * The function returns the number of characters printed.
  */
-uint print_line(WINDOW *w, char *data, size_t max_char);
+uint print_line(WINDOW *w, const char *data, size_t length, size_t max_char,
+                uint xoffset);
 
 /*! \brief print a buffer to the WINDOW
  *
  * Will repeatldy call print_line on all the lines up to _nline - 1
  * The lines will start at column
- * buffer_model contains the list of string to display
+ * buffer contains the lines to display
  * r is a range which contains the index of the line we want to print
  * first_column in the index of the column to be displayed first
  * lines in the number of lines in available for display
@@ -30,13 +45,14 @@ uint print_line(WINDOW *w, char *data, size_t max_char);
  * if wordwrap is true, string will be displayed entirely on several lines.
  */
 template <typename range_type>
-void print_buffer(WINDOW *w, char * const *buffer, const range_type& r,
+void print_buffer(WINDOW *w, const IBuffer &buffer, const range_type& r,
                   uint first_column, uint lines, uint columns,
                   uint xoffset, bool wordwrap);
 
-/*! \brief overprint the text with its attributes to the window
+/*! \brief overprint the matches of the filters to the window
  *
- * attr_list contains the list of attributes to print
+ * the spans of the matches are retrieved from the highlighter, each filter is
+ * highlighted with its own color
  * r is a range which contains the index of the line we want to print
  * first_column in the index of the column to be displayed first
  * lines in the number of lines in available for display
@@ -45,7 +61,7 @@ void print_buffer(WINDOW *w, char * const *buffer, const range_type& r,
  * if wordwrap is true, string will be displayed entirely on several lines.
  */
 template <typename range_type>
-void print_attrs(WINDOW *w, attr_list_t attr_list, char * const *buffer,
+void print_attrs(WINDOW *w, const IBuffer &buffer, Highlighter &highlighter,
                  const range_type& r, uint first_column, uint lines,
                  uint columns, uint xoffset, bool wordwrap);
 
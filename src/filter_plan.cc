@@ -0,0 +1,358 @@
+#include <chrono>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "logmacros.h"
+#include "filter_plan.h"
+
+// Characters ending a pattern written without quotes
+#define PLAN_OPERATORS "&|!()\""
+
+FilterPlan::statistics_t FilterPlan::sum(const statistics_t &a,
+                                         const statistics_t &b) {
+  return { a.evaluations + b.evaluations, a.matches + b.matches,
+           a.samples + b.samples, a.nanoseconds + b.nanoseconds };
+}
+
+/*
+ * Expected cost of evaluating a node before its siblings: its mean cost over
+ * the probability it decides the result of its parent. The probability is
+ * smoothed, a node never evaluated is assumed to match half of the lines.
+ */
+double FilterPlan::rank(const statistics_t &statistics, bool land) {
+  double p = (statistics.matches + 1.0) / (statistics.evaluations + 2.0);
+  double cost = statistics.samples ?
+    static_cast<double>(statistics.nanoseconds) / statistics.samples : 0;
+  return cost / (land ? 1 - p : p);
+}
+
+static void skip_spaces(const std::string &expression, size_t &at) {
+  while (at < expression.size() && std::isspace(expression[at])) ++at;
+}
+
+FilterPlan::FilterPlan(const std::string &expression,
+                       const filter_flags_t &flags) :
+  m_line(0), m_statistics(std::make_shared<shared_statistics_t>()),
+  m_flags(flags)
+{
+  size_t at = 0;
+  (*this).parse_or(expression, at);
+  if (at < expression.size())
+    throw std::invalid_argument("unexpected '" + expression.substr(at, 1) +
+                                "' at " + std::to_string(at));
+  m_statistics->nodes.resize(m_nodes.size(), statistics_t());
+  (*this).find_occurring();
+  LOGDBG("expression " << expression << " compiled to " << m_nodes.size()
+         << " nodes");
+}
+
+FilterPlan::FilterPlan(const std::vector< std::shared_ptr<Matcher> > &matchers,
+                       bool land) :
+  m_line(0), m_statistics(std::make_shared<shared_statistics_t>()),
+  m_flags({ false, false, false })
+{
+  std::vector<size_t> children;
+  for (const auto &matcher: matchers)
+    children.push_back((*this).add_node(node_type_e::PATTERN, matcher));
+  size_t root = (*this).add_node(land ? node_type_e::AND : node_type_e::OR);
+  m_nodes[root].children = m_nodes[root].order = children;
+  m_statistics->nodes.resize(m_nodes.size(), statistics_t());
+  (*this).find_occurring();
+}
+
+FilterPlan::FilterPlan(const FilterPlan &other) :
+  m_nodes(other.m_nodes), m_line(0), m_occurring(other.m_occurring),
+  m_statistics(other.m_statistics), m_flags(other.m_flags)
+{
+  std::lock_guard<std::mutex> lock(m_statistics->mutex);
+  for (size_t i = 0; i < m_nodes.size(); ++i) {
+    node_t &node = m_nodes[i];
+    if (node.matcher) node.matcher = node.matcher->clone();
+    node.base = m_statistics->nodes[i];
+    node.local = statistics_t();
+    node.line = 0;
+  }
+  (*this).order();
+}
+
+FilterPlan::~FilterPlan() {
+  // What was measured is kept for the next clones
+  if (m_nodes.empty() || !m_nodes.back().local.evaluations) return;
+  std::lock_guard<std::mutex> lock(m_statistics->mutex);
+  for (size_t i = 0; i < m_nodes.size(); ++i)
+    m_statistics->nodes[i] = sum(m_statistics->nodes[i], m_nodes[i].local);
+}
+
+std::shared_ptr<Matcher> FilterPlan::clone() const {
+  return std::make_shared<FilterPlan>(*this);
+}
+
+bool FilterPlan::is_expression(const std::string &pattern) {
+  return !pattern.empty() && pattern[0] == '?';
+}
+
+bool FilterPlan::search(const char *begin, const char *end, uint &start_pos,
+                        uint &end_pos) const {
+  if (!(*this).matches(begin, end)) return false;
+  size_t root = m_nodes.size() - 1;
+  if ((*this).span(root, begin, end)) {
+    start_pos = m_nodes[root].start_pos;
+    end_pos = m_nodes[root].end_pos;
+  } else {
+    start_pos = end_pos = 0;
+  }
+  return true;
+}
+
+bool FilterPlan::search_from(const char *begin, const char *end,
+                             const char *from, uint &start_pos,
+                             uint &end_pos) const {
+  if (!(*this).matches(begin, end)) return false;
+  // The leftmost occurrence of the patterns, the longest one if several begin
+  // there
+  bool found = false;
+  uint pattern_start_pos, pattern_end_pos;
+  for (size_t index: m_occurring) {
+    if (!m_nodes[index].matcher->search_from(begin, end, from,
+                                             pattern_start_pos,
+                                             pattern_end_pos))
+      continue;
+    if (!found || pattern_start_pos < start_pos ||
+        (pattern_start_pos == start_pos && pattern_end_pos > end_pos)) {
+      start_pos = pattern_start_pos;
+      end_pos = pattern_end_pos;
+    }
+    found = true;
+  }
+  return found;
+}
+
+bool FilterPlan::matches(const char *begin, const char *end) const {
+  // The results of the nodes are kept for the line being searched
+  if (++m_line % PLAN_ORDER_INTERVAL == 0) (*this).order();
+  return (*this).evaluate(m_nodes.size() - 1, begin, end);
+}
+
+std::vector<size_t> FilterPlan::get_order() const {
+  const node_t &root = m_nodes.back();
+  if (root.type != node_type_e::AND && root.type != node_type_e::OR)
+    return { 0 };
+  // Ordered with what all the clones measured so far
+  std::vector<double> ranks(m_nodes.size());
+  {
+    std::lock_guard<std::mutex> lock(m_statistics->mutex);
+    for (size_t child: root.children)
+      ranks[child] = rank(sum(m_statistics->nodes[child],
+                              m_nodes[child].local),
+                          root.type == node_type_e::AND);
+  }
+  std::vector<size_t> order(root.children.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return ranks[root.children[a]] < ranks[root.children[b]];
+  });
+  return order;
+}
+
+/*
+ * Parse an expression:
+ *   or      := and ('|' and)*
+ *   and     := unary ('&' unary)*
+ *   unary   := '!' unary | '(' or ')' | pattern
+ *   pattern := word | '"' regex '"'
+ */
+size_t FilterPlan::parse_or(const std::string &expression, size_t &at) {
+  std::vector<size_t> children = { (*this).parse_and(expression, at) };
+  while (at < expression.size() && expression[at] == '|') {
+    ++at;
+    children.push_back((*this).parse_and(expression, at));
+  }
+  if (children.size() == 1) return children.front();
+  size_t index = (*this).add_node(node_type_e::OR);
+  m_nodes[index].children = m_nodes[index].order = children;
+  return index;
+}
+
+size_t FilterPlan::parse_and(const std::string &expression, size_t &at) {
+  std::vector<size_t> children = { (*this).parse_unary(expression, at) };
+  while (at < expression.size() && expression[at] == '&') {
+    ++at;
+    children.push_back((*this).parse_unary(expression, at));
+  }
+  if (children.size() == 1) return children.front();
+  size_t index = (*this).add_node(node_type_e::AND);
+  m_nodes[index].children = m_nodes[index].order = children;
+  return index;
+}
+
+size_t FilterPlan::parse_unary(const std::string &expression, size_t &at) {
+  skip_spaces(expression, at);
+  size_t index;
+  if (at < expression.size() && expression[at] == '!') {
+    ++at;
+    size_t child = (*this).parse_unary(expression, at);
+    index = (*this).add_node(node_type_e::NOT);
+    m_nodes[index].children = m_nodes[index].order = { child };
+  } else if (at < expression.size() && expression[at] == '(') {
+    ++at;
+    index = (*this).parse_or(expression, at);
+    if (at >= expression.size() || expression[at] != ')')
+      throw std::invalid_argument("missing ')' at " + std::to_string(at));
+    ++at;
+  } else {
+    index = (*this).parse_pattern(expression, at);
+  }
+  skip_spaces(expression, at);
+  return index;
+}
+
+size_t FilterPlan::parse_pattern(const std::string &expression, size_t &at) {
+  std::string pattern;
+  if (at < expression.size() && expression[at] == '"') {
+    for (++at; at < expression.size() && expression[at] != '"'; ++at) {
+      if (expression[at] == '\\' && at + 1 < expression.size() &&
+          expression[at + 1] == '"')
+        ++at;
+      pattern.push_back(expression[at]);
+    }
+    if (at >= expression.size())
+      throw std::invalid_argument("missing '\"' at " + std::to_string(at));
+    ++at;
+  } else {
+    while (at < expression.size() && !std::isspace(expression[at]) &&
+           std::strchr(PLAN_OPERATORS, expression[at]) == nullptr)
+      pattern.push_back(expression[at++]);
+  }
+  if (pattern.empty())
+    throw std::invalid_argument("missing pattern at " + std::to_string(at));
+  // The flags of the expression apply to its patterns, which may add others
+  filter_flags_t flags = m_flags;
+  pattern = Matcher::parse_flags(pattern, flags);
+  return (*this).add_node(node_type_e::PATTERN,
+                          Matcher::compile(pattern, flags));
+}
+
+size_t FilterPlan::add_node(node_type_e type,
+                            std::shared_ptr<Matcher> matcher) {
+  m_nodes.emplace_back();
+  node_t &node = m_nodes.back();
+  node.type = type;
+  node.matcher = matcher;
+  node.base = node.local = statistics_t();
+  node.line = 0;
+  node.result = node.has_span = false;
+  node.start_pos = node.end_pos = 0;
+  return m_nodes.size() - 1;
+}
+
+bool FilterPlan::evaluate(size_t index, const char *begin,
+                          const char *end) const {
+  node_t &node = m_nodes[index];
+  if (node.line == m_line) return node.result;
+  bool timed = node.local.evaluations % PLAN_SAMPLE_INTERVAL == 0;
+  std::chrono::steady_clock::time_point start;
+  if (timed) start = std::chrono::steady_clock::now();
+  bool result = false;
+  switch (node.type) {
+  case node_type_e::PATTERN:
+    result = node.matcher->matches(begin, end);
+    break;
+  case node_type_e::NOT:
+    result = !(*this).evaluate(node.children.front(), begin, end);
+    break;
+  case node_type_e::AND:
+    result = true;
+    for (size_t child: node.order)
+      if (!(result = (*this).evaluate(child, begin, end))) break;
+    break;
+  case node_type_e::OR:
+    for (size_t child: node.order)
+      if ((result = (*this).evaluate(child, begin, end))) break;
+    break;
+  }
+  if (timed) {
+    node.local.nanoseconds +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    ++node.local.samples;
+  }
+  ++node.local.evaluations;
+  if (result) ++node.local.matches;
+  node.line = m_line;
+  node.result = result;
+  return result;
+}
+
+/*
+ * Set the span of a node evaluated to true, from its patterns in the order they
+ * are written. Return false if it has none.
+ */
+bool FilterPlan::span(size_t index, const char *begin, const char *end) const {
+  node_t &node = m_nodes[index];
+  const node_t *spanning = nullptr;
+  switch (node.type) {
+  case node_type_e::PATTERN:
+    // Only searched for its position now
+    return node.matcher->search(begin, end, node.start_pos, node.end_pos);
+  case node_type_e::NOT:
+    return false;
+  case node_type_e::AND:
+    // All the operands are true
+    for (auto child = node.children.rbegin(); child != node.children.rend();
+         ++child)
+      if ((*this).span(*child, begin, end)) {
+        spanning = &m_nodes[*child];
+        break;
+      }
+    break;
+  case node_type_e::OR:
+    // The operands not evaluated yet are evaluated now
+    for (size_t child: node.children)
+      if ((*this).evaluate(child, begin, end) &&
+          (*this).span(child, begin, end)) {
+        spanning = &m_nodes[child];
+        break;
+      }
+    break;
+  }
+  if (!spanning) return false;
+  node.start_pos = spanning->start_pos;
+  node.end_pos = spanning->end_pos;
+  return true;
+}
+
+/*
+ * Evaluate the operands of each node by increasing rank, with what was measured
+ * by this plan and before it was cloned
+ */
+void FilterPlan::order() const {
+  for (node_t &node: m_nodes) {
+    if (node.type != node_type_e::AND && node.type != node_type_e::OR)
+      continue;
+    bool land = node.type == node_type_e::AND;
+    node.order = node.children;
+    std::stable_sort(node.order.begin(), node.order.end(),
+                     [&](size_t a, size_t b) {
+      return rank(sum(m_nodes[a].base, m_nodes[a].local), land) <
+             rank(sum(m_nodes[b].base, m_nodes[b].local), land);
+    });
+  }
+}
+
+/*
+ * The patterns under an even number of NOT, whose occurrences can be part of
+ * a match of the expression
+ */
+void FilterPlan::find_occurring() {
+  // The children of a node are before it
+  std::vector<bool> negated(m_nodes.size(), false);
+  for (size_t index = m_nodes.size(); index-- > 0;) {
+    const node_t &node = m_nodes[index];
+    for (size_t child: node.children)
+      negated[child] = negated[index] != (node.type == node_type_e::NOT);
+    if (node.type == node_type_e::PATTERN && !negated[index])
+      m_occurring.push_back(index);
+  }
+  std::reverse(m_occurring.begin(), m_occurring.end());
+}
@@ -0,0 +1,126 @@
+/*! \brief Boolean filter expressions
+ *
+ * A filter beginning with '?' is an expression combining patterns:
+ *
+ *   ?ERROR & !(timeout | "retry [0-9]+")
+ *
+ * '&' binds tighter than '|', '!' negates, and the parentheses group. A
+ * pattern is a word, or any regex between double quotes, '\"' standing for a
+ * quote. The flags of the expression (see filter_flags_t) apply to all its
+ * patterns, a quoted pattern may add its own: ?"(?i)error" & !retry. The
+ * expression is compiled to a plan evaluating the cheapest and most decisive
+ * patterns first, as measured on the lines already filtered.
+ */
+
+#ifndef __FILTER_PLAN_H__
+#define __FILTER_PLAN_H__
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "matcher.h"
+
+// Number of lines evaluated between two orderings of the plan
+#define PLAN_ORDER_INTERVAL 1024
+// One evaluation of a node out of PLAN_SAMPLE_INTERVAL is timed
+#define PLAN_SAMPLE_INTERVAL 16
+
+/*
+ * A tree of AND, OR and NOT nodes over the matchers of the patterns. The
+ * children of an AND (resp. OR) node are evaluated by increasing
+ * cost / P(false) (resp. cost / P(true)), which minimizes the expected cost of
+ * the short-circuit evaluation of independent predicates. The probabilities
+ * and costs are measured while searching, and the order revised every
+ * PLAN_ORDER_INTERVAL lines. The clones share what they measured with the plan
+ * they are cloned from when destroyed, so the next clones start from a good
+ * order.
+ *
+ * A match spans the last pattern of an AND, or the first matching pattern of
+ * an OR, in the order they are written. A NOT has no span: an expression only
+ * matched by a negation spans nothing. The occurrences in a line matching the
+ * expression are the ones of its patterns which are not negated.
+ */
+class FilterPlan : public Matcher {
+public:
+  /*
+   * Compile expression, without its leading '?', its patterns with flags.
+   * Throws std::invalid_argument if it is not a valid expression,
+   * std::regex_error if one of its patterns is not a valid regex.
+   */
+  FilterPlan(const std::string &expression, const filter_flags_t &flags);
+  /* A plan ANDing (or ORing) matchers */
+  FilterPlan(const std::vector< std::shared_ptr<Matcher> > &matchers,
+             bool land);
+  FilterPlan(const FilterPlan &other);
+  ~FilterPlan();
+  bool search(const char *begin, const char *end, uint &start_pos,
+              uint &end_pos) const;
+  bool search_from(const char *begin, const char *end, const char *from,
+                   uint &start_pos, uint &end_pos) const;
+  /* The patterns are only searched for their position if needed */
+  bool matches(const char *begin, const char *end) const;
+  std::shared_ptr<Matcher> clone() const;
+  inline bool can_search_blocks() const { return false; }
+  /*
+   * Return the indexes of the operands of the root node, in the order they are
+   * evaluated.
+   */
+  std::vector<size_t> get_order() const;
+  /* Return true if pattern is an expression */
+  static bool is_expression(const std::string &pattern);
+private:
+  enum class node_type_e { PATTERN, NOT, AND, OR };
+  struct statistics_t {
+    uint64_t  evaluations;
+    uint64_t  matches;
+    uint64_t  samples;
+    uint64_t  nanoseconds; // spent in the timed evaluations
+  };
+  struct node_t {
+    node_type_e               type;
+    std::shared_ptr<Matcher>  matcher;
+    // The operands, as written and in the order they are evaluated
+    std::vector<size_t>       children;
+    std::vector<size_t>       order;
+    // Measured by the plan cloned from, and since
+    statistics_t              base;
+    statistics_t              local;
+    // Result for the line being searched
+    uint64_t                  line;
+    bool                      result;
+    bool                      has_span;
+    uint                      start_pos;
+    uint                      end_pos;
+  };
+  // Shared by a plan and its clones
+  struct shared_statistics_t {
+    std::mutex                mutex;
+    std::vector<statistics_t> nodes;
+  };
+
+  size_t parse_or(const std::string &expression, size_t &at);
+  size_t parse_and(const std::string &expression, size_t &at);
+  size_t parse_unary(const std::string &expression, size_t &at);
+  size_t parse_pattern(const std::string &expression, size_t &at);
+  size_t add_node(node_type_e type, std::shared_ptr<Matcher> matcher = nullptr);
+  bool evaluate(size_t index, const char *begin, const char *end) const;
+  bool span(size_t index, const char *begin, const char *end) const;
+  void find_occurring();
+  static statistics_t sum(const statistics_t &a, const statistics_t &b);
+  static double rank(const statistics_t &statistics, bool land);
+  void order() const;
+
+  // The root is the last node
+  mutable std::vector<node_t>           m_nodes;
+  mutable uint64_t                      m_line;
+  // The patterns not negated, whose occurrences are the ones of the expression
+  std::vector<size_t>                   m_occurring;
+  std::shared_ptr<shared_statistics_t>  m_statistics;
+  // Of the patterns of the expression
+  filter_flags_t                        m_flags;
+};
+
+#endif // __FILTER_PLAN_H__
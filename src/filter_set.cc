@@ -9,3 +9,27 @@ std::ostream& operator<<(std::ostream& os, const filter_set_t& filter_set)
   }
   return os;
 }
+
+bool is_narrower(const filter_set_t &filter_set, const filter_set_t &previous)
+{
+  size_t size = filter_set.filters.size();
+  size_t previous_size = previous.filters.size();
+  if (size == 0 || previous_size == 0) return false;
+  // With a single filter, AND and OR are the same
+  bool land = filter_set.land || size == 1;
+  bool previous_land = previous.land || previous_size == 1;
+  if (size == previous_size + 1) {
+    // The lines matched by an additional AND term are a subset
+    if (!land || !previous_land) return false;
+  } else if (size != previous_size || (size > 1 && land != previous_land)) {
+    return false;
+  }
+  // Each filter of previous is narrowed, the additional one is not compared
+  auto filter = filter_set.filters.begin();
+  for (const auto &previous_filter: previous.filters) {
+    if (!Matcher::is_narrower(filter->first, previous_filter.first))
+      return false;
+    ++filter;
+  }
+  return true;
+}
@@ -2,20 +2,39 @@
 #define __FILTER_SET_H__
 
 #include <list>
-#include <regex>
+#include <memory>
 #include <string>
 #include <iostream>
 
+#include "matcher.h"
+#include "filter_plan.h"
+
 /*
  * This structure is the logical representation of the filters set on each
- * buffer. The last filters added is at the tail of the queue.
+ * buffer. The last filters added is at the tail of the queue. Each filter is
+ * kept with the matcher it is compiled to, which is shared by the copies of the
+ * set. The matchers are only set in the copy of the FilterEngine, which
+ * compiles the filters.
  */
 struct filter_set_t {
-  std::list< std::pair<std::string, std::regex> > filters;
+  std::list< std::pair<std::string, std::shared_ptr<Matcher> > > filters;
+  // All the filters compiled together, to OR them in one pass. Only set by
+  // the FilterEngine.
+  std::shared_ptr<MultiMatcher> multi_matcher;
+  // The filters ANDed, evaluated in the order found the cheapest. Only set by
+  // the FilterEngine.
+  std::shared_ptr<FilterPlan> plan;
   bool  land; // logical and if true, logical or otherwise
   bool  dynamic; // last filter is dynamic i.e. being interactivally edited
 };
 
 std::ostream& operator<<(std::ostream& os, const filter_set_t& filter_set);
 
+/*
+ * Return true if the lines matched by filter_set are known to be a subset of
+ * the lines matched by previous: a filter was narrowed (see
+ * Matcher::is_narrower) or a filter was ANDed to previous.
+ */
+bool is_narrower(const filter_set_t &filter_set, const filter_set_t &previous);
+
 #endif //__FILTER_SET_H__
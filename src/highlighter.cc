@@ -0,0 +1,79 @@
+#include <algorithm>
+#include "logmacros.h"
+#include "highlighter.h"
+
+Highlighter::Highlighter() : m_version(0), m_clones_version(0)
+{
+}
+
+void Highlighter::set_filters(
+  const std::vector< std::shared_ptr<Matcher> > &matchers) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_filters = matchers;
+  ++m_version;
+}
+
+std::vector<span_t> Highlighter::get_spans(lineno_t line_index,
+                                           const line_t &line) {
+  {
+    // The spans of the previous filters are dropped
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_clones_version != m_version) {
+      m_clones.clear();
+      for (const auto &filter: m_filters) m_clones.push_back(filter->clone());
+      m_clones_version = m_version;
+      m_entries.clear();
+      m_index.clear();
+    }
+  }
+  auto it = m_index.find(line_index);
+  if (it != m_index.end()) {
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+  } else {
+    m_entries.push_front({ line_index, nullptr, 0, std::vector<span_t>() });
+    m_index[line_index] = m_entries.begin();
+    if (m_entries.size() > HIGHLIGHT_CACHE_SIZE) {
+      m_index.erase(m_entries.back().line_index);
+      m_entries.pop_back();
+    }
+  }
+  entry_t &entry = m_entries.front();
+  // A new line, or a line which changed, is searched
+  if (entry.text != line.text || entry.length != line.length) {
+    entry.text = line.text;
+    entry.length = line.length;
+    (*this).search(line, entry.spans);
+  }
+  return entry.spans;
+}
+
+/*
+ * Search all the occurrences of each filter, each one from the end of the
+ * previous one. The empty matches are not highlighted.
+ */
+void Highlighter::search(const line_t &line,
+                         std::vector<span_t> &spans) const {
+  spans.clear();
+  if (line.text == nullptr) return;
+  const char *begin = line.text;
+  const char *end = line.text + line.length;
+  for (uint filter = 0; filter < m_clones.size(); ++filter) {
+    const Matcher &matcher = *m_clones[filter];
+    uint start_pos, end_pos;
+    const char *from = begin;
+    while (from <= end && spans.size() < HIGHLIGHT_MAX_SPANS &&
+           matcher.search_from(begin, end, from, start_pos, end_pos)) {
+      if (end_pos > start_pos) {
+        spans.push_back({ start_pos, end_pos, filter });
+        from = begin + end_pos;
+      } else {
+        from = begin + start_pos + 1;
+      }
+    }
+  }
+  std::stable_sort(spans.begin(), spans.end(),
+                   [](const span_t &a, const span_t &b) {
+    return a.start_pos < b.start_pos;
+  });
+  LOGDBG_(spans.size() << " spans found");
+}
@@ -0,0 +1,75 @@
+/*! \brief Highlighting of the matches of the filters
+ *
+ * The filtering only decides which lines match. Where the filters match is
+ * found for the lines displayed only, when they are drawn.
+ */
+
+#ifndef __HIGHLIGHTER_H__
+#define __HIGHLIGHTER_H__
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "types.h"
+#include "buffer.h"
+#include "matcher.h"
+
+// Number of lines whose spans are kept, a few screens
+#define HIGHLIGHT_CACHE_SIZE 1024
+// Maximum number of spans of a line, the occurrences after them are not
+// highlighted
+#define HIGHLIGHT_MAX_SPANS 4096
+
+/*
+ * An occurrence of a filter in a line
+ */
+struct span_t {
+  uint  start_pos;
+  uint  end_pos;
+  uint  filter;     // index of the filter, which gives its color
+};
+
+/*
+ * Find every occurrence of every filter in the lines displayed. The spans of
+ * the lines displayed recently are kept in a least recently used cache, so
+ * scrolling only searches the lines appearing.
+ * The filters are set when the lines they matched are published, the spans are
+ * only asked for by the view.
+ */
+class Highlighter {
+public:
+  Highlighter();
+  /* Highlight the matches of matchers, the filter i being matchers[i] */
+  void set_filters(const std::vector< std::shared_ptr<Matcher> > &matchers);
+  /*
+   * Return the spans of line, the line line_index of the file buffer, by
+   * increasing start position. The spans of several filters may overlap.
+   */
+  std::vector<span_t> get_spans(lineno_t line_index, const line_t &line);
+private:
+  struct entry_t {
+    lineno_t            line_index;
+    // The line may grow if it is the last one of a followed file
+    const char          *text;
+    size_t              length;
+    std::vector<span_t> spans;
+  };
+  void search(const line_t &line, std::vector<span_t> &spans) const;
+
+  // Set by the FilterEngine
+  std::vector< std::shared_ptr<Matcher> >                     m_filters;
+  uint64_t                                                    m_version;
+  std::mutex                                                  m_mutex;
+  // Clones of the filters used by the view, and the version they are of
+  std::vector< std::shared_ptr<Matcher> >                     m_clones;
+  uint64_t                                                    m_clones_version;
+  // The most recently used first
+  std::list<entry_t>                                          m_entries;
+  std::unordered_map<lineno_t, std::list<entry_t>::iterator>  m_index;
+};
+
+#endif // __HIGHLIGHTER_H__
@@ -0,0 +1,233 @@
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "logmacros.h"
+#include "index_cache.h"
+
+#define INDEX_CACHE_MAGIC "GGRIDX01"
+// Size of the windows of the file hashed to check it did not change
+#define INDEX_CACHE_HASH_WINDOW 4096
+
+/*
+ * The header is followed by the segments table (nb_segments lineno_t) then the
+ * lower 32 bits of the offsets (nb_lines uint32_t), so both are aligned.
+ */
+struct index_cache_header_t {
+  char      magic[8];
+  uint64_t  dev;
+  uint64_t  ino;
+  uint64_t  size;         // size of the file when the index was saved
+  int64_t   mtime_sec;
+  int64_t   mtime_nsec;
+  uint64_t  covered;      // bytes of the file covered by the index
+  uint64_t  nb_lines;     // number of offsets in the index
+  uint64_t  nb_segments;
+  uint64_t  head_hash;    // hash of the beginning of the covered bytes
+  uint64_t  tail_hash;    // hash of the end of the covered bytes
+};
+
+/*
+ * FNV-1a hash of [data, data + size)
+ */
+static uint64_t hash(const char *data, size_t size) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= (unsigned char) data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint64_t head_hash(const char *data, size_t covered) {
+  return hash(data, std::min(covered, (size_t) INDEX_CACHE_HASH_WINDOW));
+}
+
+static uint64_t tail_hash(const char *data, size_t covered) {
+  size_t window = std::min(covered, (size_t) INDEX_CACHE_HASH_WINDOW);
+  return hash(data + covered - window, window);
+}
+
+/*
+ * Return true if the tables of an entry are the offsets of lines, increasing
+ * up to covered, so the lines restored stay within the file
+ */
+static bool valid_tables(const uint32_t *low, lineno_t nb_lines,
+                         const lineno_t *segments, size_t nb_segments,
+                         uint64_t covered) {
+  for (size_t k = 0; k < nb_segments; ++k)
+    if (segments[k] > nb_lines || (k != 0 && segments[k] < segments[k - 1]))
+      return false;
+  uint64_t previous = 0;
+  size_t high = 0;
+  for (lineno_t i = 0; i < nb_lines; ++i) {
+    while (high < nb_segments && segments[high] <= i) ++high;
+    uint64_t offset = ((uint64_t) high << 32) | low[i];
+    if (offset < previous || offset > covered) return false;
+    previous = offset;
+  }
+  return previous == covered;
+}
+
+static bool write_all(int fd, const void *data, size_t size) {
+  const char *p = (const char *) data;
+  while (size != 0) {
+    ssize_t written = write(fd, p, size);
+    if (written == -1 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    p += written;
+    size -= written;
+  }
+  return true;
+}
+
+/*
+ * Create directory and its parents
+ */
+static bool make_directory(const std::string &directory) {
+  for (size_t slash = directory.find('/', 1); ;
+       slash = directory.find('/', slash + 1)) {
+    std::string path = directory.substr(0, slash);
+    if (mkdir(path.c_str(), 0700) == -1 && errno != EEXIST) return false;
+    if (slash == std::string::npos) return true;
+  }
+}
+
+IndexCache::IndexCache(const std::string &directory) : m_directory(directory)
+{
+}
+
+std::string IndexCache::default_directory() {
+  const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+  if (xdg_cache_home && *xdg_cache_home)
+    return std::string(xdg_cache_home) + "/ggrep";
+  const char *home = getenv("HOME");
+  if (home && *home) return std::string(home) + "/.cache/ggrep";
+  return "";
+}
+
+std::string IndexCache::entry_path(const struct stat &st) const {
+  char name[64];
+  snprintf(name, sizeof (name), "/%llx-%llx.idx",
+           (unsigned long long) st.st_dev, (unsigned long long) st.st_ino);
+  return m_directory + name;
+}
+
+size_t IndexCache::load(int fd, const char *data, size_t size,
+                        LineIndex &index) {
+  if (m_directory.empty() || size < INDEX_CACHE_MIN_SIZE) return 0;
+  struct stat st;
+  if (fstat(fd, &st) == -1) return 0;
+  std::string path = (*this).entry_path(st);
+  int cache_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (cache_fd == -1) return 0;
+  size_t covered = 0;
+  struct stat cache_st;
+  index_cache_header_t header;
+  if (fstat(cache_fd, &cache_st) == 0 &&
+      pread(cache_fd, &header, sizeof (header), 0) == sizeof (header) &&
+      !memcmp(header.magic, INDEX_CACHE_MAGIC, sizeof (header.magic)) &&
+      header.dev == (uint64_t) st.st_dev && header.ino == (uint64_t) st.st_ino &&
+      // The file is unchanged, or data was appended to it
+      ((header.size == size && header.mtime_sec == st.st_mtim.tv_sec &&
+        header.mtime_nsec == st.st_mtim.tv_nsec) || header.size < size) &&
+      header.covered <= header.size && header.nb_lines != 0 &&
+      // Bounded by the size of the file before the size of the tables is
+      // computed: a line has one byte at least, a segment covers 4GB
+      header.nb_lines <= header.covered + 1 &&
+      header.nb_segments <= (header.covered >> 32) &&
+      (uint64_t) cache_st.st_size == sizeof (header) +
+        header.nb_segments * sizeof (lineno_t) +
+        header.nb_lines * sizeof (uint32_t) &&
+      header.head_hash == head_hash(data, header.covered) &&
+      header.tail_hash == tail_hash(data, header.covered))
+  {
+    void *entry = mmap(nullptr, cache_st.st_size, PROT_READ, MAP_PRIVATE,
+                       cache_fd, 0);
+    if (entry != MAP_FAILED) {
+      const lineno_t *segments =
+        (const lineno_t *) ((const char *) entry + sizeof (header));
+      const uint32_t *low = (const uint32_t *) (segments + header.nb_segments);
+      if (valid_tables(low, header.nb_lines, segments, header.nb_segments,
+                       header.covered)) {
+        index.assign(low, header.nb_lines, segments, header.nb_segments);
+        covered = header.covered;
+        LOGINF("index restored from " << path << ": " << header.nb_lines
+               << " offsets, " << covered << " bytes");
+      } else {
+        LOGINF("corrupted index in " << path);
+      }
+      munmap(entry, cache_st.st_size);
+    }
+  } else {
+    LOGINF("no valid index in " << path);
+  }
+  close(cache_fd);
+  return covered;
+}
+
+void IndexCache::save(int fd, const char *data, size_t size,
+                      const LineIndex &index) {
+  if (m_directory.empty() || size < INDEX_CACHE_MIN_SIZE || index.empty())
+    return;
+  struct stat st;
+  if (fstat(fd, &st) == -1) return;
+  // The sentinel of an unterminated last line is not saved, the line will be
+  // indexed again when the cache is restored
+  lineno_t nb_lines = index.size();
+  if (index.back() > size) --nb_lines;
+  size_t nb_segments = 0;
+  while (nb_segments < index.nb_segments() &&
+         index.segment(nb_segments) < nb_lines)
+    ++nb_segments;
+  index_cache_header_t header;
+  memset(&header, 0, sizeof (header));
+  memcpy(header.magic, INDEX_CACHE_MAGIC, sizeof (header.magic));
+  header.dev = st.st_dev;
+  header.ino = st.st_ino;
+  header.size = size;
+  header.mtime_sec = st.st_mtim.tv_sec;
+  header.mtime_nsec = st.st_mtim.tv_nsec;
+  header.covered = index[nb_lines - 1];
+  header.nb_lines = nb_lines;
+  header.nb_segments = nb_segments;
+  header.head_hash = head_hash(data, header.covered);
+  header.tail_hash = tail_hash(data, header.covered);
+  if (!make_directory(m_directory)) {
+    LOGERR("cannot create " << m_directory << ": " << strerror(errno));
+    return;
+  }
+  // Write in a temporary file renamed once complete, so a concurrent load
+  // never sees a partial entry
+  std::string path = (*this).entry_path(st);
+  std::string tmp_path = path + "." + std::to_string(getpid());
+  int cache_fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0600);
+  if (cache_fd == -1) {
+    LOGERR("cannot create " << tmp_path << ": " << strerror(errno));
+    return;
+  }
+  bool ok = write_all(cache_fd, &header, sizeof (header));
+  for (size_t k = 0; ok && k < nb_segments; ++k) {
+    lineno_t segment = index.segment(k);
+    ok = write_all(cache_fd, &segment, sizeof (segment));
+  }
+  std::vector<uint32_t> block(64 * 1024);
+  for (lineno_t i = 0; ok && i < nb_lines; i += block.size()) {
+    size_t count = std::min((lineno_t) block.size(), nb_lines - i);
+    for (size_t j = 0; j < count; ++j) block[j] = index.low(i + j);
+    ok = write_all(cache_fd, block.data(), count * sizeof (uint32_t));
+  }
+  close(cache_fd);
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) == -1) {
+    LOGERR("cannot save the index in " << path << ": " << strerror(errno));
+    unlink(tmp_path.c_str());
+    return;
+  }
+  LOGINF("index saved in " << path << ": " << nb_lines << " offsets");
+}
@@ -0,0 +1,57 @@
+/*! \brief On-disk cache of the line indexes
+ *
+ * Indexing a multi-GB file means reading all of it. The line index of large
+ * files is saved in a cache directory so the file can be reopened without
+ * being read again.
+ */
+
+#ifndef __INDEX_CACHE_H__
+#define __INDEX_CACHE_H__
+
+#include <string>
+#include <cstddef>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "line_index.h"
+
+// Files smaller than this are indexed faster than their cache is read
+#define INDEX_CACHE_MIN_SIZE (16 * 1024 * 1024)
+
+/*
+ * Each cache entry is a file named after the device and the inode of the
+ * indexed file. It contains a header describing the indexed file (size,
+ * modification time and hashes of its content) followed by the raw tables of
+ * the LineIndex.
+ * An entry is used if the file did not change or if data was only appended to
+ * it. In the latter case the index is restored and the new data indexed.
+ */
+class IndexCache {
+public:
+  /* An empty directory disables the cache */
+  IndexCache(const std::string &directory);
+  /*
+   * Return the default cache directory: $XDG_CACHE_HOME/ggrep or
+   * $HOME/.cache/ggrep, an empty string if none is defined.
+   */
+  static std::string default_directory();
+  /*
+   * Restore the index of the file opened as fd and mapped at data. Returns the
+   * number of bytes of the file covered by the restored index, 0 if there is no
+   * valid cache entry for the file (index is then left untouched).
+   */
+  size_t load(int fd, const char *data, size_t size, LineIndex &index);
+  /*
+   * Save the index of the first size bytes of the file opened as fd and mapped
+   * at data. An unterminated last line is not saved.
+   */
+  void save(int fd, const char *data, size_t size, const LineIndex &index);
+
+private:
+  std::string entry_path(const struct stat &st) const;
+
+private:
+  std::string m_directory;
+};
+
+#endif // __INDEX_CACHE_H__
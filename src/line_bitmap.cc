@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <iterator>
+#include "line_bitmap.h"
+
+size_t LineBitmap::block_t::memory_size() const {
+  return sizeof (block_t) + array.size() * sizeof (uint16_t) +
+    bits.size() * sizeof (uint64_t);
+}
+
+LineBitmap::LineBitmap() : m_number_of_lines(0), m_memory_size(0)
+{
+}
+
+void LineBitmap::append(lineno_t line) {
+  lineno_t key = line >> BITMAP_BLOCK_BITS;
+  uint16_t low = line & (BITMAP_BLOCK_SIZE - 1);
+  if (m_blocks.empty() || m_blocks.back().key != key) {
+    m_blocks.emplace_back(key);
+    m_memory_size += sizeof (block_t);
+  }
+  block_t &block = m_blocks.back();
+  if (block.is_bitset()) {
+    block.bits[low >> 6] |= (uint64_t) 1 << (low & 63);
+  } else {
+    block.array.push_back(low);
+    m_memory_size += sizeof (uint16_t);
+    if (block.array.size() > BITMAP_MAX_ARRAY_SIZE) {
+      m_memory_size -= block.memory_size();
+      to_bitset(block);
+      m_memory_size += block.memory_size();
+    }
+  }
+  ++block.number_of_lines;
+  ++m_number_of_lines;
+}
+
+void LineBitmap::prepend(const LineBitmap &other) {
+  for (auto it = other.m_blocks.rbegin(); it != other.m_blocks.rend(); ++it) {
+    // The last block of other and the first one of the set may be the same
+    if (!m_blocks.empty() && m_blocks.front().key == it->key) {
+      block_t &block = m_blocks.front();
+      m_number_of_lines -= block.number_of_lines;
+      m_memory_size -= block.memory_size();
+      unite(block, *it);
+    } else {
+      m_blocks.push_front(*it);
+    }
+    m_number_of_lines += m_blocks.front().number_of_lines;
+    m_memory_size += m_blocks.front().memory_size();
+  }
+}
+
+void LineBitmap::to_bitset(block_t &block) {
+  block.bits.assign(BITMAP_NB_WORDS, 0);
+  for (uint16_t low: block.array)
+    block.bits[low >> 6] |= (uint64_t) 1 << (low & 63);
+  std::vector<uint16_t>().swap(block.array);
+}
+
+void LineBitmap::to_array(block_t &block) {
+  block.array.clear();
+  block.array.reserve(block.number_of_lines);
+  for (uint32_t w = 0; w < BITMAP_NB_WORDS; ++w) {
+    for (uint64_t word = block.bits[w]; word; word &= word - 1)
+      block.array.push_back(w * 64 + __builtin_ctzll(word));
+  }
+  std::vector<uint64_t>().swap(block.bits);
+}
+
+void LineBitmap::compact(block_t &block) {
+  block.number_of_lines = 0;
+  for (uint64_t word: block.bits)
+    block.number_of_lines += __builtin_popcountll(word);
+  if (block.number_of_lines <= BITMAP_MAX_ARRAY_SIZE) to_array(block);
+}
+
+void LineBitmap::intersect(block_t &block, const block_t &other) {
+  if (block.is_bitset() && other.is_bitset()) {
+    for (uint32_t w = 0; w < BITMAP_NB_WORDS; ++w)
+      block.bits[w] &= other.bits[w];
+    compact(block);
+    return;
+  }
+  // The result is at most as big as the array
+  std::vector<uint16_t> array;
+  if (!block.is_bitset() && !other.is_bitset()) {
+    std::set_intersection(block.array.begin(), block.array.end(),
+                          other.array.begin(), other.array.end(),
+                          std::back_inserter(array));
+  } else {
+    const std::vector<uint16_t> &lows =
+      block.is_bitset() ? other.array : block.array;
+    const std::vector<uint64_t> &bits =
+      block.is_bitset() ? block.bits : other.bits;
+    for (uint16_t low: lows)
+      if (bits[low >> 6] & ((uint64_t) 1 << (low & 63))) array.push_back(low);
+  }
+  block.array.swap(array);
+  std::vector<uint64_t>().swap(block.bits);
+  block.number_of_lines = block.array.size();
+}
+
+void LineBitmap::unite(block_t &block, const block_t &other) {
+  if (!block.is_bitset() && !other.is_bitset()) {
+    std::vector<uint16_t> array;
+    std::set_union(block.array.begin(), block.array.end(),
+                   other.array.begin(), other.array.end(),
+                   std::back_inserter(array));
+    block.array.swap(array);
+    block.number_of_lines = block.array.size();
+    if (block.array.size() > BITMAP_MAX_ARRAY_SIZE) to_bitset(block);
+    return;
+  }
+  if (!block.is_bitset()) to_bitset(block);
+  if (other.is_bitset()) {
+    for (uint32_t w = 0; w < BITMAP_NB_WORDS; ++w)
+      block.bits[w] |= other.bits[w];
+  } else {
+    for (uint16_t low: other.array)
+      block.bits[low >> 6] |= (uint64_t) 1 << (low & 63);
+  }
+  compact(block);
+}
+
+void LineBitmap::intersect(const LineBitmap &other) {
+  // Only the blocks present in both sets are kept
+  std::deque<block_t> blocks;
+  auto it = other.m_blocks.begin();
+  for (block_t &block: m_blocks) {
+    while (it != other.m_blocks.end() && it->key < block.key) ++it;
+    if (it == other.m_blocks.end()) break;
+    if (it->key != block.key) continue;
+    intersect(block, *it);
+    if (block.number_of_lines != 0) blocks.push_back(std::move(block));
+  }
+  m_blocks.swap(blocks);
+  (*this).update_sizes();
+}
+
+void LineBitmap::unite(const LineBitmap &other) {
+  std::deque<block_t> blocks;
+  auto it = other.m_blocks.begin();
+  for (block_t &block: m_blocks) {
+    while (it != other.m_blocks.end() && it->key < block.key)
+      blocks.push_back(*it++);
+    if (it != other.m_blocks.end() && it->key == block.key)
+      unite(block, *it++);
+    blocks.push_back(std::move(block));
+  }
+  blocks.insert(blocks.end(), it, other.m_blocks.end());
+  m_blocks.swap(blocks);
+  (*this).update_sizes();
+}
+
+void LineBitmap::get_lines(std::vector<lineno_t> &lines, lineno_t begin,
+                           lineno_t end) const {
+  for (const block_t &block: m_blocks) {
+    lineno_t base = block.key << BITMAP_BLOCK_BITS;
+    if (base >= end) return;
+    if (base + BITMAP_BLOCK_SIZE <= begin) continue;
+    if (block.is_bitset()) {
+      for (uint32_t w = 0; w < BITMAP_NB_WORDS; ++w) {
+        for (uint64_t word = block.bits[w]; word; word &= word - 1) {
+          lineno_t line = base + w * 64 + __builtin_ctzll(word);
+          if (line >= end) return;
+          if (line >= begin) lines.push_back(line);
+        }
+      }
+    } else {
+      for (uint16_t low: block.array) {
+        if (base + low >= end) return;
+        if (base + low >= begin) lines.push_back(base + low);
+      }
+    }
+  }
+}
+
+void LineBitmap::update_sizes() {
+  m_number_of_lines = 0;
+  m_memory_size = 0;
+  for (const block_t &block: m_blocks) {
+    m_number_of_lines += block.number_of_lines;
+    m_memory_size += block.memory_size();
+  }
+}
@@ -0,0 +1,74 @@
+/*! \brief Compressed set of lines
+ *
+ * A set of line numbers stored like a roaring bitmap: the lines are grouped in
+ * blocks by their high bits, and the low bits of the lines of a block are
+ * stored either as a sorted array when the block holds few lines, or as a
+ * bitset otherwise. A set of sparse or dense lines takes little memory, and the
+ * sets are intersected or united block by block.
+ */
+
+#ifndef __LINE_BITMAP_H__
+#define __LINE_BITMAP_H__
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "types.h"
+
+// Log2 of the number of lines of a block
+#define BITMAP_BLOCK_BITS 16
+#define BITMAP_BLOCK_SIZE (1 << BITMAP_BLOCK_BITS)
+// Number of 64 bits words of a bitset
+#define BITMAP_NB_WORDS (BITMAP_BLOCK_SIZE / 64)
+// Above this number of lines, a bitset is smaller than an array
+#define BITMAP_MAX_ARRAY_SIZE 4096
+
+class LineBitmap {
+public:
+  LineBitmap();
+  /* Add a line, greater than the lines already in the set */
+  void append(lineno_t line);
+  /* Add the lines of other, which are lower than the lines of the set */
+  void prepend(const LineBitmap &other);
+  /* Only keep the lines which are also in other */
+  void intersect(const LineBitmap &other);
+  /* Add the lines of other */
+  void unite(const LineBitmap &other);
+  /*
+   * Append the lines of the set in [begin, end) to lines, in increasing order
+   */
+  void get_lines(std::vector<lineno_t> &lines, lineno_t begin,
+                 lineno_t end) const;
+  inline lineno_t get_number_of_lines() const { return m_number_of_lines; }
+  /* Memory used by the set in bytes */
+  inline size_t memory_size() const { return m_memory_size; }
+
+private:
+  struct block_t {
+    lineno_t              key;      // line >> BITMAP_BLOCK_BITS
+    uint32_t              number_of_lines;
+    std::vector<uint16_t> array;    // sorted low bits, if not a bitset
+    std::vector<uint64_t> bits;     // BITMAP_NB_WORDS words, if a bitset
+
+    block_t(lineno_t k) : key(k), number_of_lines(0) {}
+    inline bool is_bitset() const { return !bits.empty(); }
+    size_t memory_size() const;
+  };
+  static void to_bitset(block_t &block);
+  static void to_array(block_t &block);
+  /* Count the lines of a bitset, and turn it to an array if it is small */
+  static void compact(block_t &block);
+  static void intersect(block_t &block, const block_t &other);
+  static void unite(block_t &block, const block_t &other);
+  /* Compute the number of lines and the memory size from the blocks */
+  void update_sizes();
+
+private:
+  std::deque<block_t>   m_blocks;   // by increasing key
+  lineno_t              m_number_of_lines;
+  size_t                m_memory_size;
+};
+
+#endif // __LINE_BITMAP_H__
@@ -0,0 +1,145 @@
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+#endif
+#include "line_index.h"
+
+/*
+ * Append the offsets corresponding to the bits set in mask. Bit n of mask set
+ * means a \n was found at offset base + n.
+ */
+static inline void append_mask(uint64_t mask, offset_t base,
+                               LineIndex &offsets) {
+  while (mask) {
+    offsets.push_back(base + __builtin_ctzll(mask) + 1);
+    // Clear the lowest bit set
+    mask &= mask - 1;
+  }
+}
+
+/*
+ * Portable implementation, also used for the tail of the vectorized versions
+ */
+static lineno_t index_lines_memchr(const char *data, size_t size,
+                                   offset_t base, LineIndex &offsets) {
+  lineno_t count = 0;
+  const char *current = data;
+  const char *end = data + size;
+  while (current < end) {
+    const char *eol = (const char *) memchr(current, '\n', end - current);
+    if (eol == nullptr) break;
+    current = eol + 1;
+    offsets.push_back(base + (current - data));
+    ++count;
+  }
+  return count;
+}
+
+#if defined(__SSE2__)
+/*
+ * Process 64 bytes per iteration with four 16 bytes comparisons
+ */
+static lineno_t index_lines_sse2(const char *data, size_t size, offset_t base,
+                                 LineIndex &offsets) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  lineno_t count = offsets.size();
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    const __m128i *p = (const __m128i *) (data + i);
+    uint64_t m0 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p), nl));
+    uint64_t m1 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 1), nl));
+    uint64_t m2 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), nl));
+    uint64_t m3 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 3), nl));
+    uint64_t mask = m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+    if (mask) append_mask(mask, base + i, offsets);
+  }
+  index_lines_memchr(data + i, size - i, base + i, offsets);
+  return offsets.size() - count;
+}
+
+/*
+ * Process 64 bytes per iteration with two 32 bytes comparisons
+ */
+__attribute__((target("avx2")))
+static lineno_t index_lines_avx2(const char *data, size_t size, offset_t base,
+                                 LineIndex &offsets) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  lineno_t count = offsets.size();
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    const __m256i *p = (const __m256i *) (data + i);
+    uint64_t lo = (uint32_t) _mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(_mm256_loadu_si256(p), nl));
+    uint64_t hi = (uint32_t) _mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(_mm256_loadu_si256(p + 1), nl));
+    uint64_t mask = lo | (hi << 32);
+    if (mask) append_mask(mask, base + i, offsets);
+  }
+  index_lines_memchr(data + i, size - i, base + i, offsets);
+  return offsets.size() - count;
+}
+#endif
+
+lineno_t index_lines(const char *data, size_t size, offset_t base,
+                     LineIndex &offsets) {
+#if defined(__SSE2__)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) return index_lines_avx2(data, size, base, offsets);
+  return index_lines_sse2(data, size, base, offsets);
+#else
+  return index_lines_memchr(data, size, base, offsets);
+#endif
+}
+
+void LineIndex::append(const LineIndex &other) {
+  lineno_t position = m_low.size();
+  // The segments of other already started in this index are found at its
+  // line 0, only the new ones need to be translated
+  for (size_t k = m_segments.size(); k < other.m_segments.size(); ++k)
+    m_segments.push_back(position + other.m_segments[k]);
+  for (lineno_t i = 0; i < other.m_low.size(); ++i)
+    m_low.push_back(other.m_low[i]);
+}
+
+void LineIndex::assign(const uint32_t *low, lineno_t nb_lines,
+                       const lineno_t *segments, size_t nb_segments) {
+  (*this).clear();
+  m_segments.append(segments, nb_segments);
+  m_low.append(low, nb_lines);
+}
+
+lineno_t index_lines_parallel(const char *data, size_t size, offset_t base,
+                              LineIndex &offsets, unsigned nb_threads) {
+  if (nb_threads == 0) nb_threads = std::thread::hardware_concurrency();
+  size_t nb_chunks = std::min((size_t) std::max(nb_threads, 1u),
+                              size / PARALLEL_INDEX_MIN_CHUNK_SIZE);
+  if (nb_chunks <= 1) return index_lines(data, size, base, offsets);
+  // Each chunk is indexed in its own table. A line straddling two chunks needs
+  // no fix up: the offsets are the line starts, found after the \n, so the
+  // line simply begins in one chunk and its successor is found in the next.
+  size_t chunk_size = size / nb_chunks;
+  std::vector< std::unique_ptr<LineIndex> > chunks(nb_chunks);
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < nb_chunks; ++c) {
+    size_t begin = c * chunk_size;
+    size_t end = (c == nb_chunks - 1) ? size : begin + chunk_size;
+    chunks[c].reset(new LineIndex());
+    threads.emplace_back([data, begin, end, base, c, &chunks]() {
+      index_lines(data + begin, end - begin, base + begin, *chunks[c]);
+    });
+  }
+  for (auto &t: threads) t.join();
+  // Stitch the chunks together. The position of each chunk in the global
+  // table is the prefix sum of the counts of the previous chunks.
+  lineno_t count = 0;
+  for (size_t c = 0; c < nb_chunks; ++c) {
+    count += chunks[c]->size();
+    offsets.append(*chunks[c]);
+    chunks[c].reset();
+  }
+  return count;
+}
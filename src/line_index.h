@@ -0,0 +1,96 @@
+/*! \brief Line indexing kernel
+ *
+ * Functions used to find the end of lines in large blocks of text and build
+ * the index of the line offsets of a buffer.
+ */
+
+#ifndef __LINE_INDEX_H__
+#define __LINE_INDEX_H__
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "types.h"
+#include "chunked_array.h"
+
+/*
+ * Table of the line offsets of a buffer.
+ * Offsets are 64 bits but only their lower 32 bits are stored for each line.
+ * As the offsets are increasing, the upper 32 bits only change every 4GB of
+ * text. The index of the first line of each 4GB segment is kept in a separate
+ * table which is tiny, so 64 bits offsets cost 4 bytes per line.
+ * The index can be read by several threads while one thread appends to it.
+ */
+class LineIndex {
+public:
+  inline offset_t operator[](lineno_t i) const {
+    offset_t high = 0;
+    // Most files are smaller than 4GB and have no segment at all
+    size_t nb_segments = m_segments.size();
+    while (high < nb_segments && m_segments[high] <= i) ++high;
+    return (high << 32) | m_low[i];
+  }
+  inline void push_back(offset_t offset) {
+    if ((offset >> 32) != m_segments.size()) (*this).add_segments(offset);
+    m_low.push_back((uint32_t) offset);
+  }
+  /* Append the offsets of another index, which shall all be greater or equal
+     to the last offset of this index */
+  void append(const LineIndex &other);
+  /* Replace the content of the index by the raw tables low and segments, as
+     returned by low() and segment() */
+  void assign(const uint32_t *low, lineno_t nb_lines, const lineno_t *segments,
+              size_t nb_segments);
+  /* Raw access to the tables, used to save the index */
+  inline uint32_t low(lineno_t i) const { return m_low[i]; }
+  inline lineno_t segment(size_t k) const { return m_segments[k]; }
+  inline size_t nb_segments() const { return m_segments.size(); }
+  inline offset_t back() const { return (*this)[size() - 1]; }
+  inline lineno_t size() const { return m_low.size(); }
+  inline bool empty() const { return m_low.empty(); }
+  void clear() { m_low.clear(); m_segments.clear(); }
+  /* Memory used by the index in bytes */
+  size_t memory_size() const {
+    return m_low.memory_size() + m_segments.memory_size();
+  }
+
+private:
+  void add_segments(offset_t offset) {
+    // m_segments[k] is the index of the first line whose offset is greater or
+    // equal to (k + 1) * 4GB
+    while (m_segments.size() < (offset >> 32))
+      m_segments.push_back(m_low.size());
+  }
+
+private:
+  ChunkedArray<uint32_t>    m_low;
+  ChunkedArray<lineno_t, 8> m_segments;
+};
+
+// Below this size per thread, it is not worth spawning threads
+#define PARALLEL_INDEX_MIN_CHUNK_SIZE (16 * 1024 * 1024)
+
+/*
+ * Look for the \n characters in [data, data + size) and append, for each of
+ * them, the offset of the character following it (i.e. the beginning of the
+ * next line) to offsets. base is added to each offset appended so a large
+ * buffer can be indexed block by block.
+ * \r characters are not considered, they are stripped by the buffer when the
+ * line is accessed.
+ * The search is vectorized with AVX2 when the CPU supports it, SSE2 otherwise.
+ * Returns the number of end of lines found.
+ */
+lineno_t index_lines(const char *data, size_t size, offset_t base,
+                     LineIndex &offsets);
+
+/*
+ * Same as index_lines but the block is split in byte ranges indexed
+ * concurrently by nb_threads threads (0 means one per core). The partial
+ * results are then stitched in order into offsets.
+ * Small blocks are indexed on the calling thread.
+ */
+lineno_t index_lines_parallel(const char *data, size_t size, offset_t base,
+                              LineIndex &offsets, unsigned nb_threads = 0);
+
+#endif // __LINE_INDEX_H__
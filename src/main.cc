@@ -1,5 +1,10 @@
 #include <getopt.h>
+#include <string>
+#include <vector>
 #include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "logmacros.h"
 #include "terminal_view.h"
@@ -25,24 +30,59 @@ int version() {
 
 int help() {
   std::cout << "Usage: ggrep [OPTION]... [FILE]..." << std::endl;
+  std::cout << "When FILE is -, or with no FILE and a redirected standard input,"
+            << " read standard input." << std::endl;
+  std::cout << "      --follow   keep reading the data appended to FILE"
+            << std::endl;
+  std::cout << "  -f, --file=PATTERNS"
+            << "  filter FILE with the patterns of PATTERNS, one per line"
+            << std::endl;
+  std::cout << "      --scan-order=ORDER"
+            << "  filter from the line displayed (viewport, the default),"
+            << std::endl
+            << "                 from the last line (tail, the default with"
+            << " --follow)" << std::endl
+            << "                 or from the first line (forward)" << std::endl;
+  std::cout << std::endl;
+  std::cout << "A pattern beginning with ? combines regexes with & (and),"
+            << " | (or), ! (not)" << std::endl
+            << "and parentheses, e.g. ?ERROR & !(timeout | \"retry [0-9]+\")."
+            << std::endl;
+  std::cout << "A pattern may be prefixed by options, e.g. (?iw)error: i"
+            << " ignores the case," << std::endl
+            << "f matches a fixed string and w whole words. In the prompt,"
+            << " Ctrl+T, Ctrl+L" << std::endl
+            << "and Ctrl+W toggle them." << std::endl;
   return 0;
 }
 
-int do_version, do_help;
+int do_version, do_help, do_follow;
 struct option longopts[] = {
    { "version", no_argument,       & do_version,    1   },
    { "help",    no_argument,       & do_help,       1   },
+   { "follow",  no_argument,       & do_follow,     1   },
+   { "file",    required_argument, NULL,            'f' },
+   { "scan-order", required_argument, NULL,         's' },
    { 0, 0, 0, 0 }
 };
 
-void manage_options(int argc, char **argv, char *&filename) {
+void manage_options(int argc, char **argv, char *&filename,
+                    char *&patterns_filename, char *&scan_order) {
   // If not filename is provided, the value is NULL
   filename = nullptr;
+  patterns_filename = nullptr;
+  scan_order = nullptr;
   char c;
-  while ((c = getopt_long(argc, argv, "vh", longopts, NULL)) != -1) {
+  while ((c = getopt_long(argc, argv, "vhf:", longopts, NULL)) != -1) {
     switch (c) {
     case 0: /* getopt_long() set a variable, just keep going */
       break;
+    case 'f':
+      patterns_filename = optarg;
+      break;
+    case 's':
+      scan_order = optarg;
+      break;
     case 'h':
       help();
       exit(0);
@@ -67,6 +107,61 @@ void manage_options(int argc, char **argv, char *&filename) {
     filename = argv[i];
 }
 
+/*
+ * Read the patterns to filter the file with, one per line
+ */
+std::vector<std::string> read_patterns(const char *patterns_filename) {
+  std::vector<std::string> patterns;
+  std::ifstream file(patterns_filename);
+  if (!file) {
+    std::cerr << "cannot open " << patterns_filename << ": " << strerror(errno)
+              << std::endl;
+    exit(1);
+  }
+  std::string pattern;
+  while (std::getline(file, pattern)) {
+    if (!pattern.empty() && pattern.back() == '\r') pattern.pop_back();
+    if (!pattern.empty()) patterns.push_back(pattern);
+  }
+  return patterns;
+}
+
+/*
+ * Order in which the lines are filtered, by default from the line displayed or
+ * from the last line when following the file
+ */
+scan_order_e parse_scan_order(const char *scan_order) {
+  if (scan_order == nullptr)
+    return do_follow ? scan_order_e::TAIL_FIRST : scan_order_e::VIEWPORT_FIRST;
+  if (strcmp(scan_order, "viewport") == 0) return scan_order_e::VIEWPORT_FIRST;
+  if (strcmp(scan_order, "tail") == 0) return scan_order_e::TAIL_FIRST;
+  if (strcmp(scan_order, "forward") == 0) return scan_order_e::FORWARD;
+  std::cerr << "invalid scan order " << scan_order
+            << ": expected viewport, tail or forward" << std::endl;
+  exit(1);
+}
+
+/*
+ * The user inputs are read from the standard input. If the text to browse
+ * comes from the standard input, it is moved to another file descriptor and
+ * the terminal is reopened as the standard input.
+ * Returns the file descriptor to read the text from, -1 if the standard input
+ * is not read.
+ */
+int detach_stdin(char *&filename) {
+  static char stdin_filename[] = "-";
+  if (filename == nullptr && !isatty(STDIN_FILENO)) filename = stdin_filename;
+  if (filename == nullptr || strcmp(filename, "-") != 0) return -1;
+  int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+  int tty = open("/dev/tty", O_RDONLY);
+  if (fd == -1 || tty == -1 || dup2(tty, STDIN_FILENO) == -1) {
+    std::cerr << "cannot read the terminal: " << strerror(errno) << std::endl;
+    exit(1);
+  }
+  close(tty);
+  return fd;
+}
+
 Controller *g_controller = NULL;
 
 void terminate(int sig, siginfo_t *info, void *oldact) {
@@ -110,13 +205,19 @@ int main(int argc, char **argv) {
   install_sigsegv_handler();
   // Parse the options
   char *filename = nullptr;
-  manage_options(argc, argv, filename);
+  char *patterns_filename = nullptr;
+  char *scan_order = nullptr;
+  manage_options(argc, argv, filename, patterns_filename, scan_order);
+  scan_order_e order = parse_scan_order(scan_order);
+  std::vector<std::string> patterns;
+  if (patterns_filename != nullptr) patterns = read_patterns(patterns_filename);
+  int stdin_fd = detach_stdin(filename);
   // Create the various model used by the application
   BrowserModel  browser_model;
   FBarModel     fbar_model;
   PromptModel   prompt_model;
   StateModel    state_model;
-  BufferFactory buffer_factory;
+  BufferFactory buffer_factory(do_follow, stdin_fd);
   // Create a ncurses terminal view. Could also be a Windows terminal view or a
   // Qt window for example.
   TerminalView view(browser_model, fbar_model, prompt_model, state_model);
@@ -124,6 +225,7 @@ int main(int argc, char **argv) {
   // Create the controller
   Controller controller(browser_model, fbar_model, prompt_model, state_model,
                         buffer_factory);
+  controller.set_scan_order(order);
   // Install interrupt routine
   g_controller = &controller;
   install_sigint_handler();
@@ -131,7 +233,9 @@ int main(int argc, char **argv) {
   // inputs
   controller.bind_view(view);
   // If a filename was provided, create a buffer in the controller
-  if (filename != nullptr) controller.create_buffer(filename);
+  if (filename != nullptr && controller.create_buffer(filename) &&
+      !patterns.empty())
+    controller.add_filters(patterns);
   // Create the thread that listens to the user inputs and interprets those
   // inputs
   controller.start();
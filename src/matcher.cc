@@ -0,0 +1,652 @@
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+#endif
+#include "logmacros.h"
+#include "matcher.h"
+#include "filter_plan.h"
+
+// Characters with a special meaning in an ECMAScript regex
+#define REGEX_METACHARACTERS "^$\\.*+?()[]{}|"
+// Letters of the flags of a filter, see filter_flags_t
+#define FILTER_FLAGS "ifw"
+
+/* The ASCII letters in lower case, the other bytes unchanged */
+static inline char to_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/*
+ * Return true if there is a word boundary (\\b) at position in [begin, end)
+ */
+static inline bool is_boundary(const char *begin, const char *end,
+                               const char *position) {
+  bool before = position > begin &&
+    (isalnum((unsigned char) position[-1]) || position[-1] == '_');
+  bool after = position < end &&
+    (isalnum((unsigned char) position[0]) || position[0] == '_');
+  return before != after;
+}
+
+/*
+ * Bit set in the bytes compared to c, a byte of a needle in lower case, to fold
+ * them to lower case: only the two cases of a letter give the lower case one
+ */
+static inline char fold_bit(char c) {
+  return c >= 'a' && c <= 'z' ? 0x20 : 0;
+}
+
+/*
+ * Compare n bytes of data to needle. If ICASE, needle is in lower case and the
+ * bytes of data are compared once in lower case.
+ */
+template <bool ICASE>
+static inline bool equal(const char *data, const char *needle, size_t n) {
+  if (!ICASE) return !memcmp(data, needle, n);
+  for (size_t i = 0; i < n; ++i)
+    if (to_lower(data[i]) != needle[i]) return false;
+  return true;
+}
+
+/*
+ * Portable implementation, also used for the tail of the vectorized versions.
+ * If ICASE, needle is in lower case and matches the bytes in both cases.
+ */
+template <bool ICASE>
+static const char *find_memchr(const char *data, size_t size,
+                               const char *needle, size_t length) {
+  if (size < length) return nullptr;
+  const char *current = data;
+  const char *last = data + size - length;
+  while (current <= last) {
+    if (ICASE) {
+      while (current <= last && to_lower(*current) != needle[0]) ++current;
+      if (current > last) return nullptr;
+    } else {
+      current = (const char *) memchr(current, needle[0], last - current + 1);
+      if (current == nullptr) return nullptr;
+    }
+    if (equal<ICASE>(current + 1, needle + 1, length - 1)) return current;
+    ++current;
+  }
+  return nullptr;
+}
+
+#if defined(__SSE2__)
+/*
+ * Compare the first byte of the needle, and the one at probe, to 16 positions
+ * at once, and only verify the positions where both are equal. If ICASE, the
+ * bytes are folded with fold_bit() first.
+ */
+template <bool ICASE>
+static const char *find_sse2(const char *data, size_t size,
+                             const char *needle, size_t length, size_t probe) {
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i second = _mm_set1_epi8(needle[probe]);
+  const __m128i fold_first = _mm_set1_epi8(fold_bit(needle[0]));
+  const __m128i fold_second = _mm_set1_epi8(fold_bit(needle[probe]));
+  size_t i = 0;
+  for (; i + length - 1 + 16 <= size; i += 16) {
+    __m128i block_first = _mm_loadu_si128((const __m128i *) (data + i));
+    __m128i block_second =
+      _mm_loadu_si128((const __m128i *) (data + i + probe));
+    if (ICASE) {
+      block_first = _mm_or_si128(block_first, fold_first);
+      block_second = _mm_or_si128(block_second, fold_second);
+    }
+    uint32_t mask = _mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                    _mm_cmpeq_epi8(second, block_second)));
+    while (mask) {
+      size_t position = i + __builtin_ctz(mask);
+      // The first byte is already known to be equal
+      if (equal<ICASE>(data + position + 1, needle + 1, length - 1))
+        return data + position;
+      // Clear the lowest bit set
+      mask &= mask - 1;
+    }
+  }
+  return find_memchr<ICASE>(data + i, size - i, needle, length);
+}
+
+/*
+ * Same as find_sse2 with 32 positions at once
+ */
+template <bool ICASE>
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *data, size_t size,
+                             const char *needle, size_t length, size_t probe) {
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i second = _mm256_set1_epi8(needle[probe]);
+  const __m256i fold_first = _mm256_set1_epi8(fold_bit(needle[0]));
+  const __m256i fold_second = _mm256_set1_epi8(fold_bit(needle[probe]));
+  size_t i = 0;
+  for (; i + length - 1 + 32 <= size; i += 32) {
+    __m256i block_first = _mm256_loadu_si256((const __m256i *) (data + i));
+    __m256i block_second =
+      _mm256_loadu_si256((const __m256i *) (data + i + probe));
+    if (ICASE) {
+      block_first = _mm256_or_si256(block_first, fold_first);
+      block_second = _mm256_or_si256(block_second, fold_second);
+    }
+    uint32_t mask = _mm256_movemask_epi8(
+      _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                       _mm256_cmpeq_epi8(second, block_second)));
+    while (mask) {
+      size_t position = i + __builtin_ctz(mask);
+      if (equal<ICASE>(data + position + 1, needle + 1, length - 1))
+        return data + position;
+      mask &= mask - 1;
+    }
+  }
+  return find_sse2<ICASE>(data + i, size - i, needle, length, probe);
+}
+#endif
+
+/*
+ * Return the first occurrence of needle in [data, data + size), nullptr if
+ * there is none. If ICASE, needle is in lower case and matches the bytes in
+ * both cases. probe is the position of a rare byte of the needle, tested with
+ * the first one before the others.
+ */
+template <bool ICASE>
+static const char *find(const char *data, size_t size, const char *needle,
+                        size_t length, size_t probe) {
+#if defined(__SSE2__)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) return find_avx2<ICASE>(data, size, needle, length, probe);
+  return find_sse2<ICASE>(data, size, needle, length, probe);
+#else
+  return find_memchr<ICASE>(data, size, needle, length);
+#endif
+}
+
+/*
+ * Return the position of the byte of needle tested with the first one: the
+ * last one, the most independent of the first one, unless the letters match
+ * both cases. A letter in both cases is frequent, the last byte which is
+ * neither a letter nor a space is then preferred, if any.
+ */
+static size_t find_probe(const std::string &needle, bool icase) {
+  size_t probe = needle.size() - 1;
+  if (!icase) return probe;
+  for (size_t i = probe; i > 0; --i) {
+    unsigned char c = needle[i];
+    if (!isalpha(c) && !isspace(c)) return i;
+  }
+  return probe;
+}
+
+/*
+ * Skip the quantifier at pattern[i], if any, and return the minimum number of
+ * repetitions of the preceding atom: 1 without quantifier.
+ */
+static size_t skip_quantifier(const std::string &pattern, size_t &i) {
+  if (i == pattern.size()) return 1;
+  size_t min = 1;
+  switch (pattern[i]) {
+    case '*': case '?': min = 0; ++i; break;
+    case '+': ++i; break;
+    case '{':
+      min = 0;
+      while (++i < pattern.size() && isdigit((unsigned char) pattern[i]))
+        min = min * 10 + pattern[i] - '0';
+      while (i < pattern.size() && pattern[i++] != '}');
+      break;
+    default: return 1;
+  }
+  // Lazy quantifier
+  if (i < pattern.size() && pattern[i] == '?') ++i;
+  return min;
+}
+
+/*
+ * Skip the escape sequence at pattern[i], the backslash excluded. Return the
+ * character it stands for if it is an escaped metacharacter, '\0' otherwise.
+ */
+static char skip_escape(const std::string &pattern, size_t &i) {
+  if (i == pattern.size()) return '\0';
+  char c = pattern[i++];
+  if (c != '\0' && strchr(REGEX_METACHARACTERS, c)) return c;
+  // Skip the operands of the escape sequence
+  switch (c) {
+    case 'x': i += 2; break;
+    case 'u': i += 4; break;
+    case 'c': i += 1; break;
+    default:
+      // Back reference
+      while (isdigit((unsigned char) c) && i < pattern.size() &&
+             isdigit((unsigned char) pattern[i]))
+        ++i;
+  }
+  i = std::min(i, pattern.size());
+  return '\0';
+}
+
+/*
+ * Append to literals the runs of literal characters any match of the sequence
+ * starting at pattern[i] must contain. The sequence ends at the end of the
+ * pattern or at the parenthesis closing the current group, which is skipped.
+ * Returns false if the sequence is an alternation, in which case the literals
+ * it appended are not required.
+ */
+static bool find_required_literals(const std::string &pattern, size_t &i,
+                                   std::vector<std::string> &literals) {
+  bool alternation = false;
+  std::string run;
+  auto end_run = [&]() {
+    if (!run.empty()) literals.push_back(run);
+    run.clear();
+  };
+  while (i < pattern.size()) {
+    char c = pattern[i++];
+    if (c == ')') break;
+    if (c == '|') {
+      alternation = true;
+      end_run();
+      continue;
+    }
+    if (c == '(') {
+      end_run();
+      // Lookaheads do not consume characters, their content is not required
+      bool lookahead = pattern.compare(i, 2, "?=") == 0 ||
+        pattern.compare(i, 2, "?!") == 0;
+      if (pattern.compare(i, 2, "?:") == 0 || lookahead) i += 2;
+      std::vector<std::string> group;
+      bool required = find_required_literals(pattern, i, group);
+      if (skip_quantifier(pattern, i) != 0 && required && !lookahead)
+        literals.insert(literals.end(), group.begin(), group.end());
+      continue;
+    }
+    if (c == '[') {
+      // Skip the character class
+      if (i < pattern.size() && pattern[i] == '^') ++i;
+      while (i < pattern.size() && pattern[i] != ']')
+        if (pattern[i++] == '\\') ++i;
+      i = std::min(i + 1, pattern.size());
+      c = '\0';
+    } else if (c == '\\') {
+      c = skip_escape(pattern, i);
+    } else if (strchr(REGEX_METACHARACTERS, c)) {
+      // Any character or anchor
+      c = '\0';
+    }
+    size_t atom_end = i;
+    size_t min = skip_quantifier(pattern, i);
+    if (c == '\0' || min == 0) {
+      end_run();
+    } else {
+      run.push_back(c);
+      // A repeated character is required once, but the characters following
+      // it are not adjacent to it
+      if (i != atom_end) end_run();
+    }
+  }
+  end_run();
+  return !alternation;
+}
+
+std::shared_ptr<Matcher> Matcher::compile(const std::string &filter) {
+  filter_flags_t flags = { false, false, false };
+  std::string pattern = Matcher::parse_flags(filter, flags);
+  return Matcher::compile(pattern, flags);
+}
+
+std::shared_ptr<Matcher> Matcher::compile(const std::string &pattern,
+                                          const filter_flags_t &flags) {
+  if (!flags.fixed && FilterPlan::is_expression(pattern)) {
+    LOGDBG("filter " << pattern << " compiled to a plan");
+    return std::make_shared<FilterPlan>(pattern.substr(1), flags);
+  }
+  std::string literal = pattern;
+  if (flags.fixed || LiteralMatcher::is_literal(pattern, literal)) {
+    LOGDBG("filter " << pattern << " compiled to a literal matcher");
+    return std::make_shared<LiteralMatcher>(literal, flags.icase, flags.word);
+  }
+  LOGDBG("filter " << pattern << " compiled to a regex matcher");
+  return std::make_shared<RegexMatcher>(Matcher::to_regex(pattern, flags),
+                                        flags.icase);
+}
+
+std::string Matcher::parse_flags(const std::string &filter,
+                                 filter_flags_t &flags) {
+  size_t begin = 0;
+  // Each prefix is (? followed by at least a flag and ). What follows the fixed
+  // flag is the string, even if it looks like a prefix.
+  while (!flags.fixed && filter.compare(begin, 2, "(?") == 0) {
+    size_t end = filter.find_first_not_of(FILTER_FLAGS, begin + 2);
+    if (end == begin + 2 || end == std::string::npos || filter[end] != ')')
+      break;
+    for (size_t i = begin + 2; i < end; ++i) {
+      switch (filter[i]) {
+        case 'i': flags.icase = true; break;
+        case 'f': flags.fixed = true; break;
+        case 'w': flags.word = true; break;
+      }
+    }
+    begin = end + 1;
+  }
+  return filter.substr(begin);
+}
+
+std::string Matcher::format_flags(const std::string &pattern,
+                                  const filter_flags_t &flags) {
+  std::string prefix;
+  if (flags.icase) prefix.push_back('i');
+  if (flags.fixed) prefix.push_back('f');
+  if (flags.word) prefix.push_back('w');
+  if (prefix.empty()) return pattern;
+  return "(?" + prefix + ")" + pattern;
+}
+
+std::string Matcher::to_regex(const std::string &pattern,
+                              const filter_flags_t &flags) {
+  std::string regex;
+  if (flags.fixed) {
+    for (char c: pattern) {
+      if (strchr(REGEX_METACHARACTERS, c) != nullptr) regex.push_back('\\');
+      regex.push_back(c);
+    }
+  } else {
+    regex = pattern;
+  }
+  if (flags.word) regex = "\\b(?:" + regex + ")\\b";
+  return regex;
+}
+
+/*
+ * If the lines matching pattern with flags are the lines containing a string,
+ * store it in literal and return true
+ */
+static bool get_literal(const std::string &pattern,
+                        const filter_flags_t &flags, std::string &literal) {
+  if (flags.word) return false;
+  if (!flags.fixed) return LiteralMatcher::is_literal(pattern, literal);
+  literal = pattern;
+  return true;
+}
+
+bool Matcher::is_narrower(const std::string &pattern_filter,
+                          const std::string &previous_filter) {
+  if (pattern_filter == previous_filter) return true;
+  filter_flags_t flags = { false, false, false };
+  filter_flags_t previous_flags = { false, false, false };
+  std::string pattern = Matcher::parse_flags(pattern_filter, flags);
+  std::string previous = Matcher::parse_flags(previous_filter, previous_flags);
+  // The expressions are not analyzed
+  if ((!flags.fixed && FilterPlan::is_expression(pattern)) ||
+      (!previous_flags.fixed && FilterPlan::is_expression(previous)))
+    return false;
+  // A string found in any case is not found in the same case
+  if (flags.icase && !previous_flags.icase) return false;
+  std::string literal;
+  if (!get_literal(previous, previous_flags, literal)) return false;
+  // A line matching pattern contains the literals it requires, so it matches
+  // previous if one of them contains the literal of previous
+  std::vector<std::string> required(1);
+  if (!get_literal(pattern, flags, required.front()))
+    required = RegexMatcher::required_literals(
+      Matcher::to_regex(pattern, flags));
+  if (previous_flags.icase) {
+    std::transform(literal.begin(), literal.end(), literal.begin(), to_lower);
+    for (std::string &string: required)
+      std::transform(string.begin(), string.end(), string.begin(), to_lower);
+  }
+  for (const std::string &string: required)
+    if (string.find(literal) != std::string::npos) return true;
+  return false;
+}
+
+RegexMatcher::RegexMatcher(const std::string &pattern, bool icase)
+{
+  for (const std::string &literal: required_literals(pattern))
+    m_required.emplace_back(literal, icase);
+  LOGDBG("filter " << pattern << " requires " << m_required.size()
+         << " literals");
+  std::shared_ptr<const program_t> forward =
+    compile_program(pattern, false, icase);
+  std::shared_ptr<const program_t> backward =
+    compile_program(pattern, true, icase);
+  if (forward && backward) {
+    m_forward.reset(new LazyDfa(forward, true));
+    // The automata of a pattern with empty loops only tell if a line matches
+    if (!forward->empty_loops)
+      m_backward.reset(new LazyDfa(backward, false));
+  }
+  if (!m_backward) {
+    LOGINF("filter " << pattern << " matched by std::regex");
+    m_regex = std::make_shared<const std::regex>(pattern,
+      icase ? std::regex::ECMAScript | std::regex::icase :
+              std::regex::ECMAScript);
+  }
+  // The anchors match at the beginning and end of the text, not of the lines
+  // of a block. The lookaheads of std::regex may look past the end of a line.
+  m_search_blocks =
+    !m_regex && pattern.find_first_of("^$") == std::string::npos;
+}
+
+RegexMatcher::RegexMatcher(const RegexMatcher &other) :
+  m_required(other.m_required), m_regex(other.m_regex),
+  m_search_blocks(other.m_search_blocks)
+{
+  if (other.m_forward) m_forward.reset(new LazyDfa(*other.m_forward));
+  if (other.m_backward) m_backward.reset(new LazyDfa(*other.m_backward));
+}
+
+std::shared_ptr<Matcher> RegexMatcher::clone() const {
+  return std::make_shared<RegexMatcher>(*this);
+}
+
+std::vector<std::string> RegexMatcher::required_literals(
+  const std::string &pattern)
+{
+  std::vector<std::string> literals;
+  size_t i = 0;
+  // A match of an alternation only contains the literals of one of its
+  // branches
+  if (!find_required_literals(pattern, i, literals) || i != pattern.size())
+    return std::vector<std::string>();
+  // The longest literals are the most selective, test them first
+  std::sort(literals.begin(), literals.end(),
+            [](const std::string &a, const std::string &b) {
+              return a.size() != b.size() ? a.size() > b.size() : a < b;
+            });
+  literals.erase(std::unique(literals.begin(), literals.end()),
+                 literals.end());
+  return literals;
+}
+
+bool RegexMatcher::search(const char *begin, const char *end, uint &start_pos,
+                          uint &end_pos) const {
+  // Not a virtual call, the lines are searched one by one
+  return RegexMatcher::search_from(begin, end, begin, start_pos, end_pos);
+}
+
+bool RegexMatcher::search_from(const char *begin, const char *end,
+                               const char *from, uint &start_pos,
+                               uint &end_pos) const {
+  // Reject the lines which cannot match without running the regex
+  for (const LiteralMatcher &literal: m_required)
+    if (!literal.search(from, end, start_pos, end_pos)) return false;
+  if (m_regex) {
+    std::cmatch matches;
+    if (!std::regex_search(from, end, matches, *m_regex,
+                           from == begin ?
+                           std::regex_constants::match_default :
+                           std::regex_constants::match_prev_avail))
+      return false;
+    start_pos = (from - begin) + matches.position();
+    end_pos = start_pos + matches.length();
+    return true;
+  }
+  size_t size = end - begin;
+  size_t match_start, match_end;
+  if (!m_forward->search_forward(begin, size, match_end, from - begin))
+    return false;
+  // The leftmost match begins where the earliest match ending at match_end
+  // begins
+  if (!m_backward->search_backward(begin, size, match_end, match_start,
+                                   from - begin))
+    return false;
+  start_pos = match_start;
+  end_pos = match_end;
+  return true;
+}
+
+bool RegexMatcher::matches(const char *begin, const char *end) const {
+  uint start_pos, end_pos;
+  for (const LiteralMatcher &literal: m_required)
+    if (!literal.search(begin, end, start_pos, end_pos)) return false;
+  if (!m_forward) return std::regex_search(begin, end, *m_regex);
+  size_t match_end;
+  return m_forward->search_forward(begin, end - begin, match_end);
+}
+
+LiteralMatcher::LiteralMatcher(const std::string &literal, bool icase,
+                               bool word) :
+  m_literal(literal), m_icase(icase), m_word(word)
+{
+  if (m_icase)
+    std::transform(m_literal.begin(), m_literal.end(), m_literal.begin(),
+                   to_lower);
+  m_probe = m_literal.empty() ? 0 : find_probe(m_literal, m_icase);
+}
+
+std::shared_ptr<Matcher> LiteralMatcher::clone() const {
+  return std::make_shared<LiteralMatcher>(*this);
+}
+
+bool LiteralMatcher::search(const char *begin, const char *end,
+                            uint &start_pos, uint &end_pos) const {
+  return LiteralMatcher::search_from(begin, end, begin, start_pos, end_pos);
+}
+
+bool LiteralMatcher::search_from(const char *begin, const char *end,
+                                 const char *from, uint &start_pos,
+                                 uint &end_pos) const {
+  size_t length = m_literal.size();
+  // The occurrences which are not words are skipped
+  for (; from <= end; ++from) {
+    size_t size = end - from;
+    const char *found;
+    // An empty pattern matches the empty string at the beginning of the line
+    if (length == 0) found = from;
+    else if (length > size) found = nullptr;
+    else if (m_icase)
+      found = find<true>(from, size, m_literal.data(), length, m_probe);
+    else if (length == 1)
+      found = (const char *) memchr(from, m_literal[0], size);
+    else found = find<false>(from, size, m_literal.data(), length, m_probe);
+    if (found == nullptr) return false;
+    if (!m_word || (is_boundary(begin, end, found) &&
+                    is_boundary(begin, end, found + length))) {
+      start_pos = found - begin;
+      end_pos = start_pos + length;
+      return true;
+    }
+    from = found;
+  }
+  return false;
+}
+
+bool LiteralMatcher::is_literal(const std::string &pattern,
+                                std::string &literal) {
+  literal.clear();
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    char c = pattern[i];
+    if (c == '\\') {
+      // Only an escaped metacharacter stands for itself, other escapes are
+      // character classes or control characters
+      if (++i == pattern.size() || pattern[i] == '\0' ||
+          !strchr(REGEX_METACHARACTERS, pattern[i]))
+        return false;
+      c = pattern[i];
+    } else if (c != '\0' && strchr(REGEX_METACHARACTERS, c)) {
+      return false;
+    }
+    literal.push_back(c);
+  }
+  return true;
+}
+
+MultiMatcher::MultiMatcher(
+  const std::vector<std::string> &patterns,
+  const std::vector< std::shared_ptr<Matcher> > &matchers) :
+  m_matchers(matchers), m_clones(matchers.size())
+{
+  std::vector<std::string> literals, regexes;
+  std::vector<int> literal_tags, regex_tags;
+  std::vector<bool> regex_icase;
+  std::string literal;
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    filter_flags_t flags = { false, false, false };
+    std::string pattern = Matcher::parse_flags(patterns[i], flags);
+    std::string regex = Matcher::to_regex(pattern, flags);
+    if (!flags.fixed && FilterPlan::is_expression(pattern)) {
+      m_others.push_back(i);
+    } else if (!flags.icase && get_literal(pattern, flags, literal)) {
+      literals.push_back(literal);
+      literal_tags.push_back(i);
+    } else if (compile_program(regex, false, flags.icase)) {
+      regexes.push_back(regex);
+      regex_tags.push_back(i);
+      regex_icase.push_back(flags.icase);
+    } else {
+      m_others.push_back(i);
+    }
+  }
+  if (!literals.empty()) {
+    if (AhoCorasick::fits(literals)) {
+      m_literals = std::make_shared<const AhoCorasick>(literals, literal_tags);
+    } else {
+      // Too large to be compiled together
+      m_others.insert(m_others.end(), literal_tags.begin(), literal_tags.end());
+    }
+  }
+  if (!regexes.empty()) {
+    std::shared_ptr<const program_t> program =
+      compile_program(regexes, regex_tags, regex_icase);
+    if (program) {
+      m_regexes.reset(new LazyDfa(program, false));
+    } else {
+      // Too large once combined
+      m_others.insert(m_others.end(), regex_tags.begin(), regex_tags.end());
+    }
+  }
+  LOGINF("filter set compiled: "
+         << (m_literals ? literals.size() : 0) << " literals in one automaton, "
+         << (m_regexes ? regexes.size() : 0) << " regexes in one DFA, "
+         << m_others.size() << " patterns searched one by one");
+}
+
+MultiMatcher::MultiMatcher(const MultiMatcher &other) :
+  m_literals(other.m_literals), m_others(other.m_others),
+  m_matchers(other.m_matchers), m_clones(other.m_matchers.size())
+{
+  if (other.m_regexes) m_regexes.reset(new LazyDfa(*other.m_regexes));
+}
+
+std::shared_ptr<MultiMatcher> MultiMatcher::clone() const {
+  return std::make_shared<MultiMatcher>(*this);
+}
+
+bool MultiMatcher::search(const char *begin, const char *end,
+                          tag_set_t &matched) const {
+  matched.clear();
+  matched.contains.resize(m_matchers.size(), false);
+  if (m_literals) m_literals->search(begin, end - begin, matched);
+  if (m_regexes) m_regexes->search_all(begin, end - begin, matched);
+  uint start_pos, end_pos;
+  for (int i: m_others) {
+    if (!m_clones[i]) m_clones[i] = m_matchers[i]->clone();
+    if (m_clones[i]->search(begin, end, start_pos, end_pos)) matched.insert(i);
+  }
+  return !matched.empty();
+}
+
+bool MultiMatcher::matches(const char *begin, const char *end) const {
+  return (*this).search(begin, end, m_matched);
+}
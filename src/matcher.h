@@ -0,0 +1,222 @@
+/*! \brief Matchers used by the filters
+ *
+ * A Matcher looks for a pattern in the lines of a buffer. Filters are compiled
+ * to the fastest matcher able to find their pattern.
+ */
+
+#ifndef __MATCHER_H__
+#define __MATCHER_H__
+
+#include <regex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "automaton.h"
+
+/*
+ * Options of a filter, set by a prefix of its pattern made of their letters,
+ * e.g. (?iw)error:
+ *   i  the ASCII letters match both cases (like grep -i)
+ *   f  the pattern is a fixed string, not a regex (like grep -F)
+ *   w  the matches begin and end at word boundaries (like grep -w)
+ * A regex cannot begin with such a prefix, there is no ambiguity.
+ */
+struct filter_flags_t {
+  bool  icase;
+  bool  fixed;
+  bool  word;
+};
+
+/*
+ * A compiled pattern. search() does not change the pattern but may update a
+ * cache which is not shared between threads: each thread searches with its own
+ * clone of the matcher.
+ */
+class Matcher {
+public:
+  virtual ~Matcher() {}
+  /*
+   * Look for the leftmost match of the pattern in [begin, end). If found, set
+   * start_pos and end_pos to the position of the match relative to begin and
+   * return true.
+   */
+  virtual bool search(const char *begin, const char *end, uint &start_pos,
+                      uint &end_pos) const = 0;
+  /*
+   * Like search(), for the leftmost match beginning at or after from. The
+   * text before from is the context of the assertions, e.g. '^' only matches
+   * at begin. Used to find all the occurrences of the pattern in a line.
+   */
+  virtual bool search_from(const char *begin, const char *end,
+                           const char *from, uint &start_pos,
+                           uint &end_pos) const = 0;
+  /*
+   * Return true if the pattern matches [begin, end). Cheaper than search() when
+   * the position of the match is not needed.
+   */
+  virtual bool matches(const char *begin, const char *end) const {
+    uint start_pos, end_pos;
+    return (*this).search(begin, end, start_pos, end_pos);
+  }
+  /*
+   * Return a matcher for the same pattern, to be used by another thread. The
+   * compiled pattern is shared, the caches are not.
+   */
+  virtual std::shared_ptr<Matcher> clone() const = 0;
+  /*
+   * Return true if a block of several lines can be searched at once: the
+   * leftmost match of a line is then also found in a block beginning with the
+   * line, at the same position. False for the patterns with anchors.
+   */
+  virtual bool can_search_blocks() const { return true; }
+  /*
+   * Compile a filter, with the flags of its prefix if any, to a FilterPlan if
+   * it is an expression, to a LiteralMatcher if it is a fixed string or
+   * contains no regex metacharacter, or to a RegexMatcher otherwise.
+   * Throws std::regex_error if the pattern is not a valid regex,
+   * std::invalid_argument if it is not a valid expression.
+   */
+  static std::shared_ptr<Matcher> compile(const std::string &filter);
+  static std::shared_ptr<Matcher> compile(const std::string &pattern,
+                                          const filter_flags_t &flags);
+  /*
+   * Set the flags of the prefixes of filter, leaving the others unchanged, and
+   * return the pattern following them. The prefixes end with the one setting
+   * the fixed flag, so format_flags(string, flags) gives string back whatever
+   * string is.
+   */
+  static std::string parse_flags(const std::string &filter,
+                                 filter_flags_t &flags);
+  /* Return pattern prefixed by its flags, if any is set */
+  static std::string format_flags(const std::string &pattern,
+                                  const filter_flags_t &flags);
+  /*
+   * Return the regex matching what pattern matches with flags, the case
+   * excepted
+   */
+  static std::string to_regex(const std::string &pattern,
+                              const filter_flags_t &flags);
+  /*
+   * Return true if the lines matched by pattern are known to be matched by
+   * previous too, e.g. when a literal is extended. The analysis is
+   * conservative and returns false when unsure.
+   */
+  static bool is_narrower(const std::string &pattern,
+                          const std::string &previous);
+};
+
+/*
+ * Matcher for plain strings. The candidate positions are found by comparing the
+ * first and last bytes of the string to 32 (AVX2) or 16 (SSE2) positions of the
+ * line at once, then verified. The leftmost occurrence is the match a regex
+ * would find, so the spans highlighted are the same.
+ */
+class LiteralMatcher : public Matcher {
+public:
+  /*
+   * If icase, the ASCII letters of literal match both cases. If word, only the
+   * occurrences beginning and ending at word boundaries match.
+   */
+  LiteralMatcher(const std::string &literal, bool icase = false,
+                 bool word = false);
+  bool search(const char *begin, const char *end, uint &start_pos,
+              uint &end_pos) const;
+  bool search_from(const char *begin, const char *end, const char *from,
+                   uint &start_pos, uint &end_pos) const;
+  std::shared_ptr<Matcher> clone() const;
+  /*
+   * If pattern only matches itself as a regex, possibly with escaped
+   * metacharacters, store the string it matches in literal and return true
+   */
+  static bool is_literal(const std::string &pattern, std::string &literal);
+private:
+  // In lower case if m_icase
+  std::string m_literal;
+  bool        m_icase;
+  bool        m_word;
+  // Position of the rare byte searched with the first one
+  size_t      m_probe;
+};
+
+/*
+ * Matcher for regular expressions (ECMAScript grammar).
+ * The pattern is analyzed to find the literal strings any match must contain.
+ * Lines not containing all of them are rejected by a literal search, so the
+ * regex engine only runs on the candidate lines.
+ * The regex is matched by a lazy DFA finding the end of the leftmost match,
+ * then by a lazy DFA of the reversed pattern scanning back from that end to
+ * find its beginning. Patterns the automata cannot match (back references,
+ * lookaheads) are left to std::regex. So are the positions of the matches of
+ * the patterns whose repetitions may iterate over the empty string.
+ */
+class RegexMatcher : public Matcher {
+public:
+  /* If icase, the ASCII letters of pattern match both cases */
+  RegexMatcher(const std::string &pattern, bool icase = false);
+  RegexMatcher(const RegexMatcher &other);
+  bool search(const char *begin, const char *end, uint &start_pos,
+              uint &end_pos) const;
+  bool search_from(const char *begin, const char *end, const char *from,
+                   uint &start_pos, uint &end_pos) const;
+  /* Only the forward DFA runs, the beginning of the match is not needed */
+  bool matches(const char *begin, const char *end) const;
+  std::shared_ptr<Matcher> clone() const;
+  inline bool can_search_blocks() const { return m_search_blocks; }
+  /*
+   * Return the literal strings any match of pattern must contain, longest
+   * first. The analysis is conservative: a pattern it does not understand
+   * yields fewer literals, or none.
+   */
+  static std::vector<std::string> required_literals(const std::string &pattern);
+private:
+  std::vector<LiteralMatcher>       m_required;
+  // The states of the DFAs are built while searching
+  std::unique_ptr<LazyDfa>          m_forward;
+  std::unique_ptr<LazyDfa>          m_backward;
+  // Only set if the automata cannot find the matches of the pattern
+  std::shared_ptr<const std::regex> m_regex;
+  bool                              m_search_blocks;
+};
+
+/*
+ * Matcher of a set of patterns, which finds which of them match a line in one
+ * pass over it instead of one pass per pattern. The literals are matched by an
+ * Aho-Corasick automaton and the regexes by a single lazy DFA of all of them.
+ * The patterns the automata cannot match are searched one by one.
+ * Like a Matcher, each thread searches with its own clone.
+ */
+class MultiMatcher {
+public:
+  /* matchers[i] is the matcher of patterns[i] */
+  MultiMatcher(const std::vector<std::string> &patterns,
+               const std::vector< std::shared_ptr<Matcher> > &matchers);
+  MultiMatcher(const MultiMatcher &other);
+  /*
+   * Set matched to the indexes of the patterns matching [begin, end). Returns
+   * true if any pattern matches.
+   */
+  bool search(const char *begin, const char *end, tag_set_t &matched) const;
+  /*
+   * Return true if any pattern matches [begin, end), like search(). The
+   * patterns matching are then given by get_last_matched().
+   */
+  bool matches(const char *begin, const char *end) const;
+  /* Indexes of the patterns found by the last call to matches */
+  inline const tag_set_t &get_last_matched() const { return m_matched; }
+  std::shared_ptr<MultiMatcher> clone() const;
+  inline size_t get_number_of_patterns() const { return m_matchers.size(); }
+
+private:
+  std::shared_ptr<const AhoCorasick>              m_literals;
+  std::unique_ptr<LazyDfa>                        m_regexes;
+  // Patterns searched one by one, by index
+  std::vector<int>                                m_others;
+  std::vector< std::shared_ptr<Matcher> >         m_matchers;
+  // Clones of m_matchers, made when a pattern is searched one by one
+  mutable std::vector< std::shared_ptr<Matcher> > m_clones;
+  mutable tag_set_t                               m_matched;
+};
+
+#endif // __MATCHER_H__
@@ -0,0 +1,46 @@
+#include "logmacros.h"
+#include "matcher_cache.h"
+
+MatcherCache::MatcherCache(size_t capacity) : m_matchers(capacity),
+  m_multi(MATCHER_CACHE_MULTI_SIZE)
+{
+}
+
+std::shared_ptr<Matcher> MatcherCache::get(const std::string &pattern) {
+  std::shared_ptr<Matcher> matcher;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_matchers.find(pattern, matcher)) return matcher;
+  }
+  // The invalid patterns are cached too, as null
+  try {
+    matcher = Matcher::compile(pattern);
+  } catch (const std::exception &e) {
+    LOGERR("invalid filter " << pattern << ": " << e.what());
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // Another thread may have compiled the same pattern meanwhile
+  m_matchers.insert(pattern, matcher);
+  return matcher;
+}
+
+std::shared_ptr<MultiMatcher> MatcherCache::get(
+  const std::vector<std::string> &patterns) {
+  // A pattern is a line of text, the set is keyed by its lines
+  std::string key;
+  for (const auto &pattern: patterns) key += pattern + '\n';
+  std::shared_ptr<MultiMatcher> multi_matcher;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_multi.find(key, multi_matcher)) return multi_matcher;
+  }
+  std::vector< std::shared_ptr<Matcher> > matchers;
+  for (const auto &pattern: patterns) {
+    matchers.push_back((*this).get(pattern));
+    if (!matchers.back()) return nullptr;
+  }
+  multi_matcher = std::make_shared<MultiMatcher>(patterns, matchers);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_multi.insert(key, multi_matcher);
+  return multi_matcher;
+}
@@ -0,0 +1,80 @@
+/*! \brief Cache of the compiled matchers
+ *
+ * Compiling a pattern, e.g. a large alternation, takes time. The matchers
+ * compiled recently are kept by pattern, the prefix of its options included, so
+ * a pattern typed again, or used by another buffer, is not compiled again. So
+ * are the patterns ORed, compiled together.
+ */
+
+#ifndef __MATCHER_CACHE_H__
+#define __MATCHER_CACHE_H__
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#include "matcher.h"
+
+// Number of patterns kept in the cache
+#define MATCHER_CACHE_SIZE 256
+// Number of sets of patterns compiled together kept in the cache
+#define MATCHER_CACHE_MULTI_SIZE 16
+
+/*
+ * A least recently used cache of the matchers, shared by the buffers. The
+ * matchers are compiled outside of the lock of the cache, by the thread asking
+ * for them.
+ */
+class MatcherCache {
+public:
+  MatcherCache(size_t capacity = MATCHER_CACHE_SIZE);
+  /*
+   * Return the matcher of pattern, compiled if it is not in the cache. Returns
+   * null if pattern is not a valid regex or expression.
+   */
+  std::shared_ptr<Matcher> get(const std::string &pattern);
+  /*
+   * Return the patterns compiled together, if they were not recently. Returns
+   * null if any pattern is not valid.
+   */
+  std::shared_ptr<MultiMatcher> get(const std::vector<std::string> &patterns);
+private:
+  /* Values by key, the most recently used first */
+  template <typename T>
+  struct lru_t {
+    typedef std::pair<std::string, std::shared_ptr<T> > entry_t;
+    std::list<entry_t>                                                entries;
+    std::unordered_map<std::string,
+                       typename std::list<entry_t>::iterator>         index;
+    size_t                                                            capacity;
+
+    lru_t(size_t c) : capacity(c) {}
+    /* Set value to the value of key, if found. The null values are found. */
+    bool find(const std::string &key, std::shared_ptr<T> &value) {
+      auto it = index.find(key);
+      if (it == index.end()) return false;
+      entries.splice(entries.begin(), entries, it->second);
+      value = it->second->second;
+      return true;
+    }
+    /* Add the value of key, unless another thread added it meanwhile */
+    void insert(const std::string &key, std::shared_ptr<T> value) {
+      if (index.find(key) != index.end()) return;
+      entries.emplace_front(key, value);
+      index[key] = entries.begin();
+      if (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+      }
+    }
+  };
+  lru_t<Matcher>                                                    m_matchers;
+  lru_t<MultiMatcher>                                               m_multi;
+  std::mutex                                                        m_mutex;
+};
+
+#endif // __MATCHER_CACHE_H__
@@ -1,173 +1,763 @@
 #include <ncurses.h>
 #include <map>
 #include <cmath>
-#include <regex>
+#include <chrono>
+#include <limits>
+#include <climits>
 #include <tuple>
 #include <utility>
+#include <algorithm>
 #include "logmacros.h"
 #include "processor.h"
 #include "buffer_model.h"
 
-FilterEngine::FilterEngine(BufferModel &buffer_model) :
+// Number of lines of the first shard of a filtering
+#define FILTER_FIRST_SHARD_SIZE 1024
+// The size of the shards doubles up to this number of lines
+#define FILTER_MAX_SHARD_SIZE (64 * 1024)
+// Number of shards dispatched per worker in advance
+#define FILTER_SHARDS_PER_WORKER 2
+// Memory used by the bitmaps of the lines matched by the filters
+#define FILTER_BITMAPS_MEMORY_BUDGET (64 * 1024 * 1024)
+// Maximum number of lines searched at once, between two checks that the
+// filters did not change
+#define FILTER_BLOCK_LINES 4096
+// Signals closer than this are a burst, filtered once it is over
+#define FILTER_DEBOUNCE_MS 30
+
+WorkerPool::WorkerPool(unsigned nb_workers) : m_stopped(false) {
+  if (nb_workers == 0)
+    nb_workers = std::max(1u, std::thread::hardware_concurrency());
+  m_running.resize(nb_workers, nullptr);
+  for (unsigned i = 0; i < nb_workers; ++i)
+    m_workers.emplace_back(&WorkerPool::work, this, i);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopped = true;
+    m_tasks.clear();
+  }
+  m_signal.notify_all();
+  for (auto &worker: m_workers) worker.join();
+}
+
+void WorkerPool::submit(std::function<void(unsigned)> task,
+                        const void *owner) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.emplace_back(owner, std::move(task));
+  }
+  m_signal.notify_one();
+}
+
+void WorkerPool::drop(const void *owner) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_tasks.erase(std::remove_if(m_tasks.begin(), m_tasks.end(),
+                               [owner](const task_t &task) {
+                                 return task.first == owner;
+                               }),
+                m_tasks.end());
+  while (std::find(m_running.begin(), m_running.end(), owner) !=
+         m_running.end())
+    m_done.wait(lock);
+}
+
+void WorkerPool::work(unsigned worker) {
+  while (true) {
+    task_t task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stopped && m_tasks.empty()) m_signal.wait(lock);
+      if (m_stopped) return;
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+      m_running[worker] = task.first;
+    }
+    task.second(worker);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_running[worker] = nullptr;
+    }
+    m_done.notify_all();
+  }
+}
+
+FilterEngine::FilterEngine(BufferModel &buffer_model,
+                           std::shared_ptr<WorkerPool> workers) :
   ProcessorThread(std::bind(&FilterEngine::filter, this)),
-  m_buffer_model(buffer_model)
+  m_buffer_model(buffer_model),
+  m_filter_set(std::make_shared<filter_set_t>()),
+  m_generation(0), m_filtered_generation(0), m_last_signal(0),
+  m_previous_signal(0), m_scan_order(scan_order_e::VIEWPORT_FIRST),
+  m_origin(0), m_low(0), m_high(0), m_down(0), m_up(0),
+  m_candidates(std::make_shared<std::vector<lineno_t> >()),
+  m_next_candidate(0), m_candidates_matched(false),
+  m_shard_size(FILTER_FIRST_SHARD_SIZE),
+  m_bitmap_clock(0),
+  m_workers(workers ? workers : std::make_shared<WorkerPool>())
 {
-  // Initialize the filter list
-  m_buffer_model.retrieve_filter_set(m_filter_set);
+  // The filter list is retrieved by rearm: the BufferModel, and the mutex
+  // protecting its filter set, are not fully constructed yet
+  m_worker_filters.resize(m_workers->get_number_of_workers());
+}
+
+FilterEngine::~FilterEngine() {
+  // No shard is dispatched anymore once the thread is stopped. The shards of
+  // the engine still queued in a shared pool are dropped, and the ones being
+  // filtered finished, before the engine is gone.
+  (*this).join();
+  ++m_generation;
+  m_workers->drop(this);
 }
 
 /*
  * Match a line of text versus a set of provided filters
  */
-bool FilterEngine::match(const char *line,
-                         const filter_set_t &filter_set,
-                         std::cmatch &matches) {
-  bool match = false;
-  if (filter_set.land) {
-    // If we want to AND the results
-    for (const auto &re: filter_set.filters) {
-      // If just one regex does not match, exit
-      if (!(match = std::regex_search(line, matches, re.second)))
-        return false;
+bool FilterEngine::match(const line_t &line,
+                         const filter_set_t &filter_set) {
+  // All the filters are searched in one pass
+  if (!filter_set.land && filter_set.multi_matcher)
+    return filter_set.multi_matcher->matches(line.text,
+                                             line.text + line.length);
+  // The filters ANDed are evaluated cheapest first
+  if (filter_set.plan)
+    return filter_set.plan->matches(line.text, line.text + line.length);
+  return !filter_set.filters.empty() &&
+    filter_set.filters.front().second->matches(line.text,
+                                               line.text + line.length);
+}
+
+bool FilterEngine::match_all(
+  const line_t &line, lineno_t line_index, const filter_set_t &filter_set,
+  std::vector< std::vector<lineno_t> > &filter_matches) {
+  if (!filter_set.land && filter_set.multi_matcher) {
+    if (!filter_set.multi_matcher->matches(line.text,
+                                           line.text + line.length))
+      return false;
+    for (int i: filter_set.multi_matcher->get_last_matched().tags)
+      filter_matches[i].push_back(line_index);
+    return true;
+  }
+  bool any = false;
+  bool all = true;
+  size_t i = 0;
+  for (const auto &re: filter_set.filters) {
+    if (re.second->matches(line.text, line.text + line.length)) {
+      filter_matches[i].push_back(line_index);
+      any = true;
+    } else {
+      all = false;
     }
-  } else {
-    // If we want to OR the results
-    for (const auto &re: filter_set.filters) {
-      // If just one regex does match, exit
-      if ((match = std::regex_search(line, matches, re.second)))
-        return true;
+    ++i;
+  }
+  return filter_set.land ? all : any;
+}
+
+void FilterEngine::search_lines(const Matcher &matcher, const IBuffer &buffer,
+                                const shard_t &shard,
+                                std::vector<lineno_t> &matches) {
+  uint start_pos, end_pos;
+  lineno_t line = shard.begin;
+  // The positions of the matches in a block must fit in an uint
+  bool blocks = matcher.can_search_blocks();
+  while (blocks && line < shard.end) {
+    if (shard.is_cancelled()) return;
+    lineno_t block_end = std::min(line + FILTER_BLOCK_LINES, shard.end);
+    line_t block = buffer.get_block(line, block_end);
+    if (block.text == nullptr || block.length > UINT_MAX) break;
+    if (!matcher.search(block.text, block.text + block.length, start_pos,
+                        end_pos)) {
+      line = block_end;
+      continue;
+    }
+    // The match is in the last line beginning before it, which is looked for
+    // close to the current line first
+    const char *found = block.text + start_pos;
+    lineno_t low = line;
+    lineno_t high = block_end - 1;
+    for (lineno_t step = 1; low + step <= high; step *= 2) {
+      if (buffer.get_line(low + step).text > found) {
+        high = low + step - 1;
+        break;
+      }
+      low += step;
     }
+    while (low < high) {
+      lineno_t middle = low + (high - low + 1) / 2;
+      if (buffer.get_line(middle).text <= found) low = middle;
+      else high = middle - 1;
+    }
+    line_t text = buffer.get_line(low);
+    uint position = found - text.text;
+    uint length = end_pos - start_pos;
+    line = low;
+    // A match spanning several lines is not a match of its first line. Such a
+    // pattern would make every search of a block scan far, the lines are
+    // searched one by one instead.
+    if (position + length > text.length) break;
+    matches.push_back(line++);
+  }
+  for (; line < shard.end; ++line) {
+    if (shard.is_cancelled()) return;
+    line_t text = buffer.get_line(line);
+    if (matcher.matches(text.text, text.text + text.length))
+      matches.push_back(line);
+  }
+}
+
+bool FilterEngine::filter_blocks(shard_t &shard,
+                                 const filter_set_t &filter_set,
+                                 const IBuffer &buffer) {
+  if (shard.lines || filter_set.filters.empty() ||
+      (filter_set.filters.size() > 1 && !filter_set.land) ||
+      buffer.get_block(shard.begin, shard.end).text == nullptr)
+    return false;
+  if (shard.filter_matches.empty()) {
+    // Every line matching the set matches each filter. The first filter
+    // searchable in blocks, in the order of the plan, is searched and the set
+    // is only matched against its lines.
+    std::vector<const Matcher *> filters;
+    for (const auto &filter: filter_set.filters)
+      filters.push_back(filter.second.get());
+    std::vector<size_t> order =
+      filter_set.plan ? filter_set.plan->get_order() : std::vector<size_t>(1);
+    const Matcher *driver = nullptr;
+    for (size_t i: order) {
+      if (filters[i]->can_search_blocks()) {
+        driver = filters[i];
+        break;
+      }
+    }
+    if (!driver) return false;
+    if (filters.size() == 1) {
+      search_lines(*driver, buffer, shard, shard.matches);
+      return true;
+    }
+    std::vector<lineno_t> candidates;
+    search_lines(*driver, buffer, shard, candidates);
+    for (lineno_t candidate: candidates)
+      if (match(buffer.get_line(candidate), filter_set))
+        shard.matches.push_back(candidate);
+    return true;
+  }
+  // The lines matching each filter are recorded, every filter is searched
+  std::vector< std::vector<lineno_t> > &filter_matches = shard.filter_matches;
+  auto lines = filter_matches.begin();
+  for (const auto &filter: filter_set.filters)
+    search_lines(*filter.second, buffer, shard, *lines++);
+  // The lines matching all the filters
+  std::vector<size_t> next(filter_matches.size(), 0);
+  for (lineno_t line: filter_matches.back()) {
+    bool all = true;
+    for (size_t i = 0; all && i + 1 < filter_matches.size(); ++i) {
+      const std::vector<lineno_t> &matches = filter_matches[i];
+      while (next[i] < matches.size() && matches[next[i]] < line) ++next[i];
+      all = next[i] < matches.size() && matches[next[i]] == line;
+    }
+    if (all) shard.matches.push_back(line);
+  }
+  return true;
+}
+
+void FilterEngine::clone_filters(const filter_set_t &filter_set,
+                                 filter_set_t &clone) {
+  clone = filter_set;
+  if (clone.multi_matcher)
+    clone.multi_matcher = clone.multi_matcher->clone();
+  if (clone.plan)
+    clone.plan = std::static_pointer_cast<FilterPlan>(clone.plan->clone());
+  if (!clone.multi_matcher)
+    for (auto &filter: clone.filters)
+      filter.second = filter.second->clone();
+}
+
+/*
+ * Filter the lines of a shard and store the matches in the shard
+ */
+void FilterEngine::filter_shard(
+  shard_t &shard, std::shared_ptr<const filter_set_t> shared_filter_set,
+  worker_filters_t &worker_filters, const IBuffer &buffer) {
+  // The lines computed from the bitmaps are known to match
+  if (shard.matched) {
+    shard.matches.assign(shard.lines->begin() + shard.begin,
+                         shard.lines->begin() + shard.end);
+    shard.done.store(true, std::memory_order_release);
+    return;
+  }
+  // The matchers build their automata while searching, each worker uses its
+  // own copy of them, made once per filtering
+  filter_set_t &filter_set = worker_filters.filter_set;
+  if (worker_filters.source != shared_filter_set) {
+    worker_filters.source = shared_filter_set;
+    clone_filters(*shared_filter_set, filter_set);
+  }
+  if (filter_blocks(shard, filter_set, buffer)) {
+    shard.done.store(true, std::memory_order_release);
+    return;
   }
-  return match;
+  for (lineno_t i = shard.begin; i < shard.end; ++i) {
+    if (shard.is_cancelled()) break;
+    lineno_t line = shard.lines ? (*shard.lines)[i] : i;
+    bool matched = shard.filter_matches.empty() ?
+      match(buffer.get_line(line), filter_set) :
+      match_all(buffer.get_line(line), line, filter_set, shard.filter_matches);
+    if (matched) shard.matches.push_back(line);
+  }
+  shard.done.store(true, std::memory_order_release);
 }
 
 /*
- * Main function of the filtering thread. Will wait for an input and go through
- * buffer to match against the provided filters.
+ * Main function of the filtering thread. Will wait for an input and dispatch
+ * the buffer to the workers to match it against the provided filters, then
+ * merge their results.
  * Once the buffer has been filtered, it will wait for another input until it is
  * interrupted.
  */
 void FilterEngine::filter() {
-  std::list<std::regex> regexes;
-  // Erase the content of the model first
-  m_buffer_model.clear_filtered_line();
-  // Retrieve the content of the file buffer
-  char * const *file_text = m_buffer_model.get_file_buffer()->get_text();
-  // Position the current character string to be added
-  uint current_buffer_line = 0;
-  // Last index of the filtered line
-  uint current_filtered_line = 0;
-  // Get number of line in file
-  uint number_of_line_in_file =
-    m_buffer_model.get_file_buffer()->get_number_of_line();
-  // Reset the signal set on the first start
-  (*this).reset_signal(); // reset it to false
-  // Will hold the result of the match which will be converted to attributes
-  std::cmatch matches;
+  // Retrieve the file buffer
+  std::shared_ptr<IBuffer> file_buffer = m_buffer_model.get_file_buffer();
+  // Get number of line in file. It grows while the file is being loaded.
+  lineno_t number_of_line_in_file = file_buffer->get_number_of_line();
+  size_t max_shards =
+    FILTER_SHARDS_PER_WORKER * m_workers->get_number_of_workers();
+  // The signal set on the first start, or by a filter added before the thread
+  // started, is consumed by the first rearm
+  // Are we scanning the file buffer
+  ScanGuard scan(m_buffer_model);
   // As long as we are not interrupted
   while (!m_interrupted) {
     // If no filter has been set or we are done with our analysis then we wait.
-    while ((m_buffer_model.get_filter_set().filters.empty() ||
-            current_buffer_line >= number_of_line_in_file)
+    while ((m_filter_set->filters.empty() ||
+            (m_up >= number_of_line_in_file && m_down == 0 &&
+             m_next_candidate >= m_candidates->size() &&
+             m_up_shards.empty() && m_down_shards.empty()))
            && !m_interrupted) // if we are interrupted, we stop waiting
     {
+      scan.end();
+      // Show the result even if no line matched
+      m_buffer_model.publish_filtered_buffer();
+      m_buffer_model.set_filter_processing_progress(100);
+      // The last changes are notified right away
+      m_buffer_model.notify_filtering(true);
       LOGDBG_("filtering paused");
       (*this).wait(); // Wait until someone signals us
       LOGDBG_("filtering started, signal: " << m_signaled);
       // Have we been interrupted ?
       if (m_interrupted) return;
-      // This instruction might seem strange but we need to get out of the loop
-      // by resetting the line pointer...
-      if (m_signaled) { current_buffer_line = 0; current_filtered_line = 0; }
+      // The filters changed, start over. The signal is consumed here as a
+      // pending signal would not let us wait anymore.
+      if (m_signaled) (*this).rearm();
+      // We might have been woken up because more lines were loaded
+      number_of_line_in_file = file_buffer->get_number_of_line();
     }
     // m_signaled will be set to true if someone changed the filters or on the
     // first loop (set in ProcessorThread::start)
-    if (m_signaled) { (*this).rearm(current_buffer_line,
-                                    current_filtered_line); }
+    if (m_signaled) (*this).rearm();
+    // The filters might have been removed meanwhile
+    if (m_filter_set->filters.empty()) continue;
+    scan.begin();
     // Have we been interrupted ?
     if (m_interrupted) return;
-    // Does the current line match the filter set
-    if (match(file_text[current_buffer_line], m_filter_set, matches)) {
-      // Yes, add it to the model
-      LOGDBG_("line " << current_buffer_line << " matches");
-      m_buffer_model.add_match(file_text[current_buffer_line],
-                               current_filtered_line,
-                               matches.position(),
-                               matches.position() + matches.length());
-      ++current_filtered_line;
-    }
-    // Look at the next line
-    ++current_buffer_line;
-    // Compute the progress as percentage of the total number of lines
-    uint progress = (float) current_buffer_line /
-      (float) number_of_line_in_file * 100;
-    if (progress % 5 == 0 &&
-        progress != m_buffer_model.get_filter_processing_progress())
-      m_buffer_model.set_filter_processing_progress().update() = progress;
-  }
-}
-
-void FilterEngine::rearm(uint &current_buffer_line,
-                         uint &current_filtered_line) {
+    // Keep the workers busy, with the lines matched by the previous filters
+    // first, then the lines closest to the origin
+    while (m_up_shards.size() + m_down_shards.size() < max_shards) {
+      std::shared_ptr<shard_t> shard;
+      bool up = m_next_candidate < m_candidates->size() ||
+        m_up < number_of_line_in_file;
+      bool down = m_down > 0;
+      // The side closest to the origin goes first. With the tail first, the
+      // lines appended meanwhile are the closest.
+      if (up && down && m_next_candidate >= m_candidates->size())
+        up = (m_up > m_origin ? m_up - m_origin : 0) <=
+          (m_origin > m_down ? m_origin - m_down : 0);
+      if (up && m_next_candidate < m_candidates->size()) {
+        shard = std::make_shared<shard_t>(
+          m_next_candidate,
+          std::min(m_next_candidate + m_shard_size,
+                   (lineno_t) m_candidates->size()));
+        shard->lines = m_candidates;
+        shard->matched = m_candidates_matched;
+        // The lines not matched by the previous filters are skipped
+        shard->merged_line = (shard->end < m_candidates->size()) ?
+          (*m_candidates)[shard->end] : m_up;
+        m_next_candidate = shard->end;
+        m_up_shards.push_back(shard);
+      } else if (up) {
+        shard = std::make_shared<shard_t>(
+          m_up, std::min(m_up + m_shard_size, number_of_line_in_file));
+        m_up = shard->end;
+        m_up_shards.push_back(shard);
+      } else if (down) {
+        shard = std::make_shared<shard_t>(
+          m_down > m_shard_size ? m_down - m_shard_size : 0, m_down);
+        m_down = shard->begin;
+        m_down_shards.push_back(shard);
+      } else {
+        break;
+      }
+      // The matches of the filters are recorded when the lines are filtered
+      // for the first time
+      if (!shard->lines && !m_recorded.empty())
+        shard->filter_matches.resize(m_filter_set->filters.size());
+      (*this).dispatch(shard, file_buffer);
+      m_shard_size =
+        std::min(m_shard_size * 2, (lineno_t) FILTER_MAX_SHARD_SIZE);
+    }
+    // Merge the shards done, in line order on each side of the filtered lines.
+    // The shards abandoned because the filters changed are not.
+    bool merged = false;
+    while (m_generation.load() == m_filtered_generation &&
+           !m_up_shards.empty() &&
+           m_up_shards.front()->done.load(std::memory_order_acquire)) {
+      LOGDBG_("shard " << m_up_shards.front()->begin << " merged");
+      m_buffer_model.add_filtered_lines(m_up_shards.front()->matches,
+                                        m_origin);
+      (*this).record(*m_up_shards.front());
+      m_high = m_up_shards.front()->merged_line;
+      m_up_shards.pop_front();
+      merged = true;
+    }
+    while (m_generation.load() == m_filtered_generation &&
+           !m_down_shards.empty() &&
+           m_down_shards.front()->done.load(std::memory_order_acquire)) {
+      LOGDBG_("shard " << m_down_shards.front()->begin << " merged in front");
+      m_buffer_model.add_filtered_lines_front(m_down_shards.front()->matches);
+      (*this).record(*m_down_shards.front());
+      m_low = m_down_shards.front()->begin;
+      m_down_shards.pop_front();
+      merged = true;
+    }
+    if (merged) {
+      // Compute the progress as percentage of the total number of lines
+      uint progress = (float) (m_high - m_low) /
+        (float) number_of_line_in_file * 100;
+      m_buffer_model.set_filter_processing_progress(progress);
+    }
+    // The view is notified of the changes at most once per frame
+    std::chrono::milliseconds delay = m_buffer_model.notify_filtering(false);
+    if (!merged) {
+      // Wait for a worker to finish, more lines or new filters, or until the
+      // changes are notified
+      if (delay.count() > 0) (*this).wait_for(delay);
+      else (*this).wait();
+    }
+    // More lines might have been loaded
+    number_of_line_in_file = file_buffer->get_number_of_line();
+  }
+}
+
+void FilterEngine::dispatch(std::shared_ptr<shard_t> shard,
+                            std::shared_ptr<IBuffer> file_buffer) {
+  std::shared_ptr<const filter_set_t> filter_set = m_filter_set;
+  shard->generation = m_filtered_generation;
+  shard->current_generation = &m_generation;
+  m_workers->submit([this, shard, filter_set, file_buffer](unsigned worker) {
+    filter_shard(*shard, filter_set, m_worker_filters[worker], *file_buffer);
+    // Let the filtering thread merge the result
+    (*this).wake_up();
+  }, this);
+}
+
+void FilterEngine::signal() {
+  int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+  m_previous_signal = m_last_signal.exchange(now);
+  // The workers compare the generation of their shard to this one
+  ++m_generation;
+  ProcessorThread::signal();
+}
+
+void FilterEngine::debounce() {
+  typedef std::chrono::steady_clock clock;
+  clock::duration delay = std::chrono::milliseconds(FILTER_DEBOUNCE_MS);
+  if (clock::duration(m_last_signal - m_previous_signal) >= delay) return;
+  while (!m_interrupted) {
+    clock::duration quiet = clock::now().time_since_epoch() -
+      clock::duration(m_last_signal);
+    if (quiet >= delay) break;
+    std::this_thread::sleep_for(delay - quiet);
+  }
+}
+
+void FilterEngine::rearm() {
+  (*this).debounce();
   (*this).reset_signal(); // reset it to false
-  // Clear the attributes first
-  m_buffer_model.clear_attrs();
-  // Clear the model buffer
-  LOGDBG_("clear filtered lined");
-  m_buffer_model.clear_filtered_line();
-  // Position the current character string to be added
-  current_buffer_line = 0;
-  current_filtered_line = 0;
-  // Retrieve the filter list from the buffer.
-  m_buffer_model.retrieve_filter_set(m_filter_set);
-  LOGDBG_("retrieved filter: " << m_filter_set);
-}
-
-FilteredBuffer::FilteredBuffer(std::shared_ptr<IBuffer> &buffer) {
-  // Initialize the pointers to the filtered lines
-  m_original_number_of_line = buffer->get_number_of_line();
-  m_filtered_lines = new char*[m_original_number_of_line];
-  memset(m_filtered_lines, 0, m_original_number_of_line * sizeof (char));
-  number_of_filtered_line = 0;
-  // Initialize attrs array
-  m_attrs = new tattr_t[m_original_number_of_line * sizeof (tattr_t)];
-  (*this).clear_attrs();
+  // The shards being filtered with the previous filters were abandoned when
+  // the filters changed
+  m_up_shards.clear();
+  m_down_shards.clear();
+  m_filtered_generation = m_generation;
+  m_buffer_model.set_filter_processing_progress(0);
+  // Retrieve the filter list from the buffer. The previous one might still be
+  // used by the workers.
+  std::shared_ptr<const filter_set_t> previous = m_filter_set;
+  m_filter_set = std::make_shared<filter_set_t>();
+  m_buffer_model.retrieve_filter_set(*m_filter_set);
+  LOGDBG_("retrieved filter: " << *m_filter_set);
+  // Compile the filters, unless they were compiled recently. The invalid ones
+  // are ignored.
+  std::shared_ptr<MatcherCache> matcher_cache =
+    m_buffer_model.get_matcher_cache();
+  for (auto filter = m_filter_set->filters.begin();
+       filter != m_filter_set->filters.end();) {
+    filter->second = matcher_cache->get(filter->first);
+    if (filter->second) ++filter;
+    else filter = m_filter_set->filters.erase(filter);
+  }
+  std::vector< std::shared_ptr<Matcher> > matchers;
+  for (const auto &filter: m_filter_set->filters)
+    matchers.push_back(filter.second);
+  // The lines are filtered outward from the origin
+  switch (m_scan_order) {
+  case scan_order_e::FORWARD:
+    m_origin = 0;
+    break;
+  case scan_order_e::VIEWPORT_FIRST:
+    m_origin = m_buffer_model.get_file_line_displayed();
+    break;
+  case scan_order_e::TAIL_FIRST:
+    m_origin = m_buffer_model.get_file_buffer()->get_number_of_line();
+    break;
+  }
+  // The lines filtered with the previous filters and not matched cannot match
+  // narrower ones, only the lines matched are filtered again. The other lines
+  // are filtered from there.
+  std::shared_ptr<std::vector<lineno_t> > candidates =
+    std::make_shared<std::vector<lineno_t> >();
+  m_candidates_matched = (*this).combine_bitmaps(*candidates, m_down, m_up);
+  if (m_candidates_matched) {
+    LOGDBG_("filters computed from the bitmaps, " << candidates->size()
+            << " lines out of " << m_up - m_down << " matched");
+  } else if (is_narrower(*m_filter_set, *previous)) {
+    m_buffer_model.get_filtered_lines(*candidates);
+    m_down = m_low;
+    m_up = m_high;
+    LOGDBG_("filters narrowed, " << candidates->size() << " lines out of "
+            << m_up - m_down << " filtered again");
+  } else {
+    m_down = m_up = m_origin;
+  }
+  m_low = m_high = m_down;
+  m_candidates = candidates;
+  m_next_candidate = 0;
+  // The bitmaps of the filters are extended on each side of the lines
+  // filtered, or made again if the whole buffer is filtered. Recording them
+  // searches every filter in every line. Several filters ANDed are only
+  // recorded if each one can be searched in blocks, which costs about as much
+  // as the plan: line by line, it stops at the first filter not matching.
+  m_recorded.clear();
+  bool recording = false;
+  bool recordable = true;
+  if (m_filter_set->land && m_filter_set->filters.size() > 1)
+    for (const auto &filter: m_filter_set->filters)
+      recordable = recordable && filter.second->can_search_blocks();
+  for (const auto &filter: m_filter_set->filters) {
+    if (!recordable) break;
+    std::shared_ptr<bitmap_t> &bitmap = m_bitmaps[filter.first];
+    if (m_down == m_up &&
+        (!bitmap || (bitmap->end != m_up && bitmap->begin != m_down)))
+      bitmap = std::make_shared<bitmap_t>(m_up);
+    if (!bitmap) {
+      m_bitmaps.erase(filter.first);
+      m_recorded.emplace_back();
+      continue;
+    }
+    bitmap->last_used = ++m_bitmap_clock;
+    if (bitmap->end == m_up || bitmap->begin == m_down) {
+      m_recorded.push_back(bitmap);
+      recording = true;
+    } else {
+      m_recorded.emplace_back();
+    }
+  }
+  if (!recording) m_recorded.clear();
+  // A new filtering starts with small shards
+  m_shard_size = FILTER_FIRST_SHARD_SIZE;
+  // The lines are filtered into a new buffer, the view keeps displaying the
+  // previous one, highlighted with the previous filters, until the first lines
+  // are merged
+  m_buffer_model.new_filtered_buffer(matchers);
+  // Several filters ORed are compiled together, unless they were recently
+  if (!m_filter_set->land && m_filter_set->filters.size() > 1) {
+    std::vector<std::string> patterns;
+    for (const auto &filter: m_filter_set->filters)
+      patterns.push_back(filter.first);
+    m_filter_set->multi_matcher = matcher_cache->get(patterns);
+  }
+  // Several filters ANDed are evaluated in the order found the cheapest
+  if (m_filter_set->land && m_filter_set->filters.size() > 1)
+    m_filter_set->plan = std::make_shared<FilterPlan>(matchers, true);
+}
+
+bool FilterEngine::combine_bitmaps(std::vector<lineno_t> &lines,
+                                   lineno_t &begin, lineno_t &end) const {
+  if (m_filter_set->filters.empty()) return false;
+  std::vector<const bitmap_t *> bitmaps;
+  begin = 0;
+  end = std::numeric_limits<lineno_t>::max();
+  for (const auto &filter: m_filter_set->filters) {
+    auto it = m_bitmaps.find(filter.first);
+    if (it == m_bitmaps.end()) return false;
+    bitmaps.push_back(it->second.get());
+    begin = std::max(begin, it->second->begin);
+    end = std::min(end, it->second->end);
+  }
+  if (begin >= end) return false;
+  LineBitmap result = bitmaps[0]->lines;
+  for (size_t i = 1; i < bitmaps.size(); ++i) {
+    if (m_filter_set->land)
+      result.intersect(bitmaps[i]->lines);
+    else
+      result.unite(bitmaps[i]->lines);
+  }
+  result.get_lines(lines, begin, end);
+  return true;
+}
+
+void FilterEngine::record(const shard_t &shard) {
+  if (shard.filter_matches.empty()) return;
+  for (size_t i = 0; i < m_recorded.size(); ++i) {
+    // The shards are merged in order on each side, the bitmap is extended
+    // unless the previous shard on that side was not recorded
+    bitmap_t *bitmap = m_recorded[i].get();
+    if (bitmap == nullptr) continue;
+    if (bitmap->end == shard.begin) {
+      for (lineno_t line: shard.filter_matches[i]) bitmap->lines.append(line);
+      bitmap->end = shard.end;
+    } else if (bitmap->begin == shard.end) {
+      LineBitmap lines;
+      for (lineno_t line: shard.filter_matches[i]) lines.append(line);
+      bitmap->lines.prepend(lines);
+      bitmap->begin = shard.begin;
+    }
+  }
+  (*this).evict_bitmaps();
+}
+
+void FilterEngine::evict_bitmaps() {
+  size_t memory_size = 0;
+  for (const auto &bitmap: m_bitmaps)
+    memory_size += bitmap.second->lines.memory_size();
+  while (memory_size > FILTER_BITMAPS_MEMORY_BUDGET) {
+    auto lru = m_bitmaps.begin();
+    for (auto it = m_bitmaps.begin(); it != m_bitmaps.end(); ++it)
+      if (it->second->last_used < lru->second->last_used) lru = it;
+    LOGDBG_("bitmap of " << lru->first << " evicted");
+    memory_size -= lru->second->lines.memory_size();
+    // The matches of the filter are not recorded anymore
+    for (auto &bitmap: m_recorded)
+      if (bitmap == lru->second) bitmap.reset();
+    m_bitmaps.erase(lru);
+  }
+}
+
+FilteredBuffer::FilteredBuffer(std::shared_ptr<IBuffer> &buffer) :
+  m_buffer(buffer)
+{
 }
 
 FilteredBuffer::~FilteredBuffer() {
-  delete[] m_filtered_lines;
 }
 
-char **FilteredBuffer::get_text() const {
-  return m_filtered_lines;
+line_t FilteredBuffer::get_line(lineno_t i) const {
+  return m_buffer->get_line((*this).get_original_line(i));
 }
 
-void FilteredBuffer::clear_attrs() {
-  memset(m_attrs, 0, (m_original_number_of_line + 1) * sizeof (tattr_t));
+/*
+ * Prefetch the original lines, which are scattered in the original buffer. The
+ * lines whose text is in the same page as the previous one, or in the next
+ * page, are prefetched with it, in a single range.
+ */
+void FilteredBuffer::prefetch(lineno_t i, lineno_t count) {
+  lineno_t end = std::min(i + count, (*this).get_number_of_line());
+  if (i >= end) return;
+  uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  lineno_t first = (*this).get_original_line(i);
+  lineno_t last = first;
+  uintptr_t last_page = (uintptr_t) m_buffer->get_line(last).text / page_size;
+  for (++i; i < end; ++i) {
+    lineno_t line = (*this).get_original_line(i);
+    uintptr_t page = (uintptr_t) m_buffer->get_line(line).text / page_size;
+    if (line < last || page < last_page || page > last_page + 1) {
+      m_buffer->prefetch(first, last - first + 1);
+      first = line;
+    }
+    last = line;
+    last_page = page;
+  }
+  m_buffer->prefetch(first, last - first + 1);
 }
 
-uint FilteredBuffer::get_original_number_of_line() const {
-  return m_original_number_of_line;
+lineno_t FilteredBuffer::get_original_number_of_line() const {
+  return m_buffer->get_number_of_line();
 }
 
-uint FilteredBuffer::get_number_of_line() const {
-  return number_of_filtered_line;
+lineno_t FilteredBuffer::get_number_of_line() const {
+  return m_front_lines.size() + m_filtered_lines.size();
 }
 
 void FilteredBuffer::clear() {
-  number_of_filtered_line = 0;
-  memset(m_filtered_lines, 0, m_original_number_of_line * sizeof (char));
+  m_filtered_lines.clear();
+  m_front_lines.clear();
+  // The lines filtered first are the ones around the line displayed before
+  (*this).set_first_line_displayed(0);
 }
 
 /*
  * Add a matching line to the filtered buffer
  */
-void FilteredBuffer::add_line(char *line) {
-  if (number_of_filtered_line >= m_original_number_of_line) {
-    LOGERR("add line " << number_of_filtered_line << " to a buffer of size " <<
-           m_original_number_of_line);
-    // Should never happen
-    throw std::runtime_error("buffer overflow in filtered buffer");
-  }
-  m_filtered_lines[number_of_filtered_line++] = line;
+void FilteredBuffer::add_line(lineno_t line_index) {
+  m_filtered_lines.push_back(line_index);
+}
+
+void FilteredBuffer::add_lines(const lineno_t *line_indexes, size_t nb) {
+  m_filtered_lines.append(line_indexes, nb);
+}
+
+void FilteredBuffer::add_lines_front(const lineno_t *line_indexes,
+                                     size_t nb) {
+  m_front_lines.append(line_indexes, nb);
+}
+
+void FilteredBuffer::get_filtered_lines(std::vector<lineno_t> &lines) const {
+  lines.resize((*this).get_number_of_line());
+  for (lineno_t i = 0; i < lines.size(); ++i)
+    lines[i] = (*this).get_original_line(i);
+}
+
+lineno_t FilteredBuffer::get_original_line(lineno_t i) const {
+  lineno_t nb_front = m_front_lines.size();
+  if (i < nb_front) return m_front_lines[nb_front - 1 - i];
+  return m_filtered_lines[i - nb_front];
+}
+
+LoaderEngine::LoaderEngine(BufferModel &buffer_model) :
+  ProcessorThread(std::bind(&LoaderEngine::load, this)),
+  m_buffer_model(buffer_model)
+{
+}
+
+void LoaderEngine::load() {
+  std::shared_ptr<IBuffer> buffer = m_buffer_model.get_file_buffer();
+  lineno_t number_of_line = 0;
+  bool more = true;
+  ScanGuard scan(m_buffer_model);
+  scan.begin();
+  while (more && !m_interrupted) {
+    more = buffer->load_more();
+    // The file is indexed. When following it, only its tail will be read.
+    if (!more || buffer->get_loading_progress() == 100) scan.end();
+    // A followed file might not have grown, nothing to notify then
+    if (buffer->get_number_of_line() == number_of_line &&
+        buffer->get_loading_progress() == m_buffer_model.get_loading_progress())
+      continue;
+    number_of_line = buffer->get_number_of_line();
+    // Let the filter engine process the new lines
+    m_buffer_model.m_filter.wake_up();
+    // Update the progress, this will also redraw the view with the new lines
+    m_buffer_model.set_loading_progress().update() =
+      buffer->get_loading_progress();
+  }
+  LOGINF("buffer loaded");
 }
@@ -7,10 +7,17 @@
 #ifndef __PROCESSOR_H__
 #define __PROCESSOR_H__
 
+#include <map>
 #include <list>
+#include <deque>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <thread>
+#include <vector>
+#include <memory>
+#include <utility>
 #include <functional>
 #include <condition_variable>
 
@@ -18,6 +25,8 @@
 #include "logmacros.h"
 #include "buffer.h"
 #include "filter_set.h"
+#include "line_bitmap.h"
+#include "chunked_array.h"
 
 /**
  * A processor is a class representing a thread executing a task in the
@@ -43,25 +52,43 @@ public:
 class ProcessorThread : public Processor {
 public:
   ProcessorThread(std::function<void()> fn) : m_interrupted(false),
-    m_function(fn) {}
+    m_signaled(false), m_woken(false), m_function(fn) {}
   void start() {
     LOGDBG("starting thread");
     m_interrupted = false;
+    m_signaled = true;
     if (!m_thread.joinable())
       m_thread = std::thread(m_function);
     else
       LOGERR("thread already started!");
-    m_signaled = true;
   }
   ~ProcessorThread() {
     LOGFN()
+    join();
+  }
+  void stop() { m_interrupted = true; signal(); }
+  /* Stop the thread and wait for it to finish */
+  void join() {
     if (m_thread.joinable()) {
       stop();
       m_thread.join();
     }
   }
-  void stop() { m_interrupted = true; signal(); }
-  void signal() { LOGDBG("signaled"); m_signaled = true; m_signal.notify_all(); }
+  void signal() {
+    LOGDBG("signaled");
+    std::lock_guard<std::mutex> lock(m_wait_mutex);
+    m_signaled = true;
+    m_signal.notify_all();
+  }
+  /*
+   * Wake the thread up if it is waiting, without signaling that its input
+   * parameters changed. Used when there is more input to process.
+   */
+  void wake_up() {
+    std::lock_guard<std::mutex> lock(m_wait_mutex);
+    m_woken = true;
+    m_signal.notify_all();
+  }
   inline void reset_signal() { m_signaled = false; }
   /*
    * There can be two states in which we are signaled:
@@ -69,15 +96,26 @@ public:
    *    the condition variable
    * 2. We were busy processing but the input parameter changed and we need to
    *    start over: this is were the boolean m_signaled is used.
+   * A wake up or a signal raised before the call to wait is not lost.
    */
   void wait() {
     std::unique_lock<std::mutex> lock(m_wait_mutex);
-    m_signal.wait(lock);
+    while (!m_woken && !m_signaled && !m_interrupted) m_signal.wait(lock);
+    m_woken = false;
+  }
+  /* Like wait(), but returns after timeout at the latest */
+  void wait_for(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_wait_mutex);
+    m_signal.wait_for(lock, timeout, [this]() {
+      return m_woken || m_signaled || m_interrupted;
+    });
+    m_woken = false;
   }
 protected:
-  bool                      m_interrupted;
-  bool                      m_signaled;
+  std::atomic<bool>         m_interrupted;
+  std::atomic<bool>         m_signaled;
 private:
+  bool                      m_woken;
   std::thread               m_thread;
   std::function<void()>     m_function;
   std::mutex                m_wait_mutex;
@@ -87,10 +125,29 @@ private:
 // Forward declaration
 class BufferModel;
 
+/*
+ * The LoaderEngine loads the file buffer of a BufferModel in the background so
+ * the beginning of the buffer can be displayed while the rest is loaded. When
+ * the file is followed, the LoaderEngine keeps loading the appended lines until
+ * it is stopped.
+ */
+class LoaderEngine : public ProcessorThread {
+public:
+  LoaderEngine(BufferModel &buffer_model);
+  /*
+   * Load the buffer block by block. The model is notified after each block.
+   */
+  void load();
+private:
+  BufferModel &m_buffer_model;
+};
+
 /*
  * This class implements a buffer containing the result of the FilterEngine. It
  * implements the standard IBuffer interface but does not hold a copy of the
- * lines filtered, only pointers to the original IBuffer.
+ * lines filtered, only the index of the lines in the original IBuffer.
+ * The filtered lines can be read while the FilterEngine adds new ones, at the
+ * end or in front of the lines already filtered.
  */
 class FilteredBuffer : public Buffer {
 public:
@@ -100,28 +157,121 @@ public:
    * Standard IBuffer APIs
    */
   bool is_binary() { return false; }
-  char **get_text() const;
-  uint get_number_of_line() const;
-  uint get_original_number_of_line() const;
-  void set_number_of_line(uint) { /* Not applicable */ }
+  line_t get_line(lineno_t i) const;
+  lineno_t get_number_of_line() const;
+  lineno_t get_original_number_of_line() const;
+  void set_number_of_line(lineno_t) { /* Not applicable */ }
+  void prefetch(lineno_t i, lineno_t count);
+  /** Index in the original buffer of the filtered line i */
+  lineno_t get_original_line(lineno_t i) const;
   /*
    * Specific FilteredBuffer APIs
    */
   /** Clear the filtered line buffer */
   void clear();
-  /** Clear the attributes */
-  virtual void clear_attrs();
-  /** Add a line to the filtered line buffer */
-  void add_line(char *line);
+  /**
+   * Add a line, by its index in the original buffer, to the filtered buffer
+   */
+  void add_line(lineno_t line_index);
+  /** Add nb lines at once, like add_line */
+  void add_lines(const lineno_t *line_indexes, size_t nb);
+  /**
+   * Add nb lines in front of the filtered lines. The lines are given in
+   * decreasing order.
+   */
+  void add_lines_front(const lineno_t *line_indexes, size_t nb);
+  /** Copy the indexes in the original buffer of the filtered lines */
+  void get_filtered_lines(std::vector<lineno_t> &lines) const;
 private:
-  uint number_of_filtered_line;
-  char **m_filtered_lines;
-  uint m_original_number_of_line;
+  std::shared_ptr<IBuffer> m_buffer;
+  ChunkedArray<lineno_t> m_filtered_lines;
+  // Lines added in front of the others, the first one last
+  ChunkedArray<lineno_t> m_front_lines;
 };
 
+/*
+ * A pool of threads executing the tasks submitted, in the order they were
+ * submitted. The tasks not started yet are dropped on destruction.
+ * A task is given the index of the worker executing it, so the workers may
+ * keep their own state.
+ * The pool may be shared: each task is tagged with its owner, whose tasks are
+ * dropped before it is destroyed.
+ */
+class WorkerPool {
+public:
+  /* 0 means one worker per core */
+  WorkerPool(unsigned nb_workers = 0);
+  ~WorkerPool();
+  void submit(std::function<void(unsigned)> task,
+              const void *owner = nullptr);
+  /*
+   * Drop the tasks of owner not started yet and wait for the ones being
+   * executed to finish
+   */
+  void drop(const void *owner);
+  inline unsigned get_number_of_workers() const { return m_workers.size(); }
+private:
+  void work(unsigned worker);
+private:
+  typedef std::pair< const void *, std::function<void(unsigned)> > task_t;
+  std::vector<std::thread>                    m_workers;
+  std::deque<task_t>                          m_tasks;
+  // Owner of the task executed by each worker, if any
+  std::vector<const void *>                   m_running;
+  std::mutex                                  m_mutex;
+  std::condition_variable                     m_signal;
+  // Signaled when a task is done
+  std::condition_variable                     m_done;
+  bool                                        m_stopped;
+};
+
+/*
+ * Order in which the FilterEngine filters the lines of the file buffer
+ */
+enum class scan_order_e {
+  FORWARD,          // from the first line to the last one
+  VIEWPORT_FIRST,   // outward from the line displayed at the top of the view
+  TAIL_FIRST        // backward from the last line
+};
+
+/*
+ * The FilterEngine splits the file buffer in shards of lines which are filtered
+ * concurrently by a pool of workers. The matches of the shards are merged in
+ * line order in the model, as soon as all the shards before them are done.
+ * The filtering starts from a line chosen by the scan order, e.g. the line
+ * displayed, and the shards are dispatched from there towards both ends of the
+ * buffer, the closest to that line first. The shards after it are merged at
+ * the end of the filtered lines, the ones before it in front of them, so the
+ * filtered lines stay in order.
+ * The first shards are small so the first matches, which are the ones on
+ * screen, are displayed quickly. The following ones grow to reduce the
+ * overhead.
+ * A filter is searched over the whole text of a shard at once rather than line
+ * by line, like grep: the line of each match is found through the line index,
+ * and the search resumes on the next line. The lines without any match only
+ * cost the search.
+ * When the filters are narrowed, typically while a filter is being typed, the
+ * lines which did not match before cannot match anymore: only the lines
+ * already matched are filtered again, then the lines not filtered yet.
+ * The lines matched by each filter are recorded in a bitmap while the whole
+ * buffer is filtered, unless the filters are ANDed and one of them cannot be
+ * searched in blocks. When all the filters of a new set have a bitmap, e.g.
+ * when switching between AND and OR or removing a filter, the lines matching
+ * the set are computed from the bitmaps and are not filtered again.
+ * Only which lines match is decided while filtering: where the filters match
+ * is found by the Highlighter for the lines displayed.
+ * Each change of the filters starts a new generation: the shards of the
+ * previous ones are abandoned as soon as the change is signaled, and the lines
+ * filtered are added to a new FilteredBuffer, published in the model once it
+ * holds its first lines so the view never mixes the results of two
+ * generations. A burst of changes, e.g. fast typing, is only filtered once.
+ */
 class FilterEngine : public ProcessorThread {
 public:
-  FilterEngine(BufferModel &buffer_model);
+  /* The shards are filtered by workers, a pool of its own if none is given */
+  FilterEngine(BufferModel &buffer_model,
+               std::shared_ptr<WorkerPool> workers = nullptr);
+  ~FilterEngine();
   /*
    * Start once the signal is raised (or on first call to start).
    * Check the content of the filter set. If the filter set is empty, wait for a
@@ -132,20 +282,158 @@ public:
    * Re-arm the filter state so that the buffer of filtered line is clear, and a
    * new filtering can begin
    */
-  void rearm(uint &current_buffer_line, uint &current_filtered_line);
+  void rearm();
+  /*
+   * Signal that the filters changed. The shards being filtered with the
+   * previous filters are abandoned right away.
+   */
+  void signal();
+  /* Set the order of the next filterings */
+  inline void set_scan_order(scan_order_e order) { m_scan_order = order; }
 private:
   /*
-   * Match a character string from the buffer with a particular filter set.
+   * A range of lines filtered by a worker. If lines is set, the shard is made
+   * of the lines (*lines)[begin] to (*lines)[end - 1], which are merged at the
+   * end of the filtered lines. If matched is also set, they are known to match
+   * and are not filtered.
+   */
+  struct shard_t {
+    lineno_t                                    begin;
+    lineno_t                                    end;
+    std::shared_ptr<const std::vector<lineno_t> > lines;
+    bool                                        matched;
+    // The lines before this one are filtered once a shard merged at the end of
+    // the filtered lines is merged
+    lineno_t                                    merged_line;
+    std::vector<lineno_t>                       matches;
+    // Lines matched by each filter, only if the shard records them
+    std::vector< std::vector<lineno_t> >        filter_matches;
+    std::atomic<bool>                           done;
+    // Generation of the filters the shard is filtered with, and generation of
+    // the latest filters
+    uint64_t                                    generation;
+    const std::atomic<uint64_t>                 *current_generation;
+
+    shard_t(lineno_t b, lineno_t e) : begin(b), end(e), matched(false),
+      merged_line(e), done(false), generation(0), current_generation(nullptr) {}
+    /* The filters changed, the result is not needed anymore */
+    inline bool is_cancelled() const {
+      return current_generation->load(std::memory_order_relaxed) != generation;
+    }
+  };
+  /*
+   * Match a character string from the buffer with a particular filter set
+   */
+  static bool match(const line_t &line, const filter_set_t &filter_set);
+  /*
+   * Like match(), but all the filters are searched and the line is added to
+   * filter_matches[i] if the filter i matches
+   */
+  static bool match_all(const line_t &line, lineno_t line_index,
+                        const filter_set_t &filter_set,
+                        std::vector< std::vector<lineno_t> > &filter_matches);
+  /*
+   * Add the lines of a shard matching a filter to matches. The text of the
+   * lines is searched in blocks if possible, otherwise line by line.
+   */
+  static void search_lines(const Matcher &matcher, const IBuffer &buffer,
+                           const shard_t &shard,
+                           std::vector<lineno_t> &matches);
+  /*
+   * Filter the lines of a shard in blocks. Returns false if the filter set
+   * cannot be searched in blocks, e.g. several filters ORed.
+   */
+  static bool filter_blocks(shard_t &shard, const filter_set_t &filter_set,
+                            const IBuffer &buffer);
+  /* Filters of a worker, cloned from the filters it filtered with last */
+  struct worker_filters_t {
+    std::shared_ptr<const filter_set_t> source;
+    filter_set_t                        filter_set;
+  };
+  /* Copy filter_set to clone, with copies of its matchers */
+  static void clone_filters(const filter_set_t &filter_set,
+                            filter_set_t &clone);
+  /*
+   * Filter the lines of a shard, executed by the workers. The worker clones
+   * the filters when they changed.
+   */
+  static void filter_shard(
+    shard_t &shard, std::shared_ptr<const filter_set_t> shared_filter_set,
+    worker_filters_t &worker_filters, const IBuffer &buffer);
+  /* Lines matched by a filter among the lines [begin, end) */
+  struct bitmap_t {
+    LineBitmap  lines;
+    lineno_t    begin;
+    lineno_t    end;
+    uint64_t    last_used;
+
+    bitmap_t(lineno_t line) : begin(line), end(line), last_used(0) {}
+  };
+  /*
+   * If all the filters have a bitmap, set lines to the lines matching the
+   * filter set in [begin, end), the lines covered by all the bitmaps, and
+   * return true
+   */
+  bool combine_bitmaps(std::vector<lineno_t> &lines, lineno_t &begin,
+                       lineno_t &end) const;
+  /*
+   * Wait until no signal was raised for a while if the last signal followed
+   * the previous one closely, e.g. while a filter is being typed
    */
-  bool match(const char *line, const filter_set_t &filter_set,
-             std::cmatch &matches);
+  void debounce();
+  /* Dispatch a shard to the workers */
+  void dispatch(std::shared_ptr<shard_t> shard,
+                std::shared_ptr<IBuffer> file_buffer);
+  /* Add the lines matched by the filters in a merged shard to the bitmaps */
+  void record(const shard_t &shard);
+  /* Drop the least recently used bitmaps until they fit in the budget */
+  void evict_bitmaps();
 
 private:
   //Controller  &m_controller;
   BufferModel &m_buffer_model;
   // We maintain a local filter list in order to avoid taking a mutex for each
-  // line analyzed.
-  filter_set_t m_filter_set;
+  // line analyzed. It is shared with the workers and replaced on rearm.
+  std::shared_ptr<filter_set_t> m_filter_set;
+  // Incremented each time the filters change, and generation of m_filter_set
+  std::atomic<uint64_t> m_generation;
+  uint64_t m_filtered_generation;
+  // Time of the last two signals, in steady_clock ticks
+  std::atomic<int64_t> m_last_signal;
+  std::atomic<int64_t> m_previous_signal;
+  // Order of the next filterings
+  std::atomic<scan_order_e> m_scan_order;
+  // The filtering starts at m_origin. The lines [m_low, m_high) are filtered
+  // and merged in the model. The next shards below them end at m_down, the
+  // next shards above them begin at m_up.
+  lineno_t m_origin;
+  lineno_t m_low;
+  lineno_t m_high;
+  lineno_t m_down;
+  lineno_t m_up;
+  // Shards dispatched to the workers, in the order they are merged: above the
+  // filtered lines in line order, below them in reverse line order
+  std::deque< std::shared_ptr<shard_t> > m_up_shards;
+  std::deque< std::shared_ptr<shard_t> > m_down_shards;
+  // Lines matched by the previous filters, to be filtered again when the
+  // filters are narrowed, and the next one to dispatch. When computed from the
+  // bitmaps, they are the lines matching the filters.
+  std::shared_ptr<const std::vector<lineno_t> > m_candidates;
+  lineno_t m_next_candidate;
+  bool m_candidates_matched;
+  // Number of lines of the next shard
+  lineno_t m_shard_size;
+  // Bitmaps of the filters used recently, by pattern
+  std::map<std::string, std::shared_ptr<bitmap_t> > m_bitmaps;
+  // Bitmaps extended by the current filtering, by filter of m_filter_set, or
+  // null if the matches of the filter are not recorded
+  std::vector< std::shared_ptr<bitmap_t> > m_recorded;
+  uint64_t m_bitmap_clock;
+  // Filters of each worker, by index, only used by that worker
+  std::vector<worker_filters_t> m_worker_filters;
+  // Possibly shared with the FilterEngines of the other buffers, the shards
+  // are tagged with this engine
+  std::shared_ptr<WorkerPool> m_workers;
 };
 
 #endif // __PROCESSOR_H__
\ No newline at end of file
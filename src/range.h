@@ -5,20 +5,22 @@
 #ifndef __RANGE_H__
 #define __RANGE_H__
 
+#include "types.h"
+
 /*
  * Represent a set of unique ever increasing integers
  */
 class range {
 private:
-    int m_last;
-    int m_iter;
+    lineno_t m_last;
+    lineno_t m_iter;
 
 public:
-    range(int end):
+    range(lineno_t end):
         m_last(end),
         m_iter(0)
     {}
-    range(int begin, int end):
+    range(lineno_t begin, lineno_t end):
         m_last(end),
         m_iter(begin)
     {}
@@ -30,7 +32,7 @@ public:
     // Iterator functions
     bool operator!=(const range&) const { return m_iter < m_last; }
     void operator++() { ++m_iter; }
-    int operator*() const { return m_iter; }
+    lineno_t operator*() const { return m_iter; }
 };
 
 /*
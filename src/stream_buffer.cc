@@ -0,0 +1,96 @@
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "logmacros.h"
+#include "stream_buffer.h"
+
+StreamBuffer::StreamBuffer(int fd, const std::string &name) : Buffer(),
+  m_name(name), m_fd(fd), m_nb_lines(0)
+{
+  LOGDBG("StreamBuffer constructor " << this);
+  // The first line starts at the beginning of the stream
+  m_line_offsets.push_back(0);
+}
+
+StreamBuffer::StreamBuffer(const std::string &filepath) : Buffer(),
+  m_name(filepath), m_fd(-1), m_nb_lines(0)
+{
+  LOGDBG("StreamBuffer constructor " << this);
+  struct stat st;
+  if (stat(filepath.c_str(), &st) == -1)
+    throw OpenFileException(filepath, strerror(errno));
+  if (!S_ISFIFO(st.st_mode))
+    throw OpenFileException(filepath, "not a named pipe");
+  // Do not block until a writer opens the pipe, load_more() polls it
+  m_fd = open(filepath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (m_fd == -1) throw OpenFileException(filepath, strerror(errno));
+  m_line_offsets.push_back(0);
+}
+
+StreamBuffer::~StreamBuffer() {
+  LOGDBG("StreamBuffer destructor " << this);
+  if (m_fd != -1) close(m_fd);
+}
+
+line_t StreamBuffer::get_line(lineno_t i) const {
+  // Same layout as the FileBuffer index (see FileBuffer::get_line)
+  offset_t begin = m_line_offsets[i];
+  size_t length = m_line_offsets[i + 1] - begin - 1;
+  const char *data = m_arena.data();
+  if (length > 0 && data[begin + length - 1] == '\r') --length;
+  return line_t(data + begin, length);
+}
+
+line_t StreamBuffer::get_block(lineno_t begin, lineno_t end) const {
+  // The lines are contiguous in the arena
+  offset_t first = m_line_offsets[begin];
+  return line_t(m_arena.data() + first, m_line_offsets[end] - first - 1);
+}
+
+lineno_t StreamBuffer::get_number_of_line() const {
+  return m_nb_lines.load(std::memory_order_acquire);
+}
+
+bool StreamBuffer::load_more() {
+  // Wait for data, FOLLOW_POLL_INTERVAL at most so the loading thread can be
+  // interrupted
+  struct pollfd pfd = { m_fd, POLLIN, 0 };
+  if (poll(&pfd, 1, FOLLOW_POLL_INTERVAL) <= 0) return true;
+  size_t indexed_size = m_arena.size();
+  bool eof = false;
+  // Read what is available, STREAM_READ_SIZE at most so the lines received are
+  // published regularly
+  while (m_arena.size() - indexed_size < STREAM_READ_SIZE) {
+    size_t available;
+    char *area = m_arena.get_write_area(available);
+    if (area == nullptr) { eof = true; break; }
+    ssize_t received = read(m_fd, area, available);
+    if (received == -1 && errno == EINTR) continue;
+    if (received == -1 && errno == EAGAIN) break;
+    if (received <= 0) {
+      if (received == -1) LOGERR("cannot read " << m_name << ": "
+                                 << strerror(errno));
+      eof = true;
+      break;
+    }
+    m_arena.commit(received);
+    // Only read again if more data is already available
+    if (poll(&pfd, 1, 0) <= 0) break;
+  }
+  size_t size = m_arena.size();
+  index_lines(m_arena.data() + indexed_size, size - indexed_size, indexed_size,
+              m_line_offsets);
+  // Last line is not terminated by a \n
+  if (eof && m_line_offsets.back() != size)
+    m_line_offsets.push_back(size + 1);
+  m_nb_lines.store(m_line_offsets.size() - 1, std::memory_order_release);
+  if (eof) {
+    LOGINF(m_name << " closed after " << size << " bytes");
+    close(m_fd);
+    m_fd = -1;
+  }
+  return !eof;
+}
@@ -0,0 +1,59 @@
+/*! \brief Buffer reading its content from a stream
+ *
+ * A StreamBuffer reads the standard input or a named pipe, which cannot be
+ * mapped in memory, and keeps the data received so it can be browsed.
+ */
+
+#ifndef __STREAM_BUFFER_H__
+#define __STREAM_BUFFER_H__
+
+#include <string>
+#include <atomic>
+
+#include "types.h"
+#include "arena.h"
+#include "buffer.h"
+#include "line_index.h"
+
+// Maximum number of bytes read before the lines received are published
+#define STREAM_READ_SIZE ARENA_CHUNK_SIZE
+
+/*
+ * The data received is stored in an Arena, so it is contiguous and the lines
+ * are served as views on it, like in a FileBuffer.
+ * load_more() reads what is available on the stream and indexes the complete
+ * lines received. It returns false once the end of the stream is reached.
+ */
+class StreamBuffer : public Buffer {
+public:
+  /* Read the stream fd, which is closed by the buffer */
+  StreamBuffer(int fd, const std::string &name);
+  /* Open the named pipe filepath and read it */
+  StreamBuffer(const std::string &filepath);
+  ~StreamBuffer();
+  /*
+   * Standard IBuffer APIs
+   */
+  bool is_binary() { return false; }
+  line_t get_line(lineno_t i) const;
+  line_t get_block(lineno_t begin, lineno_t end) const;
+  lineno_t get_number_of_line() const;
+  void set_number_of_line(lineno_t) { /* Not applicable */ }
+  bool load_more();
+  /*
+   * Return the name of the stream
+   */
+  inline const std::string &get_name() const { return (*this).m_name; }
+
+private:
+  std::string           m_name;
+  int                   m_fd;
+  Arena                 m_arena;
+  LineIndex             m_line_offsets;
+  std::atomic<lineno_t> m_nb_lines;
+
+private:
+  StreamBuffer(const StreamBuffer &b) = delete;
+};
+
+#endif // __STREAM_BUFFER_H__
@@ -45,6 +45,8 @@ uint TerminalView::init() {
   keypad(stdscr, TRUE);
   // No delay on escape key
   set_escdelay(0);
+  // Each filter is highlighted with its own color, if the terminal has colors
+  init_highlight_colors();
   // Get the screen size
   getmaxyx(stdscr, this->_nlines, this->_ncols);
   LOGINF("Screen initialized with " << this->_nlines << " lines and "
@@ -111,20 +113,24 @@ void TerminalView::redraw_buffer(BufferModel &buffer_model) {
       || _state_model.get_state() == state_e::FILTER_STATE
       || _state_model.get_state() == state_e::ADD_FILTER_STATE)
   {
-    uint first_line = buffer_model.get_first_line_displayed();
-    uint number_of_line = buffer_model.get_number_of_line();
+    // The lines are drawn from the same buffer even if the filtered buffer is
+    // replaced meanwhile, and lines are not added in front of them while they
+    // are drawn
+    std::unique_lock<std::mutex> lock = buffer_model.lock_view();
+    std::shared_ptr<IBuffer> buffer = buffer_model.get_current_buffer();
+    lineno_t first_line = buffer->get_first_line_displayed();
+    lineno_t number_of_line = buffer->get_number_of_line();
     LOGDBG_("range: buffer_model.get_first_line_displayed(): " << first_line)
     LOGDBG_("range: buffer_model.get_number_of_line(): " << number_of_line)
-    print_buffer(stdscr, buffer_model.get_text(),
+    print_buffer(stdscr, *buffer,
                  range(first_line, number_of_line),
                  0, this->_nlines, this->_ncols, 0, false);
+    // The matches are only searched in the lines displayed
     if (buffer_model.get_display_attributes()) {
-      print_attrs(stdscr, buffer_model.get_attrs(), buffer_model.get_text(),
-                   range(first_line,
-                         std::max(0,
-                          (int) std::min(first_line + this->_nlines,
-                                         number_of_line) - 0)),
-                   0, this->_nlines, this->_ncols, 0, false);
+      print_attrs(stdscr, *buffer, buffer_model.get_highlighter(),
+                  range(first_line,
+                        std::min(first_line + this->_nlines, number_of_line)),
+                  0, this->_nlines, this->_ncols, 0, false);
     }
     redraw_prompt(_prompt_model);
   }
@@ -175,12 +181,15 @@ void TerminalView::redraw_prompt(PromptModel &prompt_model) {
             &prompt_model.get_prompt().c_str()[_prompt_string_index]);
   } else if (_state_model.get_state() == state_e::BROWSE_STATE
              || _state_model.get_state() == state_e::FILTER_STATE) {
-    // display the number of lines and the current top line (25 because 2^32 is
-    // the maximum number of lines we can load so we can at display at most
-    // 4294967296/4294967296)
-    wmove(stdscr, this->_nlines - 1, this->_ncols - 25);
-    wprintw(stdscr, "%9i/%i",
-            buffer->get_first_line_displayed(), buffer->get_number_of_line());
+    // display the number of lines and the current top line (25 leaves room for
+    // 9 digits on each side, larger line numbers (up to 2^64) push the text to
+    // the left)
+    char position[64];
+    int width = snprintf(position, sizeof (position), "%9llu/%llu",
+      (unsigned long long) buffer->get_first_line_displayed(),
+      (unsigned long long) buffer->get_number_of_line());
+    wmove(stdscr, this->_nlines - 1, this->_ncols - std::max(25, width + 5));
+    wprintw(stdscr, "%s", position);
     // If at the top of the file, display a Top tag
     if (buffer->get_first_line_displayed() == 0) {
       wmove(stdscr, this->_nlines - 1, this->_ncols - 3);
@@ -192,6 +201,11 @@ void TerminalView::redraw_prompt(PromptModel &prompt_model) {
       wmove(stdscr, this->_nlines - 1, this->_ncols - 3);
       wprintw(stdscr, "End");
     }
+    // Show loading progress while the file is indexed in the background
+    if (buffer->get_loading_progress() != 100) {
+      wmove(stdscr, this->_nlines - 1, this->_ncols - 56);
+      wprintw(stdscr, "indexing %u %%", buffer->get_loading_progress());
+    }
   }
   if (_state_model.get_state() == state_e::FILTER_STATE) {
     // Show filtering progress if not 100%
@@ -1,7 +1,13 @@
 #ifndef  __TYPES_H__
 #define __TYPES_H__
 
+#include <cstdint>
+
 typedef unsigned int uint;
+/* Index of a line in a buffer */
+typedef uint64_t lineno_t;
+/* Offset of a character in a buffer */
+typedef uint64_t offset_t;
 
 typedef struct {
   uint x;
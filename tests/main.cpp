@@ -13,10 +13,40 @@
 #include "tests_model.h"
 #include "tests_input.h"
 #include "tests_controller.h"
+#include "tests_file_buffer.h"
+#include "tests_line_index.h"
+#include "tests_chunked_array.h"
+#include "tests_index_cache.h"
+#include "tests_stream_buffer.h"
+#include "tests_arena.h"
+#include "tests_buffer_model.h"
+#include "tests_filter_engine.h"
+#include "tests_matcher.h"
+#include "tests_automaton.h"
+#include "tests_filter_set.h"
+#include "tests_line_bitmap.h"
+#include "tests_block_search.h"
+#include "tests_filter_plan.h"
+#include "tests_highlighter.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION( ModelTest );
 CPPUNIT_TEST_SUITE_REGISTRATION( InputTest );
 CPPUNIT_TEST_SUITE_REGISTRATION( ControllerTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( FileBufferTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( LineIndexTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( ChunkedArrayTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( IndexCacheTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( StreamBufferTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( ArenaTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( BufferModelTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( FilterEngineTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( MatcherTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( AutomatonTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( FilterSetTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( LineBitmapTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( BlockSearchTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( FilterPlanTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( HighlighterTest );
 
 int main(int argc, char **argv)
 {
@@ -28,6 +58,21 @@ int main(int argc, char **argv)
   runner.addTest( ModelTest::suite()            );
   runner.addTest( InputTest::suite()            );
   runner.addTest( ControllerTest::suite()       );
+  runner.addTest( FileBufferTest::suite()       );
+  runner.addTest( LineIndexTest::suite()        );
+  runner.addTest( ChunkedArrayTest::suite()     );
+  runner.addTest( IndexCacheTest::suite()       );
+  runner.addTest( StreamBufferTest::suite()     );
+  runner.addTest( ArenaTest::suite()            );
+  runner.addTest( BufferModelTest::suite()      );
+  runner.addTest( FilterEngineTest::suite()     );
+  runner.addTest( MatcherTest::suite()          );
+  runner.addTest( AutomatonTest::suite()        );
+  runner.addTest( FilterSetTest::suite()        );
+  runner.addTest( LineBitmapTest::suite()       );
+  runner.addTest( BlockSearchTest::suite()      );
+  runner.addTest( FilterPlanTest::suite()       );
+  runner.addTest( HighlighterTest::suite()      );
   runner.run();
   return 0;
 }
\ No newline at end of file
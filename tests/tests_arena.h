@@ -0,0 +1,83 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <string>
+#include <cstring>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "arena.h"
+
+class ArenaTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( ArenaTest );
+  CPPUNIT_TEST( test_append );
+  CPPUNIT_TEST( test_write_area );
+  CPPUNIT_TEST( test_spill );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  void test_append()
+  {
+    Arena arena;
+    CPPUNIT_ASSERT ( arena.data() == nullptr );
+    CPPUNIT_ASSERT ( arena.append("abc\n", 4) );
+    const char *data = arena.data();
+    CPPUNIT_ASSERT ( arena.append("de\n", 3) );
+    // The bytes are packed and do not move
+    CPPUNIT_ASSERT_EQUAL ( (size_t) 7, arena.size() );
+    CPPUNIT_ASSERT ( data == arena.data() );
+    CPPUNIT_ASSERT_EQUAL ( std::string("abc\nde\n"), std::string(data, 7) );
+  }
+
+  void test_write_area()
+  {
+    Arena arena;
+    size_t available;
+    char *area = arena.get_write_area(available);
+    CPPUNIT_ASSERT_EQUAL ( (size_t) ARENA_CHUNK_SIZE, available );
+    memcpy(area, "xyz", 3);
+    arena.commit(3);
+    CPPUNIT_ASSERT ( arena.get_write_area(available) == area + 3 );
+    CPPUNIT_ASSERT_EQUAL ( (size_t) ARENA_CHUNK_SIZE - 3, available );
+    // Filling the chunk backs the next one
+    arena.commit(available);
+    CPPUNIT_ASSERT ( arena.get_write_area(available) ==
+                     area + ARENA_CHUNK_SIZE );
+    CPPUNIT_ASSERT_EQUAL ( (size_t) ARENA_CHUNK_SIZE, available );
+    CPPUNIT_ASSERT_EQUAL ( std::string("xyz"),
+                           std::string(arena.data(), 3) );
+  }
+
+  void test_spill()
+  {
+    // A budget of one chunk: the previous chunks are moved to the spill file
+    // and still read the same at the same address
+    Arena arena(ARENA_CHUNK_SIZE);
+    std::string block(4096, 0);
+    const size_t nb_blocks = 4 * ARENA_CHUNK_SIZE / block.size() + 1;
+    for (size_t i = 0; i < nb_blocks; ++i) {
+      memset(&block[0], 'a' + i % 26, block.size());
+      CPPUNIT_ASSERT ( arena.append(block.data(), block.size()) );
+    }
+    CPPUNIT_ASSERT_EQUAL ( nb_blocks * block.size(), arena.size() );
+    for (size_t i = 0; i < nb_blocks; ++i) {
+      const char *data = arena.data() + i * block.size();
+      CPPUNIT_ASSERT_EQUAL ( (char) ('a' + i % 26), data[0] );
+      CPPUNIT_ASSERT_EQUAL ( (char) ('a' + i % 26), data[block.size() - 1] );
+    }
+  }
+};
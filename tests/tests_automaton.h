@@ -0,0 +1,266 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "automaton.h"
+
+class AutomatonTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( AutomatonTest );
+  CPPUNIT_TEST( test_unsupported_patterns );
+  CPPUNIT_TEST( test_dfa_search_forward );
+  CPPUNIT_TEST( test_dfa_search_backward );
+  CPPUNIT_TEST( test_dfa_assertions );
+  CPPUNIT_TEST( test_dfa_copy );
+  CPPUNIT_TEST( test_empty_loops );
+  CPPUNIT_TEST( test_aho_corasick );
+  CPPUNIT_TEST( test_aho_corasick_random );
+  CPPUNIT_TEST( test_aho_corasick_sparse );
+  CPPUNIT_TEST( test_aho_corasick_fits );
+  CPPUNIT_TEST( test_dfa_search_all );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  /* End of the leftmost-first match of pattern in text from from, or -1 */
+  static int match_end(const std::string &pattern, const std::string &text,
+                       size_t from = 0)
+  {
+    LazyDfa dfa(compile_program(pattern, false), true);
+    size_t end;
+    if (!dfa.search_forward(text.data(), text.size(), end, from)) return -1;
+    return end;
+  }
+
+  /* Beginning of the leftmost match of pattern ending at end, or -1 */
+  static int match_start(const std::string &pattern, const std::string &text,
+                         size_t end, size_t from = 0)
+  {
+    LazyDfa dfa(compile_program(pattern, true), false);
+    size_t start;
+    if (!dfa.search_backward(text.data(), text.size(), end, start, from))
+      return -1;
+    return start;
+  }
+
+  void test_unsupported_patterns()
+  {
+    // Left to std::regex
+    CPPUNIT_ASSERT ( !compile_program("(a)\\1", false) );
+    CPPUNIT_ASSERT ( !compile_program("a(?=b)", false) );
+    CPPUNIT_ASSERT ( !compile_program("a(?!b)", false) );
+    CPPUNIT_ASSERT ( !compile_program("[[:alpha:]]", false) );
+    // Invalid
+    CPPUNIT_ASSERT ( !compile_program("(ab", false) );
+    CPPUNIT_ASSERT ( !compile_program("a**", false) );
+    CPPUNIT_ASSERT ( compile_program("(?:a|b)+c{2,3}[^x-z]\\d\\w.", false) );
+  }
+
+  void test_dfa_search_forward()
+  {
+    CPPUNIT_ASSERT_EQUAL ( 6, match_end("b+", "aabbbba") );
+    CPPUNIT_ASSERT_EQUAL ( -1, match_end("c", "aabbbba") );
+    // The first alternative of the leftmost match has priority
+    CPPUNIT_ASSERT_EQUAL ( 2, match_end("ab|abc", "abc") );
+    CPPUNIT_ASSERT_EQUAL ( 3, match_end("abc|ab", "abc") );
+    // Lazy quantifiers stop at the first match
+    CPPUNIT_ASSERT_EQUAL ( 3, match_end("a.*?b", "axbxb") );
+    CPPUNIT_ASSERT_EQUAL ( 5, match_end("a.*b", "axbxb") );
+    CPPUNIT_ASSERT_EQUAL ( 4, match_end("x{2,3}", "axxxxx") );
+    // The search begins at from
+    CPPUNIT_ASSERT_EQUAL ( 5, match_end("ab", "ab ab ab", 1) );
+    // An empty match
+    CPPUNIT_ASSERT_EQUAL ( 0, match_end("x*", "abc") );
+  }
+
+  void test_dfa_search_backward()
+  {
+    // The lowest beginning of a match ending there
+    CPPUNIT_ASSERT_EQUAL ( 2, match_start("b+", "aabbbba", 6) );
+    CPPUNIT_ASSERT_EQUAL ( 0, match_start("a.*b", "axbxb", 5) );
+    CPPUNIT_ASSERT_EQUAL ( 3, match_start("a.*b", "axbab", 5, 3) );
+    CPPUNIT_ASSERT_EQUAL ( -1, match_start("c", "abc", 2) );
+  }
+
+  void test_dfa_assertions()
+  {
+    CPPUNIT_ASSERT_EQUAL ( 3, match_end("^foo", "foo foo") );
+    // The text before from is the context of the assertions
+    CPPUNIT_ASSERT_EQUAL ( -1, match_end("^foo", "foo foo", 1) );
+    CPPUNIT_ASSERT_EQUAL ( 7, match_end("foo$", "foo foo") );
+    CPPUNIT_ASSERT_EQUAL ( -1, match_end("foo$", "foo foox") );
+    CPPUNIT_ASSERT_EQUAL ( 10, match_end("\\bbar\\b", "barbar bar") );
+    CPPUNIT_ASSERT_EQUAL ( -1, match_end("\\bar", "bar", 1) );
+    CPPUNIT_ASSERT_EQUAL ( 3, match_end("\\Bar", "bar") );
+    CPPUNIT_ASSERT_EQUAL ( 7, match_start("\\bbar\\b", "barbar bar", 10) );
+  }
+
+  void test_dfa_copy()
+  {
+    // Copies share the program, each one builds its own states
+    LazyDfa dfa(compile_program("[0-9]+ms", false), true);
+    LazyDfa copy(dfa);
+    std::string text = "took 125ms";
+    size_t end = 0, copy_end = 0;
+    CPPUNIT_ASSERT ( dfa.search_forward(text.data(), text.size(), end) );
+    CPPUNIT_ASSERT ( copy.search_forward(text.data(), text.size(),
+                                         copy_end) );
+    CPPUNIT_ASSERT_EQUAL ( (size_t) 10, end );
+    CPPUNIT_ASSERT_EQUAL ( end, copy_end );
+  }
+
+  void test_empty_loops()
+  {
+    // The repetitions which may iterate over the empty string are flagged,
+    // their spans are found by std::regex
+    CPPUNIT_ASSERT ( compile_program("(c?\?)*", false)->empty_loops );
+    CPPUNIT_ASSERT ( compile_program(".?\?(.{0,2}?)*a", false)->empty_loops );
+    CPPUNIT_ASSERT ( compile_program("(a|b?)+", false)->empty_loops );
+    CPPUNIT_ASSERT ( compile_program("(\\b)*a", false)->empty_loops );
+    CPPUNIT_ASSERT ( !compile_program("(a?){2}", false)->empty_loops );
+    CPPUNIT_ASSERT ( !compile_program("(ab?)*c?", false)->empty_loops );
+  }
+
+  /* Tags found in text, sorted */
+  static std::vector<int> found(const AhoCorasick &automaton,
+                                const std::string &text, size_t nb_tags)
+  {
+    tag_set_t matched;
+    matched.contains.resize(nb_tags, false);
+    automaton.search(text.data(), text.size(), matched);
+    std::vector<int> tags = matched.tags;
+    std::sort(tags.begin(), tags.end());
+    return tags;
+  }
+
+  void test_aho_corasick()
+  {
+    AhoCorasick automaton({ "he", "she", "his", "hers", "s" },
+                          { 0, 1, 2, 3, 4 });
+    // The literals ending at the suffixes of a node are found too
+    CPPUNIT_ASSERT ( (found(automaton, "ushers", 5) ==
+                      std::vector<int>{ 0, 1, 3, 4 }) );
+    CPPUNIT_ASSERT ( (found(automaton, "this", 5) ==
+                      std::vector<int>{ 2, 4 }) );
+    CPPUNIT_ASSERT ( found(automaton, "", 5).empty() );
+    CPPUNIT_ASSERT ( found(automaton, "HE SHE", 5).empty() );
+    // Several literals may have the same tag
+    AhoCorasick tagged({ "foo", "bar", "baz" }, { 1, 0, 1 });
+    CPPUNIT_ASSERT ( (found(tagged, "xbazx", 2) == std::vector<int>{ 1 }) );
+  }
+
+  void test_aho_corasick_random()
+  {
+    std::mt19937 random(2018);
+    for (int i = 0; i < 200; ++i) {
+      std::vector<std::string> literals;
+      std::vector<int> tags;
+      for (int j = random() % 8; j >= 0; --j) {
+        std::string literal;
+        for (int k = random() % 4; k >= 0; --k) literal += "abc"[random() % 3];
+        literals.push_back(literal);
+        tags.push_back(tags.size());
+      }
+      AhoCorasick automaton(literals, tags);
+      for (int j = 0; j < 10; ++j) {
+        std::string text;
+        for (int k = random() % 20; k > 0; --k) text += "abcd"[random() % 4];
+        std::vector<int> expected;
+        for (size_t tag = 0; tag < literals.size(); ++tag)
+          if (text.find(literals[tag]) != std::string::npos)
+            expected.push_back(tag);
+        CPPUNIT_ASSERT ( found(automaton, text, literals.size()) ==
+                         expected );
+      }
+    }
+  }
+
+  void test_aho_corasick_sparse()
+  {
+    // More literals than the nodes of the DFA, the deeper nodes following
+    // their failure links
+    std::mt19937 random(2018);
+    std::vector<std::string> texts;
+    for (int i = 0; i < 50; ++i) {
+      std::string text;
+      for (int k = 0; k < 200; ++k) text += 'a' + random() % 26;
+      texts.push_back(text);
+    }
+    std::vector<std::string> literals;
+    std::vector<int> tags;
+    for (int i = 0; i < 10000; ++i) {
+      size_t length = 1 + random() % 20;
+      std::string literal;
+      if (i % 2) {
+        // Occurs in a text
+        const std::string &text = texts[random() % texts.size()];
+        literal = text.substr(random() % (text.size() - length), length);
+      } else {
+        for (size_t k = 0; k < length; ++k) literal += 'a' + random() % 26;
+      }
+      literals.push_back(literal);
+      tags.push_back(tags.size());
+    }
+    AhoCorasick automaton(literals, tags);
+    CPPUNIT_ASSERT ( automaton.get_number_of_dense_nodes() <
+                     automaton.get_number_of_nodes() );
+    for (const std::string &text: texts) {
+      std::vector<int> expected;
+      for (size_t tag = 0; tag < literals.size(); ++tag)
+        if (text.find(literals[tag]) != std::string::npos)
+          expected.push_back(tag);
+      CPPUNIT_ASSERT ( found(automaton, text, literals.size()) == expected );
+    }
+  }
+
+  void test_aho_corasick_fits()
+  {
+    std::vector<std::string> literals = { "foo",
+      std::string(AC_MAX_LITERALS_SIZE - 3, 'x') };
+    CPPUNIT_ASSERT ( AhoCorasick::fits(literals) );
+    literals.push_back("y");
+    CPPUNIT_ASSERT ( !AhoCorasick::fits(literals) );
+    CPPUNIT_ASSERT_THROW ( AhoCorasick(literals, { 0, 1, 2 }),
+                           std::length_error );
+  }
+
+  void test_dfa_search_all()
+  {
+    // The tags of all the patterns matching, not only of the first one
+    LazyDfa dfa(compile_program({ "a+b", "^b", "c\\d", "b$" }, { 0, 1, 2, 3 },
+                                { false, false, false, false }), false);
+    tag_set_t matched;
+    matched.contains.resize(4, false);
+    std::string text = "b aab c1";
+    dfa.search_all(text.data(), text.size(), matched);
+    std::vector<int> tags = matched.tags;
+    std::sort(tags.begin(), tags.end());
+    CPPUNIT_ASSERT ( (tags == std::vector<int>{ 0, 1, 2 }) );
+    // Each pattern has its own case sensitivity
+    LazyDfa folded(compile_program({ "ab", "cd" }, { 0, 1 }, { true, false }),
+                   false);
+    matched.clear();
+    text = "AB CD";
+    folded.search_all(text.data(), text.size(), matched);
+    CPPUNIT_ASSERT ( (matched.tags == std::vector<int>{ 0 }) );
+  }
+};
@@ -0,0 +1,168 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <unistd.h>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "buffer_model.h"
+
+// Lines of the file filtered, several blocks of the FilterEngine
+#define BLOCK_TEST_LINES 30000
+// Time the FilterEngine is given to filter the file
+#define BLOCK_TEST_TIMEOUT_MS 20000
+
+class BlockSearchTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( BlockSearchTest );
+  CPPUNIT_TEST( test_get_block );
+  CPPUNIT_TEST( test_can_search_blocks );
+  CPPUNIT_TEST( test_block_search );
+  CPPUNIT_TEST( test_block_search_and );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+    char path[] = "/tmp/ggrep_block_XXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT ( fd != -1 );
+    close(fd);
+    m_path = path;
+    // Short lines of a few words, so the blocks hold many lines
+    const char *words[] = { "foo", "bar", "baz", "x", "12", "timeout", "o",
+                            "ERROR", "a", "" };
+    std::mt19937 random(2018);
+    std::ofstream file(m_path);
+    for (int i = 0; i < BLOCK_TEST_LINES; ++i) {
+      std::string line;
+      for (int j = random() % 5; j > 0; --j) {
+        if (!line.empty() || random() % 2) line += ' ';
+        line += words[random() % 10];
+      }
+      file << line << '\n';
+    }
+  }
+
+  void tearDown()
+  {
+    unlink(m_path.c_str());
+  }
+
+  void test_get_block()
+  {
+    std::ofstream(m_path) << "a\nbb\n\nccc\n";
+    FileBuffer buffer(m_path);
+    while (buffer.load_more());
+    // The lines with the end of line characters between them
+    line_t block = buffer.get_block(1, 4);
+    CPPUNIT_ASSERT_EQUAL ( std::string("bb\n\nccc"),
+                           std::string(block.text, block.length) );
+    CPPUNIT_ASSERT ( block.text == buffer.get_line(1).text );
+    block = buffer.get_block(0, 1);
+    CPPUNIT_ASSERT_EQUAL ( std::string("a"),
+                           std::string(block.text, block.length) );
+  }
+
+  void test_can_search_blocks()
+  {
+    CPPUNIT_ASSERT ( Matcher::compile("foo")->can_search_blocks() );
+    CPPUNIT_ASSERT ( Matcher::compile("a\\s+x")->can_search_blocks() );
+    CPPUNIT_ASSERT ( Matcher::compile("[a-z]+ x")->can_search_blocks() );
+    // The anchors would match at the ends of the block, not of the lines
+    CPPUNIT_ASSERT ( !Matcher::compile("^foo")->can_search_blocks() );
+    CPPUNIT_ASSERT ( !Matcher::compile("foo$")->can_search_blocks() );
+    CPPUNIT_ASSERT ( !Matcher::compile("[^x]*baz")->can_search_blocks() );
+    // A lookahead of std::regex may look at the next line
+    CPPUNIT_ASSERT ( !Matcher::compile("(?=bar)b")->can_search_blocks() );
+  }
+
+  /*
+   * Filter the file with filters, ANDed if land, and check the lines
+   * filtered are the lines matching the filters one by one
+   */
+  void check_filtering(const std::vector<std::string> &filters, bool land)
+  {
+    std::vector<std::shared_ptr<Matcher> > matchers;
+    for (const std::string &filter: filters)
+      matchers.push_back(Matcher::compile(filter));
+    FileBuffer file_buffer(m_path);
+    while (file_buffer.load_more());
+    std::vector<std::string> expected;
+    for (lineno_t i = 0; i < file_buffer.get_number_of_line(); ++i) {
+      line_t line = file_buffer.get_line(i);
+      bool matched = land;
+      uint start_pos, end_pos;
+      for (const auto &matcher: matchers) {
+        if (matcher->search(line.text, line.text + line.length, start_pos,
+                            end_pos) != land) {
+          matched = !land;
+          break;
+        }
+      }
+      if (matched) expected.push_back(std::string(line.text, line.length));
+    }
+    BufferModel model(std::make_shared<FileBuffer>(m_path));
+    while (model.get_loading_progress() != 100)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    model.enable_filtering();
+    model.set_filter_set().update().land = land;
+    model.add_filters(filters);
+    // The lines are filtered in the background
+    std::vector<std::string> filtered;
+    auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(BLOCK_TEST_TIMEOUT_MS);
+    do {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      std::shared_ptr<IBuffer> buffer = model.get_current_buffer();
+      filtered.clear();
+      for (lineno_t i = 0; i < buffer->get_number_of_line(); ++i) {
+        line_t line = buffer->get_line(i);
+        filtered.push_back(std::string(line.text, line.length));
+      }
+    } while (filtered != expected &&
+             std::chrono::steady_clock::now() < deadline);
+    CPPUNIT_ASSERT_EQUAL ( expected.size(), filtered.size() );
+    CPPUNIT_ASSERT ( filtered == expected );
+  }
+
+  void test_block_search()
+  {
+    check_filtering({ "foo" }, false);
+    check_filtering({ "ERROR" }, false);
+    check_filtering({ "\\d+" }, false);
+    check_filtering({ "ba[rz] 12" }, false);
+    // Anchored, searched line by line
+    check_filtering({ "^foo" }, false);
+    check_filtering({ "foo$" }, false);
+    // Matches found across the end of a line are not matches of the line
+    check_filtering({ "o b" }, false);
+    check_filtering({ "a\\s+x" }, false);
+    check_filtering({ "[a-z ]*baz" }, false);
+    check_filtering({ "[^x]*baz" }, false);
+    // Empty matches
+    check_filtering({ "x*" }, false);
+  }
+
+  void test_block_search_and()
+  {
+    check_filtering({ "foo", "bar" }, true);
+    check_filtering({ "foo", "^bar" }, true);
+    check_filtering({ "^foo", "bar$" }, true);
+    check_filtering({ "timeout", "\\s" }, true);
+  }
+
+private:
+  std::string m_path;
+};
@@ -0,0 +1,173 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <unistd.h>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "buffer.h"
+#include "processor.h"
+#include "buffer_model.h"
+
+/*
+ * Buffer of nb_lines lines recording the hints it is given. The lines are
+ * line_size bytes apart in memory, or all the same if line_size is 0.
+ */
+class RecordingBuffer : public Buffer {
+public:
+  RecordingBuffer(lineno_t nb_lines, size_t line_size = 0) :
+    m_nb_lines(nb_lines), m_line_size(line_size),
+    m_text(nb_lines * line_size, 'x') {}
+  bool is_binary() { return false; }
+  line_t get_line(lineno_t i) const {
+    if (m_line_size == 0) return line_t("line", 4);
+    return line_t(m_text.data() + i * m_line_size, 1);
+  }
+  lineno_t get_number_of_line() const { return m_nb_lines; }
+  void set_number_of_line(lineno_t) {}
+  void advise(access_e access) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_advices.push_back(access);
+  }
+  void prefetch(lineno_t i, lineno_t count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_prefetches.push_back(std::make_pair(i, count));
+  }
+  std::vector<access_e> advices() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_advices;
+  }
+  std::vector< std::pair<lineno_t, lineno_t> > prefetches() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_prefetches;
+  }
+
+private:
+  lineno_t                                      m_nb_lines;
+  size_t                                        m_line_size;
+  std::vector<char>                             m_text;
+  std::mutex                                    m_mutex;
+  std::vector<access_e>                         m_advices;
+  std::vector< std::pair<lineno_t, lineno_t> >  m_prefetches;
+};
+
+class BufferModelTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( BufferModelTest );
+  CPPUNIT_TEST( test_scan_advice );
+  CPPUNIT_TEST( test_prefetch );
+  CPPUNIT_TEST( test_scan_guard );
+  CPPUNIT_TEST( test_filtered_prefetch );
+  CPPUNIT_TEST( test_highlight_published );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+    m_buffer = std::make_shared<RecordingBuffer>(100000);
+    std::shared_ptr<IBuffer> buffer = m_buffer;
+    m_model.reset(new BufferModel(std::move(buffer)));
+    // The loader scans the buffer once, then the model is idle
+    for (int i = 0; i < 500 && m_buffer->advices().size() < 2; ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  void tearDown()
+  {
+    m_model.reset();
+  }
+
+  void test_scan_advice()
+  {
+    std::vector<access_e> expected = {
+      access_e::SEQUENTIAL_ACCESS, access_e::RANDOM_ACCESS
+    };
+    CPPUNIT_ASSERT ( m_buffer->advices() == expected );
+    // Only the first scan starting and the last one ending change the advice
+    m_model->begin_scan();
+    m_model->begin_scan();
+    m_model->end_scan();
+    CPPUNIT_ASSERT_EQUAL ( (size_t) 3, m_buffer->advices().size() );
+    m_model->end_scan();
+    expected.insert(expected.end(), expected.begin(), expected.end());
+    CPPUNIT_ASSERT ( m_buffer->advices() == expected );
+  }
+
+  void test_prefetch()
+  {
+    // The lines around the first line displayed, clipped at the beginning
+    m_model->set_first_line_displayed(2000);
+    m_model->set_first_line_displayed(100);
+    std::vector< std::pair<lineno_t, lineno_t> > expected = {
+      std::make_pair(2000 - BUFFER_PREFETCH_LINES, 3 * BUFFER_PREFETCH_LINES),
+      std::make_pair(0, 100 + 2 * BUFFER_PREFETCH_LINES)
+    };
+    CPPUNIT_ASSERT ( m_buffer->prefetches() == expected );
+  }
+
+  void test_scan_guard()
+  {
+    {
+      ScanGuard scan(*m_model);
+      scan.begin();
+      scan.begin();
+      CPPUNIT_ASSERT_EQUAL ( (size_t) 3, m_buffer->advices().size() );
+      scan.end();
+      scan.end();
+      CPPUNIT_ASSERT_EQUAL ( (size_t) 4, m_buffer->advices().size() );
+      // A processor interrupted while scanning
+      scan.begin();
+    }
+    std::vector<access_e> advices = m_buffer->advices();
+    CPPUNIT_ASSERT_EQUAL ( (size_t) 6, advices.size() );
+    CPPUNIT_ASSERT ( advices.back() == access_e::RANDOM_ACCESS );
+  }
+
+  void test_filtered_prefetch()
+  {
+    long page_size = sysconf(_SC_PAGESIZE);
+    std::shared_ptr<RecordingBuffer> recording =
+      std::make_shared<RecordingBuffer>(64, page_size / 4);
+    std::shared_ptr<IBuffer> buffer = recording;
+    FilteredBuffer filtered(buffer);
+    // Lines of the same page or of the next one are prefetched together
+    const lineno_t lines[] = { 1, 2, 6, 7, 20, 21, 22, 40, 9 };
+    filtered.add_lines(lines, 9);
+    filtered.prefetch(0, 9);
+    std::vector< std::pair<lineno_t, lineno_t> > expected = {
+      std::make_pair(1, 7), std::make_pair(20, 3), std::make_pair(40, 1),
+      std::make_pair(9, 1)
+    };
+    CPPUNIT_ASSERT ( recording->prefetches() == expected );
+  }
+
+  void test_highlight_published()
+  {
+    line_t line("line", 4);
+    Highlighter &highlighter = m_model->get_highlighter();
+    m_model->new_filtered_buffer({ Matcher::compile("li") });
+    m_model->publish_filtered_buffer();
+    CPPUNIT_ASSERT_EQUAL ( 0u, highlighter.get_spans(0, line)[0].start_pos );
+    // The lines displayed are the ones of the previous filters until the new
+    // ones are published
+    m_model->new_filtered_buffer({ Matcher::compile("ne") });
+    CPPUNIT_ASSERT_EQUAL ( 0u, highlighter.get_spans(0, line)[0].start_pos );
+    m_model->publish_filtered_buffer();
+    CPPUNIT_ASSERT_EQUAL ( 2u, highlighter.get_spans(0, line)[0].start_pos );
+  }
+
+private:
+  std::shared_ptr<RecordingBuffer>  m_buffer;
+  std::unique_ptr<BufferModel>      m_model;
+};
@@ -0,0 +1,79 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <thread>
+#include <atomic>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "chunked_array.h"
+
+class ChunkedArrayTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( ChunkedArrayTest );
+  CPPUNIT_TEST( test_push_back );
+  CPPUNIT_TEST( test_clear );
+  CPPUNIT_TEST( test_concurrent_read );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  void test_push_back()
+  {
+    // Blocks of 4 elements, enough of them to grow the table of blocks
+    ChunkedArray<size_t, 2> array;
+    CPPUNIT_ASSERT ( array.empty() );
+    for (size_t i = 0; i < 1000; ++i) array.push_back(i * 3);
+    CPPUNIT_ASSERT_EQUAL ( (size_t) 1000, array.size() );
+    for (size_t i = 0; i < 1000; ++i)
+      CPPUNIT_ASSERT_EQUAL ( i * 3, array[i] );
+    // The elements published can be modified by the writer
+    array[5] = 1;
+    CPPUNIT_ASSERT_EQUAL ( (size_t) 1, array[5] );
+  }
+
+  void test_clear()
+  {
+    ChunkedArray<int, 2> array;
+    for (int i = 0; i < 10; ++i) array.push_back(i);
+    size_t memory = array.memory_size();
+    array.clear();
+    CPPUNIT_ASSERT ( array.empty() );
+    // The memory is reused
+    for (int i = 0; i < 10; ++i) array.push_back(-i);
+    CPPUNIT_ASSERT_EQUAL ( memory, array.memory_size() );
+    CPPUNIT_ASSERT_EQUAL ( -9, array[9] );
+  }
+
+  void test_concurrent_read()
+  {
+    // A reader checks every element published while the writer grows the
+    // array block after block
+    ChunkedArray<size_t, 4> array;
+    const size_t nb_elements = 1000000;
+    std::atomic<bool> failed(false);
+    std::thread reader([&array, &failed, nb_elements]() {
+      size_t checked = 0;
+      while (checked < nb_elements) {
+        size_t size = array.size();
+        for (; checked < size; ++checked)
+          if (array[checked] != checked * 7) failed = true;
+      }
+    });
+    for (size_t i = 0; i < nb_elements; ++i) array.push_back(i * 7);
+    reader.join();
+    CPPUNIT_ASSERT ( !failed );
+  }
+};
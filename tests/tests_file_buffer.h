@@ -0,0 +1,189 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <string>
+#include <fstream>
+#include <unistd.h>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "buffer.h"
+
+class FileBufferTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( FileBufferTest );
+  CPPUNIT_TEST( test_lines );
+  CPPUNIT_TEST( test_last_line );
+  CPPUNIT_TEST( test_empty_file );
+  CPPUNIT_TEST( test_invalid_files );
+  CPPUNIT_TEST( test_load_more );
+  CPPUNIT_TEST( test_follow );
+  CPPUNIT_TEST( test_follow_empty_file );
+  CPPUNIT_TEST( test_follow_truncated );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+    char path[] = "/tmp/ggrep_file_XXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT ( fd != -1 );
+    close(fd);
+    m_path = path;
+  }
+
+  void tearDown()
+  {
+    unlink(m_path.c_str());
+  }
+
+  void write(const std::string &content)
+  {
+    std::ofstream(m_path, std::ios::binary) << content;
+  }
+
+  void append(const std::string &content)
+  {
+    std::ofstream(m_path, std::ios::binary | std::ios::app) << content;
+  }
+
+  /* Load a followed file until it has nb_lines lines. Gives up after a few
+     seconds. */
+  static bool follow(FileBuffer &buffer, lineno_t nb_lines)
+  {
+    for (int i = 0; i < 50 && buffer.get_number_of_line() < nb_lines; ++i)
+      buffer.load_more();
+    return buffer.get_number_of_line() == nb_lines;
+  }
+
+  /* Index the whole file */
+  static void load(FileBuffer &buffer)
+  {
+    while (buffer.load_more());
+  }
+
+  static std::string text(const line_t &line)
+  {
+    return std::string(line.text, line.length);
+  }
+
+  void test_lines()
+  {
+    (*this).write("a\nbb\r\n\nccc\n");
+    FileBuffer buffer(m_path);
+    load(buffer);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 4, buffer.get_number_of_line() );
+    CPPUNIT_ASSERT_EQUAL ( std::string("a"), text(buffer.get_line(0)) );
+    // The \r of the DOS line endings is not part of the line
+    CPPUNIT_ASSERT_EQUAL ( std::string("bb"), text(buffer.get_line(1)) );
+    CPPUNIT_ASSERT_EQUAL ( std::string(""), text(buffer.get_line(2)) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("ccc"), text(buffer.get_line(3)) );
+    // The lines are views into the mapping of the file
+    CPPUNIT_ASSERT ( buffer.get_line(1).text == buffer.get_line(0).text + 2 );
+    CPPUNIT_ASSERT ( buffer.get_line(3).text == buffer.get_line(0).text + 7 );
+  }
+
+  void test_last_line()
+  {
+    // The last line is not terminated by a \n
+    (*this).write("a\nlast");
+    FileBuffer buffer(m_path);
+    load(buffer);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 2, buffer.get_number_of_line() );
+    CPPUNIT_ASSERT_EQUAL ( std::string("last"), text(buffer.get_line(1)) );
+  }
+
+  void test_empty_file()
+  {
+    FileBuffer buffer(m_path);
+    load(buffer);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 0, buffer.get_number_of_line() );
+  }
+
+  void test_invalid_files()
+  {
+    (*this).write(std::string("text\0binary", 11));
+    CPPUNIT_ASSERT_THROW ( FileBuffer buffer(m_path), OpenFileException );
+    CPPUNIT_ASSERT_THROW ( FileBuffer buffer(m_path + ".none"),
+                           OpenFileException );
+    CPPUNIT_ASSERT_THROW ( FileBuffer buffer("/tmp"), OpenFileException );
+  }
+
+  void test_load_more()
+  {
+    // Lines of 16 characters, a few times the size of the first block
+    const lineno_t nb_lines = 3 * FIRST_LOAD_BLOCK_SIZE / 16 + 5;
+    std::string content;
+    for (lineno_t i = 0; i < nb_lines; ++i) {
+      std::string number = std::to_string(i);
+      content += std::string(15 - number.size(), '0') + number + "\n";
+    }
+    (*this).write(content);
+    FileBuffer buffer(m_path);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 0, buffer.get_number_of_line() );
+    CPPUNIT_ASSERT_EQUAL ( 0u, buffer.get_loading_progress() );
+    // Only the head of the file is indexed by the first call
+    CPPUNIT_ASSERT ( buffer.load_more() );
+    lineno_t head = buffer.get_number_of_line();
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) FIRST_LOAD_BLOCK_SIZE / 16, head );
+    CPPUNIT_ASSERT ( buffer.get_loading_progress() < 100 );
+    CPPUNIT_ASSERT_EQUAL ( std::string("000000000000000"),
+                           text(buffer.get_line(0)) );
+    CPPUNIT_ASSERT_EQUAL ( content.substr((head - 1) * 16, 15),
+                           text(buffer.get_line(head - 1)) );
+    load(buffer);
+    CPPUNIT_ASSERT_EQUAL ( nb_lines, buffer.get_number_of_line() );
+    CPPUNIT_ASSERT_EQUAL ( 100u, buffer.get_loading_progress() );
+    for (lineno_t i = 0; i < nb_lines; i += 997)
+      CPPUNIT_ASSERT_EQUAL ( content.substr(i * 16, 15),
+                             text(buffer.get_line(i)) );
+    CPPUNIT_ASSERT ( !buffer.load_more() );
+  }
+
+  void test_follow()
+  {
+    (*this).write("a\nb\npart");
+    FileBuffer buffer(m_path, true);
+    // The unterminated last line is not published yet
+    CPPUNIT_ASSERT ( follow(buffer, 2) );
+    const char *first = buffer.get_line(0).text;
+    (*this).append("ial\nc\n");
+    CPPUNIT_ASSERT ( follow(buffer, 4) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("partial"), text(buffer.get_line(2)) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("c"), text(buffer.get_line(3)) );
+    // The mapping grew in place, the views handed out are still valid
+    CPPUNIT_ASSERT ( buffer.get_line(0).text == first );
+    // Still following
+    CPPUNIT_ASSERT ( buffer.load_more() );
+  }
+
+  void test_follow_empty_file()
+  {
+    FileBuffer buffer(m_path, true);
+    CPPUNIT_ASSERT ( follow(buffer, 0) );
+    (*this).append("first\n");
+    CPPUNIT_ASSERT ( follow(buffer, 1) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("first"), text(buffer.get_line(0)) );
+  }
+
+  void test_follow_truncated()
+  {
+    (*this).write("a\nb\n");
+    FileBuffer buffer(m_path, true);
+    CPPUNIT_ASSERT ( follow(buffer, 2) );
+    // e.g. log rotation: following stops, the lines indexed are kept
+    (*this).write("c\n");
+    bool following = true;
+    for (int i = 0; i < 50 && following; ++i) following = buffer.load_more();
+    CPPUNIT_ASSERT ( !following );
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 2, buffer.get_number_of_line() );
+  }
+
+private:
+  std::string m_path;
+};
@@ -0,0 +1,472 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "buffer.h"
+#include "processor.h"
+#include "buffer_model.h"
+
+/*
+ * Buffer holding its lines in memory
+ */
+class LinesBuffer : public Buffer {
+public:
+  LinesBuffer(const std::vector<std::string> &lines) : m_lines(lines) {}
+  bool is_binary() { return false; }
+  line_t get_line(lineno_t i) const {
+    return line_t(m_lines[i].data(), m_lines[i].size());
+  }
+  lineno_t get_number_of_line() const { return m_lines.size(); }
+  void set_number_of_line(lineno_t) {}
+
+private:
+  std::vector<std::string> m_lines;
+};
+
+/*
+ * LinesBuffer counting the lines read by the other threads than the one which
+ * created it, e.g. by the workers filtering it
+ */
+class CountingBuffer : public LinesBuffer {
+public:
+  CountingBuffer(const std::vector<std::string> &lines) : LinesBuffer(lines),
+    m_owner(std::this_thread::get_id()), m_nb_reads(0) {}
+  line_t get_line(lineno_t i) const {
+    if (std::this_thread::get_id() != m_owner) ++m_nb_reads;
+    return LinesBuffer::get_line(i);
+  }
+  inline size_t exchange_reads() { return m_nb_reads.exchange(0); }
+
+private:
+  std::thread::id             m_owner;
+  mutable std::atomic<size_t> m_nb_reads;
+};
+
+/* Wait for condition to become true, a few seconds at most */
+static bool wait_for(std::function<bool()> condition)
+{
+  for (int i = 0; i < 1000 && !condition(); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  return condition();
+}
+
+class FilterEngineTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( FilterEngineTest );
+  CPPUNIT_TEST( test_worker_pool );
+  CPPUNIT_TEST( test_worker_pool_concurrency );
+  CPPUNIT_TEST( test_worker_pool_drop );
+  CPPUNIT_TEST( test_shared_workers );
+  CPPUNIT_TEST( test_filter );
+  CPPUNIT_TEST( test_refilter );
+  CPPUNIT_TEST( test_switch_filter_type );
+  CPPUNIT_TEST( test_record_and );
+  CPPUNIT_TEST( test_scan_orders );
+  CPPUNIT_TEST( test_viewport_kept );
+  CPPUNIT_TEST( test_view_locked );
+  CPPUNIT_TEST( test_burst );
+  CPPUNIT_TEST( test_notification_rate );
+  CPPUNIT_TEST( test_remove_all_filters );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+    // Enough lines for many shards, a few of them matching
+    std::vector<std::string> lines;
+    for (lineno_t i = 0; i < 300000; ++i)
+      lines.push_back("line " + std::to_string(i) +
+                      ((i % 7 == 3) ? " match" : " other"));
+    m_lines = lines;
+    std::shared_ptr<IBuffer> buffer = std::make_shared<LinesBuffer>(lines);
+    m_model.reset(new BufferModel(std::move(buffer)));
+  }
+
+  void tearDown()
+  {
+    m_model.reset();
+  }
+
+  /* Wait for the filtered view to hold the lines of m_lines accepted by
+     predicate, and check them in order */
+  void check_filtered(std::function<bool(lineno_t)> predicate)
+  {
+    std::vector<std::string> expected;
+    for (lineno_t i = 0; i < m_lines.size(); ++i)
+      if (predicate(i)) expected.push_back(m_lines[i]);
+    BufferModel &model = *m_model;
+    CPPUNIT_ASSERT ( wait_for([&model, &expected]() {
+      return model.get_number_of_line() == expected.size() &&
+        model.get_filter_processing_progress() == 100;
+    }) );
+    // The lines of a single snapshot of the filtered lines
+    std::shared_ptr<IBuffer> buffer = m_model->get_current_buffer();
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) expected.size(),
+                           buffer->get_number_of_line() );
+    for (lineno_t i = 0; i < expected.size(); ++i) {
+      line_t line = buffer->get_line(i);
+      CPPUNIT_ASSERT_EQUAL ( expected[i],
+                             std::string(line.text, line.length) );
+    }
+  }
+
+  void test_worker_pool()
+  {
+    std::atomic<int> sum(0);
+    {
+      WorkerPool pool(4);
+      CPPUNIT_ASSERT_EQUAL ( 4u, pool.get_number_of_workers() );
+      for (int i = 1; i <= 1000; ++i) pool.submit([&sum, i](unsigned) { sum += i; });
+      CPPUNIT_ASSERT ( wait_for([&sum]() { return sum == 500500; }) );
+    }
+    CPPUNIT_ASSERT_EQUAL ( 500500, sum.load() );
+  }
+
+  void test_worker_pool_concurrency()
+  {
+    // Each task waits for all the others to start: they only complete if
+    // they run on all the workers at the same time
+    WorkerPool pool(4);
+    std::atomic<int> started(0);
+    std::atomic<int> done(0);
+    // Each task is given the index of its worker
+    std::atomic<int> workers(0);
+    for (int i = 0; i < 4; ++i) {
+      pool.submit([&started, &done, &workers](unsigned worker) {
+        if (worker < 4) workers |= 1 << worker;
+        ++started;
+        wait_for([&started]() { return started == 4; });
+        if (started == 4) ++done;
+      });
+    }
+    CPPUNIT_ASSERT ( wait_for([&done]() { return done == 4; }) );
+    CPPUNIT_ASSERT_EQUAL ( 0xf, workers.load() );
+  }
+
+  void test_worker_pool_drop()
+  {
+    WorkerPool pool(1);
+    int owner = 0;
+    int other = 0;
+    std::atomic<bool> started(false);
+    std::atomic<bool> release(false);
+    std::atomic<int> executed(0);
+    std::atomic<int> others(0);
+    pool.submit([&started, &release, &executed](unsigned) {
+      started = true;
+      wait_for([&release]() { return release.load(); });
+      ++executed;
+    }, &owner);
+    for (int i = 0; i < 10; ++i)
+      pool.submit([&executed](unsigned) { ++executed; }, &owner);
+    pool.submit([&others](unsigned) { ++others; }, &other);
+    CPPUNIT_ASSERT ( wait_for([&started]() { return started.load(); }) );
+    // The queued tasks of the owner are dropped and the running one waited for
+    std::thread releaser([&release]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      release = true;
+    });
+    pool.drop(&owner);
+    releaser.join();
+    CPPUNIT_ASSERT_EQUAL ( 1, executed.load() );
+    // The tasks of the other owners are kept
+    CPPUNIT_ASSERT ( wait_for([&others]() { return others == 1; }) );
+  }
+
+  void test_shared_workers()
+  {
+    // The buffers share the workers, each one getting the lines matching its
+    // own filters, even when another one is closed while it is filtered
+    std::shared_ptr<WorkerPool> workers = std::make_shared<WorkerPool>(2);
+    std::shared_ptr<IBuffer> buffer = std::make_shared<LinesBuffer>(m_lines);
+    m_model.reset(new BufferModel(std::move(buffer), nullptr, workers));
+    std::unique_ptr<BufferModel> closed;
+    for (int i = 0; i < 2; ++i) {
+      buffer = std::make_shared<LinesBuffer>(m_lines);
+      closed.reset(new BufferModel(std::move(buffer), nullptr, workers));
+      closed->add_filter("other");
+      closed->enable_filtering();
+      if (i == 0) m_model->add_filter("match");
+      m_model->enable_filtering();
+    }
+    closed.reset();
+    check_filtered([](lineno_t i) { return i % 7 == 3; });
+    m_model->update_last_filter("1 other");
+    check_filtered([](lineno_t i) { return i % 7 != 3 && i % 10 == 1; });
+  }
+
+  void test_filter()
+  {
+    // The matches of all the shards are merged in the order of the lines
+    m_model->add_filter("match");
+    m_model->enable_filtering();
+    check_filtered([](lineno_t i) { return i % 7 == 3; });
+  }
+
+  void test_refilter()
+  {
+    m_model->add_filter("match");
+    m_model->enable_filtering();
+    check_filtered([](lineno_t i) { return i % 7 == 3; });
+    // The previous results are replaced
+    m_model->update_last_filter("5 match");
+    check_filtered([](lineno_t i) { return i % 7 == 3 && i % 10 == 5; });
+    m_model->remove_last_filter();
+    m_model->add_filter("^line 1");
+    check_filtered([this](lineno_t i) {
+      return m_lines[i].compare(0, 6, "line 1") == 0;
+    });
+  }
+
+  void test_switch_filter_type()
+  {
+    // The lines matched by each filter of the set are recorded while the set
+    // is ORed, then combined for the other sets of these filters
+    m_model->add_filter("match");
+    m_model->add_filter("5 ");
+    m_model->enable_filtering();
+    std::vector<std::string> &lines = m_lines;
+    auto has = [&lines](lineno_t i, const char *text) {
+      return lines[i].find(text) != std::string::npos;
+    };
+    check_filtered([&has](lineno_t i) {
+      return has(i, "match") || has(i, "5 ");
+    });
+    m_model->set_filter_set().update().land = true;
+    m_model->m_filter.signal();
+    check_filtered([&has](lineno_t i) {
+      return has(i, "match") && has(i, "5 ");
+    });
+    m_model->remove_last_filter();
+    check_filtered([&has](lineno_t i) { return has(i, "match"); });
+  }
+
+  void test_record_and()
+  {
+    // The lines matched by each filter of a set ANDed are recorded when the
+    // filters are searched in blocks, then combined for the other sets of
+    // these filters without reading the lines again
+    std::shared_ptr<CountingBuffer> counting =
+      std::make_shared<CountingBuffer>(m_lines);
+    std::shared_ptr<IBuffer> buffer = counting;
+    m_model.reset(new BufferModel(std::move(buffer)));
+    m_model->enable_filtering();
+    m_model->set_filter_set().update().land = true;
+    m_model->add_filters({ "match", "5 " });
+    std::vector<std::string> &lines = m_lines;
+    auto has = [&lines](lineno_t i, const char *text) {
+      return lines[i].find(text) != std::string::npos;
+    };
+    check_filtered([&has](lineno_t i) {
+      return has(i, "match") && has(i, "5 ");
+    });
+    counting->exchange_reads();
+    m_model->set_filter_set().update().land = false;
+    m_model->m_filter.signal();
+    check_filtered([&has](lineno_t i) {
+      return has(i, "match") || has(i, "5 ");
+    });
+    CPPUNIT_ASSERT_EQUAL ( (size_t) 0, counting->exchange_reads() );
+    // Not with a filter searched line by line, the plan is not slowed down by
+    // searching every filter
+    counting = std::make_shared<CountingBuffer>(m_lines);
+    buffer = counting;
+    m_model.reset(new BufferModel(std::move(buffer)));
+    m_model->enable_filtering();
+    m_model->set_filter_set().update().land = true;
+    m_model->add_filters({ "match", "^line 1" });
+    auto first = [this](lineno_t i) {
+      return m_lines[i].compare(0, 6, "line 1") == 0;
+    };
+    check_filtered([&has, &first](lineno_t i) {
+      return has(i, "match") && first(i);
+    });
+    counting->exchange_reads();
+    m_model->set_filter_set().update().land = false;
+    m_model->m_filter.signal();
+    check_filtered([&has, &first](lineno_t i) {
+      return has(i, "match") || first(i);
+    });
+    CPPUNIT_ASSERT ( counting->exchange_reads() > 0 );
+  }
+
+  void test_scan_orders()
+  {
+    // Whichever line the filtering starts from, the matches are in order
+    const scan_order_e orders[] = { scan_order_e::FORWARD,
+      scan_order_e::TAIL_FIRST, scan_order_e::VIEWPORT_FIRST };
+    for (scan_order_e order: orders) {
+      (*this).tearDown();
+      (*this).setUp();
+      m_model->m_filter.set_scan_order(order);
+      m_model->set_first_line_displayed(m_lines.size() / 2);
+      m_model->add_filter("match");
+      m_model->enable_filtering();
+      check_filtered([](lineno_t i) { return i % 7 == 3; });
+      m_model->update_last_filter("[13] match");
+      check_filtered([](lineno_t i) {
+        return i % 7 == 3 && (i % 10 == 1 || i % 10 == 3);
+      });
+    }
+  }
+
+  /* First line of m_lines from first accepted by predicate */
+  lineno_t first_filtered(lineno_t first,
+                          std::function<bool(lineno_t)> predicate)
+  {
+    while (first < m_lines.size() && !predicate(first)) ++first;
+    return first;
+  }
+
+  void test_viewport_kept()
+  {
+    // The lines filtered before the line displayed are added in front of the
+    // others, and the view is shifted so it keeps displaying the same line
+    auto matches = [](lineno_t i) { return i % 7 == 3; };
+    m_model->m_filter.set_scan_order(scan_order_e::VIEWPORT_FIRST);
+    m_model->set_first_line_displayed(m_lines.size() / 2);
+    m_model->add_filter("match");
+    m_model->enable_filtering();
+    check_filtered(matches);
+    lineno_t displayed = first_filtered(m_lines.size() / 2, matches);
+    CPPUNIT_ASSERT_EQUAL ( displayed, m_model->get_file_line_displayed() );
+    // And when the lines matched are filtered again by narrower filters, in
+    // order
+    m_model->update_last_filter("[13] match");
+    auto narrowed = [](lineno_t i) {
+      return i % 7 == 3 && (i % 10 == 1 || i % 10 == 3);
+    };
+    check_filtered(narrowed);
+    displayed = first_filtered(displayed, narrowed);
+    CPPUNIT_ASSERT_EQUAL ( displayed, m_model->get_file_line_displayed() );
+    // And after a filter change
+    m_model->update_last_filter("1 other");
+    auto changed = [](lineno_t i) { return i % 7 != 3 && i % 10 == 1; };
+    check_filtered(changed);
+    CPPUNIT_ASSERT_EQUAL ( first_filtered(displayed, changed),
+                           m_model->get_file_line_displayed() );
+  }
+
+  void test_view_locked()
+  {
+    // A view drawing while lines are added in front of the ones it displays
+    // keeps seeing the same line at the top
+    m_model->m_filter.set_scan_order(scan_order_e::VIEWPORT_FIRST);
+    m_model->set_first_line_displayed(m_lines.size() / 2);
+    m_model->add_filter("match");
+    std::atomic<bool> stopped(false);
+    std::vector<lineno_t> displayed;
+    BufferModel &model = *m_model;
+    std::thread view([&model, &stopped, &displayed]() {
+      while (!stopped) {
+        std::unique_lock<std::mutex> lock = model.lock_view();
+        std::shared_ptr<IBuffer> buffer = model.get_current_buffer();
+        lineno_t first_line = buffer->get_first_line_displayed();
+        if (first_line < buffer->get_number_of_line()) {
+          line_t line = buffer->get_line(first_line);
+          // The lines are "line <number> ..."
+          displayed.push_back(std::stoull(std::string(line.text + 5,
+                                                      line.length - 5)));
+        }
+      }
+    });
+    m_model->enable_filtering();
+    check_filtered([](lineno_t i) { return i % 7 == 3; });
+    stopped = true;
+    view.join();
+    // Once the line matched after the origin is displayed, it stays
+    lineno_t origin = first_filtered(m_lines.size() / 2,
+                                     [](lineno_t i) { return i % 7 == 3; });
+    auto first = std::find(displayed.begin(), displayed.end(), origin);
+    CPPUNIT_ASSERT ( first != displayed.end() );
+    CPPUNIT_ASSERT ( std::count(first, displayed.end(), origin) ==
+                     displayed.end() - first );
+  }
+
+  void test_burst()
+  {
+    m_model->add_filter("match");
+    m_model->enable_filtering();
+    // Typing a filter: only the last one counts, whatever the work of the
+    // previous ones abandoned on the way
+    const std::string typed = "9 match";
+    for (int round = 0; round < 3; ++round) {
+      for (size_t i = 1; i <= typed.size(); ++i)
+        m_model->update_last_filter(typed.substr(typed.size() - i));
+    }
+    check_filtered([](lineno_t i) { return i % 7 == 3 && i % 10 == 9; });
+    // The same with a pause longer than a burst between the changes
+    m_model->update_last_filter("match");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    m_model->update_last_filter("0 match");
+    check_filtered([](lineno_t i) { return i % 7 == 3 && i % 10 == 0; });
+  }
+
+  void test_notification_rate()
+  {
+    // Every line matches: the matches of each shard are added to the view
+    std::mutex mutex;
+    std::vector<std::chrono::steady_clock::time_point> times;
+    std::vector<lineno_t> numbers_of_line;
+    BufferModel &model = *m_model;
+    m_model->register_observer([&](IObservable &) {
+      std::lock_guard<std::mutex> lock(mutex);
+      times.push_back(std::chrono::steady_clock::now());
+      numbers_of_line.push_back(model.get_number_of_line());
+    });
+    m_model->add_filter("line");
+    m_model->enable_filtering();
+    check_filtered([](lineno_t) { return true; });
+    std::this_thread::sleep_for(
+      std::chrono::milliseconds(4 * BUFFER_FRAME_INTERVAL_MS));
+    std::lock_guard<std::mutex> lock(mutex);
+    // The last notification shows all the lines filtered
+    CPPUNIT_ASSERT ( !numbers_of_line.empty() );
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) m_lines.size(),
+                           numbers_of_line.back() );
+    // The notifications are a frame apart, but for the clearing of the view
+    // when the filtering is enabled and the last one of the filtering
+    int nb_close = 0;
+    for (size_t i = 1; i < times.size(); ++i) {
+      if (times[i] - times[i - 1] <
+          std::chrono::milliseconds(BUFFER_FRAME_INTERVAL_MS / 2))
+        ++nb_close;
+    }
+    CPPUNIT_ASSERT ( nb_close <= 2 );
+  }
+
+  void test_remove_all_filters()
+  {
+    // The filters are removed while the filtering thread rearms
+    m_model->enable_filtering();
+    for (int i = 0; i < 200; ++i) {
+      m_model->add_filter("match");
+      if (i % 20 == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      m_model->remove_last_filter();
+    }
+    m_model->add_filter("0 match");
+    check_filtered([](lineno_t i) { return i % 7 == 3 && i % 10 == 0; });
+  }
+
+private:
+  std::vector<std::string>      m_lines;
+  std::unique_ptr<BufferModel>  m_model;
+};
@@ -0,0 +1,194 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <regex>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "filter_plan.h"
+
+class FilterPlanTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( FilterPlanTest );
+  CPPUNIT_TEST( test_is_expression );
+  CPPUNIT_TEST( test_parse );
+  CPPUNIT_TEST( test_precedence );
+  CPPUNIT_TEST( test_invalid_expressions );
+  CPPUNIT_TEST( test_spans );
+  CPPUNIT_TEST( test_order_and );
+  CPPUNIT_TEST( test_order_or );
+  CPPUNIT_TEST( test_order_shared_with_clones );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  static bool matches(const Matcher &matcher, const std::string &line)
+  {
+    return matcher.matches(line.data(), line.data() + line.size());
+  }
+
+  /* The expression is given without its leading '?' */
+  static FilterPlan make_plan(const std::string &expression)
+  {
+    return FilterPlan(expression, filter_flags_t());
+  }
+
+  /* Match line nb_lines times with plan, which measures its patterns */
+  static void evaluate(const Matcher &plan, const std::string &line,
+                       int nb_lines)
+  {
+    for (int i = 0; i < nb_lines; ++i) matches(plan, line);
+  }
+
+  void test_is_expression()
+  {
+    CPPUNIT_ASSERT ( FilterPlan::is_expression("?foo & bar") );
+    CPPUNIT_ASSERT ( FilterPlan::is_expression("?") );
+    CPPUNIT_ASSERT ( !FilterPlan::is_expression("foo?") );
+    CPPUNIT_ASSERT ( !FilterPlan::is_expression("") );
+    // The expressions are compiled to plans
+    std::shared_ptr<Matcher> matcher = Matcher::compile("?foo & !bar");
+    CPPUNIT_ASSERT ( dynamic_cast<FilterPlan *>(matcher.get()) != nullptr );
+    CPPUNIT_ASSERT ( matches(*matcher, "foo baz") );
+    CPPUNIT_ASSERT ( !matches(*matcher, "foo bar") );
+  }
+
+  void test_parse()
+  {
+    FilterPlan plan = make_plan("ERROR & !(timeout | \"retry [0-9]+\")");
+    CPPUNIT_ASSERT ( matches(plan, "ERROR disk full") );
+    CPPUNIT_ASSERT ( !matches(plan, "ERROR timeout") );
+    CPPUNIT_ASSERT ( !matches(plan, "ERROR retry 3") );
+    CPPUNIT_ASSERT ( matches(plan, "ERROR retry now") );
+    CPPUNIT_ASSERT ( !matches(plan, "WARNING disk full") );
+    // A quoted pattern may contain spaces, operators and escaped quotes
+    FilterPlan quoted = make_plan("\"say \\\"a & b\\\"\"");
+    CPPUNIT_ASSERT ( matches(quoted, "they say \"a & b\"") );
+    CPPUNIT_ASSERT ( !matches(quoted, "they say a & b") );
+    // A word is a regex too
+    FilterPlan regex = make_plan("  a.c&!x+  ");
+    CPPUNIT_ASSERT ( matches(regex, "abc") );
+    CPPUNIT_ASSERT ( !matches(regex, "abc x") );
+    CPPUNIT_ASSERT ( matches(make_plan("!!foo"), "foo") );
+  }
+
+  void test_precedence()
+  {
+    // '&' binds tighter than '|'
+    FilterPlan plan = make_plan("a & b | c");
+    CPPUNIT_ASSERT ( matches(plan, "c") );
+    CPPUNIT_ASSERT ( matches(plan, "a b") );
+    CPPUNIT_ASSERT ( !matches(plan, "a") );
+    FilterPlan grouped = make_plan("a & (b | c)");
+    CPPUNIT_ASSERT ( !matches(grouped, "c") );
+    CPPUNIT_ASSERT ( matches(grouped, "a c") );
+    // '!' applies to the operand following it only
+    FilterPlan negated = make_plan("!a & b");
+    CPPUNIT_ASSERT ( matches(negated, "b") );
+    CPPUNIT_ASSERT ( !matches(negated, "a b") );
+    CPPUNIT_ASSERT ( !matches(negated, "c") );
+  }
+
+  void test_invalid_expressions()
+  {
+    const char *expressions[] = { "", "  ", "a &", "| a", "(a", "a)",
+                                  "\"a", "!", "a & ()", "\"\"", "a b" };
+    for (const char *expression: expressions)
+      CPPUNIT_ASSERT_THROW ( make_plan(expression), std::invalid_argument );
+    CPPUNIT_ASSERT_THROW ( make_plan("a & \"(b\""), std::regex_error );
+  }
+
+  static std::string span(const Matcher &matcher, const std::string &line)
+  {
+    uint start_pos, end_pos;
+    if (!matcher.search(line.data(), line.data() + line.size(), start_pos,
+                        end_pos))
+      return "-";
+    return line.substr(start_pos, end_pos - start_pos);
+  }
+
+  void test_spans()
+  {
+    // The last pattern of an AND, the first one matching of an OR, as written
+    CPPUNIT_ASSERT_EQUAL ( std::string("bar"),
+                           span(make_plan("fo+ & bar"), "bar foo") );
+    CPPUNIT_ASSERT_EQUAL ( std::string("foo"),
+                           span(make_plan("fo+ | bar"), "bar foo") );
+    CPPUNIT_ASSERT_EQUAL ( std::string("bar"),
+                           span(make_plan("x | bar"), "bar foo") );
+    CPPUNIT_ASSERT_EQUAL ( std::string("-"),
+                           span(make_plan("x | y"), "bar foo") );
+    // A negation has no span
+    CPPUNIT_ASSERT_EQUAL ( std::string(""),
+                           span(make_plan("!x"), "bar foo") );
+    CPPUNIT_ASSERT_EQUAL ( std::string("foo"),
+                           span(make_plan("foo & !x"), "bar foo") );
+    // The occurrences are the ones of the patterns not negated
+    FilterPlan plan = make_plan("o & !x");
+    std::string line = "foo o";
+    uint start_pos, end_pos;
+    CPPUNIT_ASSERT ( plan.search_from(line.data(), line.data() + line.size(),
+                                      line.data() + 3, start_pos, end_pos) );
+    CPPUNIT_ASSERT_EQUAL ( 4u, start_pos );
+    CPPUNIT_ASSERT_EQUAL ( 5u, end_pos );
+  }
+
+  void test_order_and()
+  {
+    // The pattern rarely true is evaluated first, it decides more often
+    FilterPlan plan = make_plan("common & rare");
+    CPPUNIT_ASSERT ( (plan.get_order() == std::vector<size_t>{ 0, 1 }) );
+    evaluate(plan, "common", 4 * PLAN_ORDER_INTERVAL);
+    CPPUNIT_ASSERT ( (plan.get_order() == std::vector<size_t>{ 1, 0 }) );
+    // The result does not depend on the order
+    CPPUNIT_ASSERT ( matches(plan, "rare common") );
+    CPPUNIT_ASSERT ( !matches(plan, "common") );
+    // A plan which is not an AND or an OR has a single operand
+    CPPUNIT_ASSERT ( (make_plan("!foo").get_order() ==
+                      std::vector<size_t>{ 0 }) );
+  }
+
+  void test_order_or()
+  {
+    // The pattern often true is evaluated first
+    FilterPlan plan = make_plan("rare | common");
+    evaluate(plan, "common", 4 * PLAN_ORDER_INTERVAL);
+    CPPUNIT_ASSERT ( (plan.get_order() == std::vector<size_t>{ 1, 0 }) );
+    CPPUNIT_ASSERT ( matches(plan, "rare") );
+    // The plans of several filters
+    FilterPlan filters({ Matcher::compile("common"), Matcher::compile("rare") },
+                       true);
+    CPPUNIT_ASSERT ( (filters.get_order() == std::vector<size_t>{ 0, 1 }) );
+    evaluate(filters, "common", 4 * PLAN_ORDER_INTERVAL);
+    CPPUNIT_ASSERT ( (filters.get_order() == std::vector<size_t>{ 1, 0 }) );
+  }
+
+  void test_order_shared_with_clones()
+  {
+    FilterPlan plan = make_plan("common & rare");
+    {
+      std::shared_ptr<Matcher> clone = plan.clone();
+      evaluate(*clone, "common", 4 * PLAN_ORDER_INTERVAL);
+    }
+    // What the clone measured is kept once it is destroyed
+    CPPUNIT_ASSERT ( (plan.get_order() == std::vector<size_t>{ 1, 0 }) );
+    std::shared_ptr<Matcher> clone = plan.clone();
+    CPPUNIT_ASSERT ( (static_cast<FilterPlan &>(*clone).get_order() ==
+                      std::vector<size_t>{ 1, 0 }) );
+  }
+};
@@ -0,0 +1,105 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "filter_set.h"
+
+class FilterSetTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( FilterSetTest );
+  CPPUNIT_TEST( test_pattern_is_narrower );
+  CPPUNIT_TEST( test_set_is_narrower );
+  CPPUNIT_TEST( test_pattern_is_narrower_flags );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  static filter_set_t make_set(const std::vector<std::string> &filters,
+                               bool land)
+  {
+    filter_set_t filter_set;
+    for (const std::string &filter: filters)
+      filter_set.filters.emplace_back(filter, nullptr);
+    filter_set.land = land;
+    filter_set.dynamic = false;
+    return filter_set;
+  }
+
+  void test_pattern_is_narrower()
+  {
+    CPPUNIT_ASSERT ( Matcher::is_narrower("foo", "foo") );
+    // A literal extended
+    CPPUNIT_ASSERT ( Matcher::is_narrower("foob", "foo") );
+    CPPUNIT_ASSERT ( Matcher::is_narrower("xfoo", "foo") );
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("fo", "foo") );
+    // A regex requiring a literal containing the previous one
+    CPPUNIT_ASSERT ( Matcher::is_narrower("xfoo.*bar", "foo") );
+    CPPUNIT_ASSERT ( Matcher::is_narrower("a\\.b+", "a\\.") );
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("fo.", "foo") );
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("bar|foo", "foo") );
+    // The previous regexes are not analyzed
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("foo", "f.o") );
+  }
+
+  void test_set_is_narrower()
+  {
+    filter_set_t previous = make_set({ "foo", "bar" }, false);
+    CPPUNIT_ASSERT ( is_narrower(make_set({ "foo", "bar" }, false),
+                                 previous) );
+    CPPUNIT_ASSERT ( is_narrower(make_set({ "foo", "barz" }, false),
+                                 previous) );
+    CPPUNIT_ASSERT ( !is_narrower(make_set({ "foo", "ba" }, false),
+                                  previous) );
+    // Filters ORed are not narrowed by another one
+    CPPUNIT_ASSERT ( !is_narrower(make_set({ "foo", "bar", "baz" }, false),
+                                  previous) );
+    CPPUNIT_ASSERT ( !is_narrower(make_set({ "foo" }, false), previous) );
+    // A filter ANDed narrows the set, a single filter is ANDed
+    CPPUNIT_ASSERT ( is_narrower(make_set({ "foo", "bar" }, true),
+                                 make_set({ "foo" }, false)) );
+    CPPUNIT_ASSERT ( is_narrower(make_set({ "foo", "bar", "baz" }, true),
+                                 make_set({ "foo", "bar" }, true)) );
+    CPPUNIT_ASSERT ( !is_narrower(make_set({ "foo", "bar" }, true),
+                                  previous) );
+    CPPUNIT_ASSERT ( !is_narrower(make_set({}, true), previous) );
+    CPPUNIT_ASSERT ( !is_narrower(make_set({ "foo" }, true),
+                                  make_set({}, true)) );
+  }
+
+  void test_pattern_is_narrower_flags()
+  {
+    CPPUNIT_ASSERT ( Matcher::is_narrower("(?i)foob", "(?i)foo") );
+    CPPUNIT_ASSERT ( Matcher::is_narrower("(?i)FOOB", "(?i)foo") );
+    // A string found in any case is not always found in the same case
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("(?i)foo", "foo") );
+    CPPUNIT_ASSERT ( Matcher::is_narrower("foo", "(?i)FOO") );
+    // A word contains the string
+    CPPUNIT_ASSERT ( Matcher::is_narrower("(?w)foo", "foo") );
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("foo", "(?w)foo") );
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("(?w)foob", "(?w)foo") );
+    // A fixed string is not a regex
+    CPPUNIT_ASSERT ( Matcher::is_narrower("(?f)a.b", "a\\.") );
+    CPPUNIT_ASSERT ( Matcher::is_narrower("a\\.b", "(?f)a.") );
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("a.b", "(?f)a.") );
+    CPPUNIT_ASSERT ( Matcher::is_narrower("(?f)?foo", "(?f)?fo") );
+    // The expressions are not analyzed
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("?foo & bar", "foo") );
+    CPPUNIT_ASSERT ( !Matcher::is_narrower("(?i)?foo", "(?i)?foo & x") );
+  }
+};
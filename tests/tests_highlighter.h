@@ -0,0 +1,107 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "highlighter.h"
+
+class HighlighterTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( HighlighterTest );
+  CPPUNIT_TEST( test_spans );
+  CPPUNIT_TEST( test_set_filters );
+  CPPUNIT_TEST( test_line_changed );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  static std::vector< std::shared_ptr<Matcher> > compile(
+    const std::vector<std::string> &patterns)
+  {
+    std::vector< std::shared_ptr<Matcher> > matchers;
+    for (const std::string &pattern: patterns)
+      matchers.push_back(Matcher::compile(pattern));
+    return matchers;
+  }
+
+  /* The spans as "start-end:filter" */
+  static std::string spans(Highlighter &highlighter, lineno_t line_index,
+                           const std::string &text)
+  {
+    std::string result;
+    for (const span_t &span: highlighter.get_spans(
+           line_index, line_t(text.data(), text.size()))) {
+      if (!result.empty()) result += ' ';
+      result += std::to_string(span.start_pos) + '-' +
+        std::to_string(span.end_pos) + ':' + std::to_string(span.filter);
+    }
+    return result;
+  }
+
+  void test_spans()
+  {
+    Highlighter highlighter;
+    highlighter.set_filters(compile({ "ab", "b+c", "x*" }));
+    // Every occurrence of every filter, by start position, the empty matches
+    // not highlighted
+    CPPUNIT_ASSERT_EQUAL ( std::string("0-2:0 1-3:1 3-5:0 6-9:1"),
+                           spans(highlighter, 0, "abcab bbc") );
+    CPPUNIT_ASSERT_EQUAL ( std::string("1-3:2"),
+                           spans(highlighter, 1, "-xx") );
+    CPPUNIT_ASSERT_EQUAL ( std::string(""), spans(highlighter, 2, "") );
+    // The occurrences of an expression are the ones of its patterns
+    highlighter.set_filters(compile({ "?a & !z" }));
+    CPPUNIT_ASSERT_EQUAL ( std::string("0-1:0 2-3:0"),
+                           spans(highlighter, 0, "aba") );
+  }
+
+  void test_set_filters()
+  {
+    Highlighter highlighter;
+    std::string text = "foo bar";
+    highlighter.set_filters(compile({ "foo" }));
+    CPPUNIT_ASSERT_EQUAL ( std::string("0-3:0"),
+                           spans(highlighter, 0, text) );
+    // The spans kept are the ones of the previous filters
+    highlighter.set_filters(compile({ "bar" }));
+    CPPUNIT_ASSERT_EQUAL ( std::string("4-7:0"),
+                           spans(highlighter, 0, text) );
+    highlighter.set_filters(compile({}));
+    CPPUNIT_ASSERT_EQUAL ( std::string(""), spans(highlighter, 0, text) );
+  }
+
+  void test_line_changed()
+  {
+    Highlighter highlighter;
+    highlighter.set_filters(compile({ "end" }));
+    // The last line of a followed file grows
+    std::string text = "the end is near the en";
+    CPPUNIT_ASSERT_EQUAL ( std::string("4-7:0"),
+                           spans(highlighter, 7, text.substr(0, 22)) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("4-7:0"),
+                           spans(highlighter, 7, text.substr(0, 22)) );
+    text += 'd';
+    CPPUNIT_ASSERT_EQUAL ( std::string("4-7:0 20-23:0"),
+                           spans(highlighter, 7, text) );
+    // The lines evicted are searched again
+    for (lineno_t i = 0; i <= HIGHLIGHT_CACHE_SIZE; ++i)
+      spans(highlighter, 100 + i, "no match");
+    CPPUNIT_ASSERT_EQUAL ( std::string("4-7:0 20-23:0"),
+                           spans(highlighter, 7, text) );
+  }
+};
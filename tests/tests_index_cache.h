@@ -0,0 +1,256 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <memory>
+#include <string>
+#include <fstream>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "buffer.h"
+#include "index_cache.h"
+
+class IndexCacheTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( IndexCacheTest );
+  CPPUNIT_TEST( test_unchanged );
+  CPPUNIT_TEST( test_appended );
+  CPPUNIT_TEST( test_rewritten );
+  CPPUNIT_TEST( test_unterminated );
+  CPPUNIT_TEST( test_small_file );
+  CPPUNIT_TEST( test_truncated );
+  CPPUNIT_TEST( test_corrupted );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+    char directory[] = "/tmp/ggrep_cache_XXXXXX";
+    CPPUNIT_ASSERT ( mkdtemp(directory) != nullptr );
+    m_directory = directory;
+    m_path = m_directory + ".txt";
+    m_cache = std::make_shared<IndexCache>(m_directory);
+  }
+
+  void tearDown()
+  {
+    DIR *dir = opendir(m_directory.c_str());
+    if (dir) {
+      while (struct dirent *entry = readdir(dir))
+        unlink((m_directory + "/" + entry->d_name).c_str());
+      closedir(dir);
+    }
+    rmdir(m_directory.c_str());
+    unlink(m_path.c_str());
+  }
+
+  /* Lines of width characters (\n included) numbered from first, with enough
+     of them to be cached */
+  static std::string lines(size_t width, lineno_t first = 0,
+                           lineno_t nb_lines = 0)
+  {
+    if (nb_lines == 0) nb_lines = INDEX_CACHE_MIN_SIZE / width + 1;
+    std::string content;
+    content.reserve(nb_lines * width);
+    for (lineno_t i = first; i < first + nb_lines; ++i) {
+      std::string number = std::to_string(i);
+      content += std::string(width - 1 - number.size(), '0') + number + "\n";
+    }
+    return content;
+  }
+
+  void write(const std::string &content,
+             std::ios::openmode mode = std::ios::trunc)
+  {
+    std::ofstream(m_path, std::ios::binary | mode) << content;
+  }
+
+  /* Open the file and return the number of lines after the first call to
+     load_more(): all of them if the index is restored from the cache, only
+     the head of the file otherwise */
+  lineno_t open_and_load(std::unique_ptr<FileBuffer> &buffer)
+  {
+    buffer.reset(new FileBuffer(m_path, false, m_cache));
+    buffer->load_more();
+    lineno_t nb_lines = buffer->get_number_of_line();
+    while (buffer->load_more());
+    return nb_lines;
+  }
+
+  /* Check the lines of buffer against content */
+  static void check(const FileBuffer &buffer, const std::string &content)
+  {
+    lineno_t nb_lines = 0;
+    for (size_t i = 0; i < content.size(); i = content.find('\n', i) + 1) {
+      if (nb_lines % 1009 == 0 || i + 50 > content.size()) {
+        line_t line = buffer.get_line(nb_lines);
+        CPPUNIT_ASSERT_EQUAL ( content.substr(i, content.find('\n', i) - i),
+                               std::string(line.text, line.length) );
+      }
+      ++nb_lines;
+      if (content.find('\n', i) == std::string::npos) break;
+    }
+    CPPUNIT_ASSERT_EQUAL ( nb_lines, buffer.get_number_of_line() );
+  }
+
+  void test_unchanged()
+  {
+    std::string content = lines(16);
+    (*this).write(content);
+    std::unique_ptr<FileBuffer> buffer;
+    // Not cached yet: only the first block is indexed by the first call
+    CPPUNIT_ASSERT ( open_and_load(buffer) < content.size() / 16 );
+    check(*buffer, content);
+    // Restored at once
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) content.size() / 16,
+                           open_and_load(buffer) );
+    check(*buffer, content);
+  }
+
+  void test_appended()
+  {
+    std::string content = lines(16);
+    (*this).write(content);
+    std::unique_ptr<FileBuffer> buffer;
+    open_and_load(buffer);
+    // The lines cached are restored and the new ones indexed
+    std::string tail = lines(16, content.size() / 16, 100000);
+    (*this).write(tail, std::ios::app);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) content.size() / 16,
+                           open_and_load(buffer) );
+    check(*buffer, content + tail);
+    // The extended index was saved
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) (content.size() + tail.size()) / 16,
+                           open_and_load(buffer) );
+    check(*buffer, content + tail);
+  }
+
+  void test_rewritten()
+  {
+    std::string content = lines(16);
+    (*this).write(content);
+    std::unique_ptr<FileBuffer> buffer;
+    open_and_load(buffer);
+    // Same size with shorter lines and another modification time: the
+    // cached index does not apply anymore
+    std::string rewritten = lines(8, 0, content.size() / 8);
+    CPPUNIT_ASSERT_EQUAL ( content.size(), rewritten.size() );
+    (*this).write(rewritten);
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { 1000000000, 0 } };
+    CPPUNIT_ASSERT ( utimensat(AT_FDCWD, m_path.c_str(), times, 0) == 0 );
+    CPPUNIT_ASSERT ( open_and_load(buffer) < rewritten.size() / 8 );
+    check(*buffer, rewritten);
+  }
+
+  void test_unterminated()
+  {
+    std::string content = lines(16) + "unterminated";
+    (*this).write(content);
+    std::unique_ptr<FileBuffer> buffer;
+    open_and_load(buffer);
+    check(*buffer, content);
+    // The last line is not cached, it is indexed again
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) content.size() / 16,
+                           open_and_load(buffer) );
+    check(*buffer, content);
+    // Once terminated, the line is indexed with the lines appended after it
+    (*this).write("\nlast\n", std::ios::app);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) content.size() / 16,
+                           open_and_load(buffer) );
+    check(*buffer, content + "\nlast\n");
+  }
+
+  void test_small_file()
+  {
+    // Not worth caching
+    (*this).write(lines(16, 0, 1000));
+    std::unique_ptr<FileBuffer> buffer;
+    open_and_load(buffer);
+    DIR *dir = opendir(m_directory.c_str());
+    int nb_entries = 0;
+    while (readdir(dir)) ++nb_entries;
+    closedir(dir);
+    CPPUNIT_ASSERT_EQUAL ( 2, nb_entries );
+  }
+
+  /* Path of the only entry of the cache */
+  std::string entry()
+  {
+    std::string path;
+    DIR *dir = opendir(m_directory.c_str());
+    while (struct dirent *entry = readdir(dir))
+      if (entry->d_name[0] != '.') path = m_directory + "/" + entry->d_name;
+    closedir(dir);
+    CPPUNIT_ASSERT ( !path.empty() );
+    return path;
+  }
+
+  /* Overwrite the entry with size bytes of data at offset */
+  void patch(off_t offset, const void *data, size_t size)
+  {
+    int fd = open(entry().c_str(), O_WRONLY);
+    CPPUNIT_ASSERT ( fd != -1 );
+    CPPUNIT_ASSERT ( pwrite(fd, data, size, offset) == (ssize_t) size );
+    close(fd);
+  }
+
+  void test_truncated()
+  {
+    std::string content = lines(16);
+    (*this).write(content);
+    std::unique_ptr<FileBuffer> buffer;
+    open_and_load(buffer);
+    struct stat st;
+    CPPUNIT_ASSERT ( stat(entry().c_str(), &st) == 0 );
+    CPPUNIT_ASSERT ( truncate(entry().c_str(), st.st_size - 4) == 0 );
+    // Indexed again, then saved again
+    CPPUNIT_ASSERT ( open_and_load(buffer) < content.size() / 16 );
+    check(*buffer, content);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) content.size() / 16,
+                           open_and_load(buffer) );
+  }
+
+  void test_corrupted()
+  {
+    std::string content = lines(16);
+    (*this).write(content);
+    std::unique_ptr<FileBuffer> buffer;
+    open_and_load(buffer);
+    // The number of lines of the header, after the magic and 6 64 bits
+    // fields, wrapping around to the same size of the entry once multiplied
+    uint64_t nb_lines = content.size() / 16 + (1ULL << 62);
+    patch(8 + 6 * 8 + 8, &nb_lines, sizeof (nb_lines));
+    CPPUNIT_ASSERT ( open_and_load(buffer) < content.size() / 16 );
+    check(*buffer, content);
+    // An offset beyond the end of the lines cached
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) content.size() / 16,
+                           open_and_load(buffer) );
+    struct stat st;
+    CPPUNIT_ASSERT ( stat(entry().c_str(), &st) == 0 );
+    uint32_t offset = content.size() * 2;
+    patch(st.st_size - 100 * sizeof (uint32_t), &offset, sizeof (offset));
+    CPPUNIT_ASSERT ( open_and_load(buffer) < content.size() / 16 );
+    check(*buffer, content);
+    // Offsets out of order
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) content.size() / 16,
+                           open_and_load(buffer) );
+    offset = 16;
+    patch(st.st_size - 100 * sizeof (uint32_t), &offset, sizeof (offset));
+    CPPUNIT_ASSERT ( open_and_load(buffer) < content.size() / 16 );
+    check(*buffer, content);
+  }
+
+private:
+  std::string                 m_directory;
+  std::string                 m_path;
+  std::shared_ptr<IndexCache> m_cache;
+};
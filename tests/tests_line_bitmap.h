@@ -0,0 +1,167 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <set>
+#include <random>
+#include <vector>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "line_bitmap.h"
+
+class LineBitmapTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( LineBitmapTest );
+  CPPUNIT_TEST( test_append );
+  CPPUNIT_TEST( test_get_lines_range );
+  CPPUNIT_TEST( test_prepend );
+  CPPUNIT_TEST( test_intersect_unite );
+  CPPUNIT_TEST( test_memory_size );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  /*
+   * Random lines of [begin, end), each one with the probability density: the
+   * blocks of the dense ones are bitsets, the others arrays
+   */
+  static std::set<lineno_t> random_lines(std::mt19937 &random, lineno_t begin,
+                                         lineno_t end, double density)
+  {
+    std::set<lineno_t> lines;
+    std::bernoulli_distribution distribution(density);
+    for (lineno_t line = begin; line < end; ++line)
+      if (distribution(random)) lines.insert(line);
+    return lines;
+  }
+
+  static LineBitmap make_bitmap(const std::set<lineno_t> &lines)
+  {
+    LineBitmap bitmap;
+    for (lineno_t line: lines) bitmap.append(line);
+    return bitmap;
+  }
+
+  static std::vector<lineno_t> get_lines(const LineBitmap &bitmap,
+                                         lineno_t begin = 0,
+                                         lineno_t end = (lineno_t) -1)
+  {
+    std::vector<lineno_t> lines;
+    bitmap.get_lines(lines, begin, end);
+    return lines;
+  }
+
+  static std::vector<lineno_t> to_vector(const std::set<lineno_t> &lines)
+  {
+    return std::vector<lineno_t>(lines.begin(), lines.end());
+  }
+
+  void test_append()
+  {
+    std::mt19937 random(2018);
+    for (double density: { 0.0, 0.001, 0.05, 0.5, 1.0 }) {
+      std::set<lineno_t> lines = random_lines(random, 1000,
+                                              3 * BITMAP_BLOCK_SIZE, density);
+      LineBitmap bitmap = make_bitmap(lines);
+      CPPUNIT_ASSERT_EQUAL ( (lineno_t) lines.size(),
+                             bitmap.get_number_of_lines() );
+      CPPUNIT_ASSERT ( get_lines(bitmap) == to_vector(lines) );
+    }
+  }
+
+  void test_get_lines_range()
+  {
+    std::mt19937 random(2018);
+    std::set<lineno_t> lines = random_lines(random, 0, 2 * BITMAP_BLOCK_SIZE,
+                                            0.3);
+    LineBitmap bitmap = make_bitmap(lines);
+    const lineno_t bounds[] = { 0, 1, 4095, BITMAP_BLOCK_SIZE - 1,
+      BITMAP_BLOCK_SIZE, BITMAP_BLOCK_SIZE + 77, 2 * BITMAP_BLOCK_SIZE };
+    for (lineno_t begin: bounds) {
+      for (lineno_t end: bounds) {
+        std::vector<lineno_t> expected;
+        for (lineno_t line: lines)
+          if (line >= begin && line < end) expected.push_back(line);
+        CPPUNIT_ASSERT ( get_lines(bitmap, begin, end) == expected );
+      }
+    }
+    // The lines are appended to the ones already there
+    std::vector<lineno_t> result = { 42 };
+    bitmap.get_lines(result, 0, 0);
+    CPPUNIT_ASSERT ( (result == std::vector<lineno_t>{ 42 }) );
+  }
+
+  void test_prepend()
+  {
+    std::mt19937 random(2018);
+    // The lines prepended may share a block with the first ones
+    for (lineno_t middle: { (lineno_t) BITMAP_BLOCK_SIZE,
+                            (lineno_t) BITMAP_BLOCK_SIZE + 1000 }) {
+      std::set<lineno_t> low = random_lines(random, 0, middle, 0.2);
+      std::set<lineno_t> high = random_lines(random, middle,
+                                             2 * BITMAP_BLOCK_SIZE, 0.01);
+      LineBitmap bitmap = make_bitmap(high);
+      bitmap.prepend(make_bitmap(low));
+      std::set<lineno_t> lines = low;
+      lines.insert(high.begin(), high.end());
+      CPPUNIT_ASSERT_EQUAL ( (lineno_t) lines.size(),
+                             bitmap.get_number_of_lines() );
+      CPPUNIT_ASSERT ( get_lines(bitmap) == to_vector(lines) );
+    }
+  }
+
+  void test_intersect_unite()
+  {
+    std::mt19937 random(2018);
+    const double densities[] = { 0.0005, 0.3 };
+    // Arrays and bitsets with one another
+    for (double a_density: densities) {
+      for (double b_density: densities) {
+        std::set<lineno_t> a = random_lines(random, 0, 3 * BITMAP_BLOCK_SIZE,
+                                            a_density);
+        std::set<lineno_t> b = random_lines(random, BITMAP_BLOCK_SIZE / 2,
+                                            4 * BITMAP_BLOCK_SIZE, b_density);
+        std::set<lineno_t> intersection, lines = a;
+        for (lineno_t line: a)
+          if (b.count(line)) intersection.insert(line);
+        lines.insert(b.begin(), b.end());
+        LineBitmap bitmap = make_bitmap(a);
+        bitmap.intersect(make_bitmap(b));
+        CPPUNIT_ASSERT_EQUAL ( (lineno_t) intersection.size(),
+                               bitmap.get_number_of_lines() );
+        CPPUNIT_ASSERT ( get_lines(bitmap) == to_vector(intersection) );
+        bitmap = make_bitmap(a);
+        bitmap.unite(make_bitmap(b));
+        CPPUNIT_ASSERT_EQUAL ( (lineno_t) lines.size(),
+                               bitmap.get_number_of_lines() );
+        CPPUNIT_ASSERT ( get_lines(bitmap) == to_vector(lines) );
+      }
+    }
+  }
+
+  void test_memory_size()
+  {
+    // A dense block is a bitset, smaller than the array of its lines
+    LineBitmap bitmap;
+    for (lineno_t line = 0; line < BITMAP_BLOCK_SIZE; ++line)
+      bitmap.append(line);
+    CPPUNIT_ASSERT ( bitmap.memory_size() < BITMAP_BLOCK_SIZE * 2 );
+    CPPUNIT_ASSERT ( bitmap.memory_size() >= BITMAP_BLOCK_SIZE / 8 );
+    // A sparse one is an array
+    LineBitmap sparse;
+    for (lineno_t line = 0; line < 100; ++line) sparse.append(line * 100);
+    CPPUNIT_ASSERT ( sparse.memory_size() < BITMAP_BLOCK_SIZE / 8 );
+  }
+};
@@ -0,0 +1,221 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "line_index.h"
+
+#define FOUR_GB ((offset_t) 1 << 32)
+
+class LineIndexTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( LineIndexTest );
+  CPPUNIT_TEST( test_index_lines );
+  CPPUNIT_TEST( test_index_lines_random );
+  CPPUNIT_TEST( test_index_lines_parallel );
+  CPPUNIT_TEST( test_index_lines_parallel_small );
+  CPPUNIT_TEST( test_segments );
+  CPPUNIT_TEST( test_append );
+  CPPUNIT_TEST( test_append_random );
+  CPPUNIT_TEST( test_index_lines_over_4gb );
+  CPPUNIT_TEST( test_index_lines_parallel_over_4gb );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  /* Offsets of the beginnings of the lines following each \n of data */
+  static std::vector<offset_t> expected_offsets(const std::string &data,
+                                                offset_t base)
+  {
+    std::vector<offset_t> offsets;
+    for (size_t i = 0; i < data.size(); ++i)
+      if (data[i] == '\n') offsets.push_back(base + i + 1);
+    return offsets;
+  }
+
+  static std::vector<offset_t> values(const LineIndex &index)
+  {
+    std::vector<offset_t> offsets;
+    for (lineno_t i = 0; i < index.size(); ++i) offsets.push_back(index[i]);
+    return offsets;
+  }
+
+  void test_index_lines()
+  {
+    // The text is compared 64 bytes at a time, the rest byte by byte: a \n
+    // is looked for at every position of texts crossing these sizes
+    for (size_t size = 0; size < 200; ++size) {
+      for (size_t at = 0; at <= size; ++at) {
+        std::string data(size, 'a');
+        if (at < size) data[at] = '\n';
+        LineIndex offsets;
+        CPPUNIT_ASSERT_EQUAL ( (lineno_t) (at < size),
+                               index_lines(data.data(), data.size(), 0,
+                                           offsets) );
+        CPPUNIT_ASSERT ( values(offsets) == expected_offsets(data, 0) );
+      }
+    }
+  }
+
+  void test_index_lines_random()
+  {
+    std::mt19937 random(2018);
+    for (int i = 0; i < 500; ++i) {
+      std::string data;
+      for (int j = random() % 1000; j > 0; --j)
+        data.push_back("\n\ra"[random() % 3]);
+      // The offsets are appended to the ones already there, from base
+      offset_t base = random() % 100000;
+      LineIndex offsets;
+      offsets.push_back(0);
+      std::vector<offset_t> expected = expected_offsets(data, base);
+      CPPUNIT_ASSERT_EQUAL ( (lineno_t) expected.size(),
+                             index_lines(data.data(), data.size(), base,
+                                         offsets) );
+      expected.insert(expected.begin(), 0);
+      CPPUNIT_ASSERT ( values(offsets) == expected );
+    }
+  }
+
+  /* Index data in 3 chunks of PARALLEL_INDEX_MIN_CHUNK_SIZE + 1 bytes with a
+     \n before, on or after the first byte of each chunk depending on shift */
+  static void check_parallel(int shift, offset_t base)
+  {
+    const size_t chunk = PARALLEL_INDEX_MIN_CHUNK_SIZE + 1;
+    std::string data(3 * chunk, 'a');
+    for (size_t c = 1; c < 3; ++c) {
+      data[c * chunk + shift] = '\n';
+      data[c * chunk + shift + 2] = '\n';
+    }
+    data[0] = '\n';
+    data[data.size() - 1] = '\n';
+    LineIndex offsets;
+    offsets.push_back(0);
+    offsets.push_back(0);
+    std::vector<offset_t> expected = expected_offsets(data, base);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 6,
+                           index_lines_parallel(data.data(), data.size(),
+                                                base, offsets, 3) );
+    expected.insert(expected.begin(), 2, 0);
+    CPPUNIT_ASSERT ( values(offsets) == expected );
+  }
+
+  void test_index_lines_parallel()
+  {
+    for (int shift = -1; shift <= 1; ++shift) check_parallel(shift, 1000);
+  }
+
+  void test_index_lines_parallel_small()
+  {
+    // Too small to be split: indexed on the calling thread
+    std::string data("a\nbb\n\nccc");
+    LineIndex offsets;
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 3,
+                           index_lines_parallel(data.data(), data.size(), 0,
+                                                offsets, 4) );
+    CPPUNIT_ASSERT ( values(offsets) == expected_offsets(data, 0) );
+  }
+
+  void test_segments()
+  {
+    // The offsets cross 4GB and 8GB, and skip the segment from 12GB to 16GB
+    std::vector<offset_t> expected = {
+      0, 10, FOUR_GB - 1, FOUR_GB, FOUR_GB + 5, 2 * FOUR_GB + 1,
+      4 * FOUR_GB + 7, 4 * FOUR_GB + 8
+    };
+    LineIndex index;
+    for (offset_t offset: expected) index.push_back(offset);
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) expected.size(), index.size() );
+    CPPUNIT_ASSERT ( values(index) == expected );
+    CPPUNIT_ASSERT_EQUAL ( 4 * FOUR_GB + 8, index.back() );
+  }
+
+  void test_append()
+  {
+    LineIndex first;
+    LineIndex second;
+    first.push_back(1);
+    first.push_back(FOUR_GB - 2);
+    // The first offset of second is in a segment first does not have yet
+    second.push_back(FOUR_GB + 3);
+    second.push_back(2 * FOUR_GB);
+    first.append(second);
+    std::vector<offset_t> expected = {
+      1, FOUR_GB - 2, FOUR_GB + 3, 2 * FOUR_GB
+    };
+    CPPUNIT_ASSERT ( values(first) == expected );
+    // Both already in the same segment
+    LineIndex third;
+    third.push_back(2 * FOUR_GB + 10);
+    first.append(third);
+    expected.push_back(2 * FOUR_GB + 10);
+    CPPUNIT_ASSERT ( values(first) == expected );
+    // Appending an empty index changes nothing
+    first.append(LineIndex());
+    CPPUNIT_ASSERT ( values(first) == expected );
+  }
+
+  void test_append_random()
+  {
+    std::mt19937_64 random(2018);
+    for (int i = 0; i < 200; ++i) {
+      std::vector<offset_t> expected;
+      offset_t offset = 0;
+      for (int j = random() % 50; j > 0; --j) {
+        // Mostly small steps with a few jumps over one or more segments
+        offset += (random() % 4 == 0) ? random() % (3 * FOUR_GB) :
+          random() % 1000;
+        expected.push_back(offset);
+      }
+      // Split the offsets in several indexes appended to each other
+      LineIndex index;
+      size_t begin = 0;
+      while (begin < expected.size()) {
+        size_t end = begin + random() % (expected.size() - begin + 1);
+        LineIndex part;
+        for (size_t k = begin; k < end; ++k) part.push_back(expected[k]);
+        index.append(part);
+        begin = end;
+      }
+      CPPUNIT_ASSERT ( values(index) == expected );
+    }
+  }
+
+  void test_index_lines_over_4gb()
+  {
+    std::string data("a\nb\nc\nd\n");
+    for (offset_t base = FOUR_GB - 9; base < FOUR_GB + 2; ++base) {
+      LineIndex offsets;
+      offsets.push_back(0);
+      std::vector<offset_t> expected = expected_offsets(data, base);
+      expected.insert(expected.begin(), 0);
+      index_lines(data.data(), data.size(), base, offsets);
+      CPPUNIT_ASSERT ( values(offsets) == expected );
+    }
+  }
+
+  void test_index_lines_parallel_over_4gb()
+  {
+    // 4GB is reached inside the second chunk and on its first byte
+    const size_t chunk = PARALLEL_INDEX_MIN_CHUNK_SIZE + 1;
+    check_parallel(0, FOUR_GB - chunk - 10);
+    check_parallel(1, FOUR_GB - chunk - 1);
+    check_parallel(-1, FOUR_GB - chunk);
+  }
+};
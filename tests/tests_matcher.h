@@ -0,0 +1,509 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <regex>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "matcher.h"
+#include "matcher_cache.h"
+
+class MatcherTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( MatcherTest );
+  CPPUNIT_TEST( test_literal_search );
+  CPPUNIT_TEST( test_literal_bounds );
+  CPPUNIT_TEST( test_literal_search_from );
+  CPPUNIT_TEST( test_is_literal );
+  CPPUNIT_TEST( test_compile );
+  CPPUNIT_TEST( test_required_literals );
+  CPPUNIT_TEST( test_required_literals_match );
+  CPPUNIT_TEST( test_regex_spans );
+  CPPUNIT_TEST( test_regex_spans_random );
+  CPPUNIT_TEST( test_multi_matcher );
+  CPPUNIT_TEST( test_multi_matcher_too_large );
+  CPPUNIT_TEST( test_matcher_cache );
+  CPPUNIT_TEST( test_multi_matcher_cache );
+  CPPUNIT_TEST( test_literal_icase );
+  CPPUNIT_TEST( test_literal_word );
+  CPPUNIT_TEST( test_regex_icase );
+  CPPUNIT_TEST( test_flags );
+  CPPUNIT_TEST( test_to_regex );
+  CPPUNIT_TEST( test_compile_flags );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+  }
+
+  void tearDown()
+  {
+  }
+
+  /* Return the start position of the match of matcher in text, or -1 */
+  static int search(const Matcher &matcher, const std::string &text)
+  {
+    uint start_pos, end_pos;
+    if (!matcher.search(text.data(), text.data() + text.size(), start_pos,
+                        end_pos))
+      return -1;
+    return start_pos;
+  }
+
+  void test_literal_search()
+  {
+    // The vectorized search compares 16 or 32 positions at once: the
+    // literal is looked for at every position of lines crossing these sizes
+    const std::vector<std::string> literals = { "x", "ab", "abc", "aab",
+      "needle", "a_long_literal_of_more_than_sixteen_bytes" };
+    for (const std::string &literal: literals) {
+      LiteralMatcher matcher(literal);
+      for (size_t size = 0; size < 80; ++size) {
+        std::string line(size, 'a');
+        CPPUNIT_ASSERT_EQUAL ( (int) line.find(literal),
+                               search(matcher, line) );
+        for (size_t at = 0; at + literal.size() <= size; ++at) {
+          std::string text = line;
+          text.replace(at, literal.size(), literal);
+          CPPUNIT_ASSERT_EQUAL ( (int) text.find(literal),
+                                 search(matcher, text) );
+        }
+      }
+    }
+  }
+
+  void test_literal_bounds()
+  {
+    // The bytes after the end of the line are not part of it
+    LiteralMatcher matcher("needle");
+    std::string text = std::string(40, '-') + "needle";
+    for (size_t end = 0; end < text.size(); ++end) {
+      uint start_pos, end_pos;
+      CPPUNIT_ASSERT_EQUAL ( false, matcher.search(text.data(),
+                                                   text.data() + end,
+                                                   start_pos, end_pos) );
+    }
+    // The empty literal matches at the beginning of the line
+    LiteralMatcher empty("");
+    CPPUNIT_ASSERT_EQUAL ( 0, search(empty, "") );
+    CPPUNIT_ASSERT_EQUAL ( 0, search(empty, "abc") );
+  }
+
+  void test_literal_search_from()
+  {
+    LiteralMatcher matcher("ab");
+    std::string text = "ab ab aab";
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    std::vector<uint> starts;
+    uint start_pos, end_pos;
+    for (const char *from = begin;
+         matcher.search_from(begin, end, from, start_pos, end_pos);
+         from = begin + end_pos) {
+      CPPUNIT_ASSERT_EQUAL ( start_pos + 2, end_pos );
+      starts.push_back(start_pos);
+    }
+    CPPUNIT_ASSERT ( (starts == std::vector<uint>{ 0, 3, 7 }) );
+  }
+
+  void test_is_literal()
+  {
+    std::string literal;
+    CPPUNIT_ASSERT_EQUAL ( true, LiteralMatcher::is_literal("foo bar",
+                                                            literal) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("foo bar"), literal );
+    // The escaped metacharacters stand for themselves
+    CPPUNIT_ASSERT_EQUAL ( true, LiteralMatcher::is_literal("a\\.b\\*",
+                                                            literal) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("a.b*"), literal );
+    CPPUNIT_ASSERT_EQUAL ( false, LiteralMatcher::is_literal("a.b", literal) );
+    CPPUNIT_ASSERT_EQUAL ( false, LiteralMatcher::is_literal("\\d", literal) );
+    CPPUNIT_ASSERT_EQUAL ( false, LiteralMatcher::is_literal("a\\", literal) );
+  }
+
+  void test_compile()
+  {
+    // The patterns without regex metacharacters are searched as strings
+    CPPUNIT_ASSERT ( std::dynamic_pointer_cast<LiteralMatcher>(
+      Matcher::compile("foo\\.bar")) );
+    CPPUNIT_ASSERT ( !std::dynamic_pointer_cast<LiteralMatcher>(
+      Matcher::compile("foo.bar")) );
+    CPPUNIT_ASSERT_EQUAL ( 2, search(*Matcher::compile("a+b"), "ccaaab") );
+  }
+
+  void test_required_literals()
+  {
+    typedef std::vector<std::string> literals_t;
+    // The longest literals first
+    CPPUNIT_ASSERT ( (RegexMatcher::required_literals("x+yz.*") ==
+                      literals_t{ "yz", "x" }) );
+    CPPUNIT_ASSERT ( (RegexMatcher::required_literals("foo.*bar") ==
+                      literals_t{ "bar", "foo" }) );
+    CPPUNIT_ASSERT ( (RegexMatcher::required_literals("error \\d+ in") ==
+                      literals_t{ "error ", " in" }) );
+    // The optional atoms and the groups of alternatives are not required
+    CPPUNIT_ASSERT ( (RegexMatcher::required_literals("ab?c") ==
+                      literals_t{ "a", "c" }) );
+    CPPUNIT_ASSERT ( (RegexMatcher::required_literals("a(b|c)d") ==
+                      literals_t{ "a", "d" }) );
+    CPPUNIT_ASSERT ( (RegexMatcher::required_literals("abc*") ==
+                      literals_t{ "ab" }) );
+    CPPUNIT_ASSERT ( (RegexMatcher::required_literals("\\.conf$") ==
+                      literals_t{ ".conf" }) );
+    CPPUNIT_ASSERT ( RegexMatcher::required_literals("foo|bar").empty() );
+    CPPUNIT_ASSERT ( RegexMatcher::required_literals("[ab]+").empty() );
+  }
+
+  void test_required_literals_match()
+  {
+    // A line without the required literals is rejected, the others are
+    // matched as std::regex matches them
+    const std::vector<std::string> patterns = { "x+yz", "a(b|c)d", "ab?c",
+      "error \\d+ in \\w+", "(?:abc)+d", "\\bword\\b", "a{2}b" };
+    const std::vector<std::string> lines = { "", "xxyz", "xyyz", "abd acd",
+      "ad ac", "error 12 in main", "error x in main", "abcabcd", "abd",
+      "words word", "sword", "aab", "ab" };
+    for (const std::string &pattern: patterns) {
+      RegexMatcher matcher(pattern);
+      std::regex regex(pattern);
+      for (const std::string &line: lines)
+        CPPUNIT_ASSERT_EQUAL ( std::regex_search(line, regex),
+                               search(matcher, line) != -1 );
+    }
+  }
+
+  /*
+   * Return the spans of all the occurrences of pattern in line, each one
+   * searched from the end of the previous one, found by matcher if not null,
+   * by std::regex otherwise. The empty matches are skipped.
+   */
+  static std::vector<std::pair<uint, uint> > spans(const Matcher *matcher,
+                                                   const std::string &pattern,
+                                                   const std::string &line)
+  {
+    std::vector<std::pair<uint, uint> > result;
+    std::regex regex(pattern);
+    const char *begin = line.data();
+    const char *end = begin + line.size();
+    for (const char *from = begin; from <= end; ) {
+      uint start_pos, end_pos;
+      if (matcher) {
+        if (!matcher->search_from(begin, end, from, start_pos, end_pos))
+          break;
+      } else {
+        std::cmatch match;
+        if (!std::regex_search(from, end, match, regex, from == begin ?
+                               std::regex_constants::match_default :
+                               std::regex_constants::match_prev_avail))
+          break;
+        start_pos = (from - begin) + match.position();
+        end_pos = start_pos + match.length();
+      }
+      if (end_pos > start_pos) result.push_back({ start_pos, end_pos });
+      from = begin + (end_pos > start_pos ? end_pos : start_pos + 1);
+    }
+    return result;
+  }
+
+  void test_regex_spans()
+  {
+    // The spans are the ones of std::regex, including for the repetitions
+    // iterating over the empty string
+    const std::vector<std::pair<std::string, std::string> > cases = {
+      { "b+", "aabbbba bb" }, { "a.*?b", "axbxb ab" }, { "ab|abc", "abcab" },
+      { "\\bfoo\\w*", "foofoo foobar xfoo" }, { "^a|b$", "aab ab" },
+      { "(c?\?)*", "c-1 a1 " }, { ".?\?(.{0,2}?)*a", "c-1 a1 a" },
+      { "(a|b?)+c", "abbc c" }, { "(x?)*y", "xxy y" }, { "x*", "axxb" } };
+    for (const auto &c: cases) {
+      RegexMatcher matcher(c.first);
+      CPPUNIT_ASSERT_MESSAGE ( c.first, spans(&matcher, c.first, c.second) ==
+                                        spans(nullptr, c.first, c.second) );
+    }
+  }
+
+  /*
+   * Random pattern of the atoms, groups and quantifiers the DFAs match. The
+   * groups are not nested deeper, std::regex backtracks exponentially on some
+   * nested repetitions.
+   */
+  static std::string random_pattern(std::mt19937 &random, int depth = 0)
+  {
+    static const char *atoms[] = { "a", "b", ".", "[ab]", "\\b", "c" };
+    static const char *quantifiers[] = { "*", "+", "?", "{0,2}", "{1,3}",
+      "*?", "+?", "?\?", "{2}" };
+    std::string pattern;
+    for (int i = random() % 3; i >= 0; --i) {
+      int atom = random() % 8;
+      if (atom < 6) {
+        pattern += atoms[atom];
+        // A quantifier cannot follow an assertion
+        if (atom == 4) continue;
+      } else if (depth < 2) {
+        pattern += (atom == 6 ? "(" : "(?:") +
+          random_pattern(random, depth + 1) + ")";
+      } else {
+        pattern += "a";
+      }
+      if (random() % 2) pattern += quantifiers[random() % 9];
+    }
+    if (depth < 2 && random() % 4 == 0)
+      pattern += "|" + random_pattern(random, depth + 1);
+    return pattern;
+  }
+
+  void test_regex_spans_random()
+  {
+    std::mt19937 random(2018);
+    for (int i = 0; i < 2000; ++i) {
+      std::string pattern = random_pattern(random);
+      RegexMatcher matcher(pattern);
+      for (int j = 0; j < 5; ++j) {
+        std::string line;
+        for (int k = random() % 12; k > 0; --k) line += "abc- "[random() % 5];
+        CPPUNIT_ASSERT_MESSAGE ( pattern + " on " + line,
+                                 spans(&matcher, pattern, line) ==
+                                 spans(nullptr, pattern, line) );
+        CPPUNIT_ASSERT_EQUAL ( !spans(nullptr, pattern, line).empty() ||
+                               std::regex_search(line, std::regex(pattern)),
+                               matcher.matches(line.data(),
+                                               line.data() + line.size()) );
+      }
+    }
+  }
+
+  void test_multi_matcher()
+  {
+    // Literals, regexes and a pattern the automata cannot match
+    const std::vector<std::string> patterns = { "foo", "ba[rz]", "o\\.", "\\d+",
+      "(a)\\1", "^x", "foo" };
+    std::vector< std::shared_ptr<Matcher> > matchers;
+    for (const std::string &pattern: patterns)
+      matchers.push_back(Matcher::compile(pattern));
+    MultiMatcher multi_matcher(patterns, matchers);
+    std::shared_ptr<MultiMatcher> clone = multi_matcher.clone();
+    const std::vector<std::string> lines = { "", "foo", "xbaz", "o.", "aa 1",
+      "foo.bar 12", "no match" };
+    for (const std::string &line: lines) {
+      const char *begin = line.data();
+      const char *end = begin + line.size();
+      std::vector<int> expected;
+      for (size_t i = 0; i < patterns.size(); ++i)
+        if (matchers[i]->matches(begin, end)) expected.push_back(i);
+      CPPUNIT_ASSERT_EQUAL ( !expected.empty(),
+                             clone->matches(begin, end) );
+      std::vector<int> tags = clone->get_last_matched().tags;
+      std::sort(tags.begin(), tags.end());
+      CPPUNIT_ASSERT_MESSAGE ( line, tags == expected );
+    }
+  }
+
+  void test_multi_matcher_too_large()
+  {
+    // The literals too large to be compiled together are searched one by one
+    const std::vector<std::string> patterns = { "foo",
+      std::string(AC_MAX_LITERALS_SIZE, 'x'), "bar" };
+    std::vector< std::shared_ptr<Matcher> > matchers;
+    for (const std::string &pattern: patterns)
+      matchers.push_back(Matcher::compile(pattern));
+    MultiMatcher multi_matcher(patterns, matchers);
+    const std::string line = "bar foo";
+    CPPUNIT_ASSERT ( multi_matcher.matches(line.data(),
+                                           line.data() + line.size()) );
+    std::vector<int> tags = multi_matcher.get_last_matched().tags;
+    std::sort(tags.begin(), tags.end());
+    CPPUNIT_ASSERT ( (tags == std::vector<int>{ 0, 2 }) );
+    CPPUNIT_ASSERT ( !multi_matcher.matches(patterns[1].data() + 1,
+                                            patterns[1].data() +
+                                            patterns[1].size()) );
+  }
+
+  void test_matcher_cache()
+  {
+    MatcherCache cache(2);
+    std::shared_ptr<Matcher> matcher = cache.get("a.c");
+    CPPUNIT_ASSERT ( matcher );
+    CPPUNIT_ASSERT ( cache.get("a.c") == matcher );
+    CPPUNIT_ASSERT ( !cache.get("a(c") );
+    // "a.c" is the most recently used, "a(c" is evicted
+    CPPUNIT_ASSERT ( cache.get("a.c") == matcher );
+    std::shared_ptr<Matcher> other = cache.get("b+");
+    CPPUNIT_ASSERT ( cache.get("a.c") == matcher );
+    CPPUNIT_ASSERT ( cache.get("b+") == other );
+    // "a.c" is evicted
+    cache.get("c*");
+    CPPUNIT_ASSERT ( cache.get("a.c") != matcher );
+  }
+
+  void test_multi_matcher_cache()
+  {
+    MatcherCache cache;
+    std::shared_ptr<Matcher> matcher = cache.get("a.c");
+    CPPUNIT_ASSERT ( matcher );
+    CPPUNIT_ASSERT ( cache.get("a.c") == matcher );
+    CPPUNIT_ASSERT ( !cache.get("a(c") );
+    // The patterns ORed are compiled once
+    std::shared_ptr<MultiMatcher> multi_matcher = cache.get(
+      std::vector<std::string>{ "foo", "b.r" });
+    CPPUNIT_ASSERT ( multi_matcher );
+    CPPUNIT_ASSERT ( cache.get(std::vector<std::string>{ "foo", "b.r" }) ==
+                     multi_matcher );
+    CPPUNIT_ASSERT ( cache.get(std::vector<std::string>{ "b.r", "foo" }) !=
+                     multi_matcher );
+    CPPUNIT_ASSERT ( !cache.get(std::vector<std::string>{ "foo", "a(c" }) );
+  }
+
+  void test_literal_icase()
+  {
+    LiteralMatcher matcher("Error", true);
+    CPPUNIT_ASSERT_EQUAL ( 4, search(matcher, "an  eRROR") );
+    CPPUNIT_ASSERT_EQUAL ( 34, search(matcher, std::string(34, '.') +
+                                               "ERROR") );
+    CPPUNIT_ASSERT_EQUAL ( -1, search(matcher, "errr or") );
+    // Only the ASCII letters have a case
+    LiteralMatcher symbols("[a]", true);
+    CPPUNIT_ASSERT_EQUAL ( 3, search(symbols, "{A][A]") );
+    // The folded search compares 16 or 32 positions at once, like the exact
+    // one: the literal is looked for at every position, in random cases
+    std::mt19937 random(2018);
+    const std::vector<std::string> literals = { "x", "Ab", "needle",
+      "a_Long_literal_of_more_than_sixteen_bytes" };
+    for (const std::string &literal: literals) {
+      LiteralMatcher folded(literal, true);
+      for (size_t size = 0; size < 80; ++size) {
+        std::string line(size, '@');
+        CPPUNIT_ASSERT_EQUAL ( -1, search(folded, line) );
+        for (size_t at = 0; at + literal.size() <= size; ++at) {
+          std::string text = line;
+          for (size_t i = 0; i < literal.size(); ++i)
+            text[at + i] = random() % 2 ? toupper(literal[i]) :
+                                          tolower(literal[i]);
+          CPPUNIT_ASSERT_EQUAL ( (int) at, search(folded, text) );
+        }
+      }
+    }
+  }
+
+  void test_literal_word()
+  {
+    LiteralMatcher matcher("bar", false, true);
+    CPPUNIT_ASSERT_EQUAL ( 9, search(matcher, "barbar_ (bar)") );
+    CPPUNIT_ASSERT_EQUAL ( 0, search(matcher, "bar") );
+    CPPUNIT_ASSERT_EQUAL ( -1, search(matcher, "foobar bars") );
+    LiteralMatcher both("Bar", true, true);
+    CPPUNIT_ASSERT_EQUAL ( 7, search(both, "BARS a BAR") );
+  }
+
+  void test_regex_icase()
+  {
+    RegexMatcher matcher("Error \\d+", true);
+    CPPUNIT_ASSERT_EQUAL ( 2, search(matcher, "! eRROR 404") );
+    CPPUNIT_ASSERT_EQUAL ( -1, search(matcher, "! eRROR x") );
+    // Lines are matched as std::regex matches them, with its icase flag. A
+    // negated class does not match the other case of its letters either.
+    const std::vector<std::string> patterns = { "Error \\d+", "[a-c]+X",
+      "\\bfoo\\b", "F(oo|aa)?z", "[^A]b", "[^b-z]B" };
+    const std::vector<std::string> lines = { "", "ERROR 1", "error", "ABCx",
+      "xfoo FOO", "fz FAAZ", "ab", "Ab", "cB" };
+    for (const std::string &pattern: patterns) {
+      RegexMatcher folded(pattern, true);
+      std::regex regex(pattern, std::regex::ECMAScript | std::regex::icase);
+      for (const std::string &line: lines) {
+        std::smatch match;
+        bool found = std::regex_search(line, match, regex);
+        CPPUNIT_ASSERT_EQUAL ( found ? (int) match.position() : -1,
+                               search(folded, line) );
+      }
+    }
+  }
+
+  void test_flags()
+  {
+    filter_flags_t flags = { false, false, false };
+    CPPUNIT_ASSERT_EQUAL ( std::string("abc"),
+                           Matcher::parse_flags("(?iw)abc", flags) );
+    CPPUNIT_ASSERT ( flags.icase && !flags.fixed && flags.word );
+    // The prefixes accumulate until the fixed flag
+    flags = { false, false, false };
+    CPPUNIT_ASSERT_EQUAL ( std::string("(?w)abc"),
+                           Matcher::parse_flags("(?i)(?f)(?w)abc", flags) );
+    CPPUNIT_ASSERT ( flags.icase && flags.fixed && !flags.word );
+    // What is not a prefix is the pattern
+    const char *patterns[] = { "(?:abc)", "(?)abc", "(?i", "(?x)abc", "a(?i)",
+                               "" };
+    for (const char *pattern: patterns) {
+      flags = { false, false, false };
+      CPPUNIT_ASSERT_EQUAL ( std::string(pattern),
+                             Matcher::parse_flags(pattern, flags) );
+      CPPUNIT_ASSERT ( !flags.icase && !flags.fixed && !flags.word );
+    }
+    // A filter is given back by its pattern and flags
+    const char *filters[] = { "abc", "(?i)abc", "(?fw)(?i)abc", "(?f)(?f)",
+                              "(?wi)x", "(?i)(?w)x" };
+    for (const char *filter: filters) {
+      flags = { false, false, false };
+      std::string pattern = Matcher::parse_flags(filter, flags);
+      filter_flags_t parsed = { false, false, false };
+      CPPUNIT_ASSERT_EQUAL ( pattern, Matcher::parse_flags(
+        Matcher::format_flags(pattern, flags), parsed) );
+      CPPUNIT_ASSERT ( parsed.icase == flags.icase &&
+                       parsed.fixed == flags.fixed &&
+                       parsed.word == flags.word );
+    }
+    CPPUNIT_ASSERT_EQUAL ( std::string("(?ifw)x"), Matcher::format_flags(
+      "x", filter_flags_t{ true, true, true }) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("x"), Matcher::format_flags(
+      "x", filter_flags_t{ false, false, false }) );
+  }
+
+  void test_to_regex()
+  {
+    filter_flags_t fixed = { false, true, false };
+    filter_flags_t word = { false, false, true };
+    filter_flags_t icase = { true, false, false };
+    CPPUNIT_ASSERT_EQUAL ( std::string("a\\.b\\*\\(c\\)"),
+                           Matcher::to_regex("a.b*(c)", fixed) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("\\b(?:a|b)\\b"),
+                           Matcher::to_regex("a|b", word) );
+    CPPUNIT_ASSERT_EQUAL ( std::string("a.b"),
+                           Matcher::to_regex("a.b", icase) );
+    // The string found matches as a regex what it matches as a string
+    std::string string = "^[x](y)?{1}$|\\+.";
+    std::regex regex(Matcher::to_regex(string, fixed));
+    CPPUNIT_ASSERT ( std::regex_search("a " + string + " b", regex) );
+  }
+
+  void test_compile_flags()
+  {
+    std::shared_ptr<Matcher> fixed = Matcher::compile("(?f)a.b");
+    CPPUNIT_ASSERT_EQUAL ( 3, search(*fixed, "axba.b") );
+    CPPUNIT_ASSERT_EQUAL ( -1, search(*fixed, "axb") );
+    std::shared_ptr<Matcher> word = Matcher::compile("(?iw)FOO");
+    CPPUNIT_ASSERT_EQUAL ( 5, search(*word, "food foo.") );
+    std::shared_ptr<Matcher> regex_word = Matcher::compile("(?w)ba.");
+    CPPUNIT_ASSERT_EQUAL ( 6, search(*regex_word, "bars (baz)") );
+    CPPUNIT_ASSERT_EQUAL ( -1, search(*regex_word, "bars") );
+    std::shared_ptr<Matcher> regex_icase = Matcher::compile("(?i)t.*T");
+    CPPUNIT_ASSERT_EQUAL ( 1, search(*regex_icase, "aTxt") );
+    // The flags of an expression apply to its patterns, a quoted pattern may
+    // add its own
+    std::shared_ptr<Matcher> plan = Matcher::compile("(?i)?FOO & !bar");
+    CPPUNIT_ASSERT_EQUAL ( 0, search(*plan, "foo") );
+    CPPUNIT_ASSERT_EQUAL ( -1, search(*plan, "foo BAR") );
+    plan = Matcher::compile("?x & \"(?i)error\"");
+    CPPUNIT_ASSERT_EQUAL ( 2, search(*plan, "x ERROR") );
+    CPPUNIT_ASSERT_EQUAL ( -1, search(*plan, "X ERROR") );
+    // A fixed string is not an expression
+    CPPUNIT_ASSERT_EQUAL ( 1, search(*Matcher::compile("(?f)?a & b"),
+                                     "x?a & b") );
+  }
+};
@@ -0,0 +1,128 @@
+/*
+ *
+ *  Created by Jean-Daniel Michaud
+ *
+ */
+
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "stream_buffer.h"
+
+class StreamBufferTest : public CppUnit::TestFixture
+{
+
+  CPPUNIT_TEST_SUITE( StreamBufferTest );
+  CPPUNIT_TEST( test_lines );
+  CPPUNIT_TEST( test_chunks );
+  CPPUNIT_TEST( test_named_pipe );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp()
+  {
+    CPPUNIT_ASSERT ( pipe(m_pipe) == 0 );
+  }
+
+  void tearDown()
+  {
+    if (m_pipe[1] != -1) close(m_pipe[1]);
+  }
+
+  void send(const std::string &data)
+  {
+    CPPUNIT_ASSERT_EQUAL ( (ssize_t) data.size(),
+                           write(m_pipe[1], data.data(), data.size()) );
+  }
+
+  void close_pipe()
+  {
+    close(m_pipe[1]);
+    m_pipe[1] = -1;
+  }
+
+  static std::string text(const line_t &line)
+  {
+    return std::string(line.text, line.length);
+  }
+
+  void test_lines()
+  {
+    // The buffer closes the read end
+    StreamBuffer buffer(m_pipe[0], "-");
+    // Nothing received yet
+    CPPUNIT_ASSERT ( buffer.load_more() );
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 0, buffer.get_number_of_line() );
+    // Only the complete lines are published
+    (*this).send("a\nbb\npart");
+    CPPUNIT_ASSERT ( buffer.load_more() );
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 2, buffer.get_number_of_line() );
+    CPPUNIT_ASSERT_EQUAL ( std::string("bb"), text(buffer.get_line(1)) );
+    (*this).send("ial\r\nlast");
+    CPPUNIT_ASSERT ( buffer.load_more() );
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 3, buffer.get_number_of_line() );
+    CPPUNIT_ASSERT_EQUAL ( std::string("partial"), text(buffer.get_line(2)) );
+    // The unterminated last line is published at the end of the stream
+    (*this).close_pipe();
+    CPPUNIT_ASSERT ( !buffer.load_more() );
+    CPPUNIT_ASSERT_EQUAL ( (lineno_t) 4, buffer.get_number_of_line() );
+    CPPUNIT_ASSERT_EQUAL ( std::string("last"), text(buffer.get_line(3)) );
+  }
+
+  void test_chunks()
+  {
+    // More than two chunks of lines of 16 characters, the lines straddling
+    // two chunks are contiguous
+    const lineno_t nb_lines = 5 * ARENA_CHUNK_SIZE / 2 / 16;
+    std::thread writer([this, nb_lines]() {
+      std::string data;
+      for (lineno_t i = 0; i < nb_lines; ++i) {
+        std::string number = std::to_string(i);
+        data += std::string(15 - number.size(), '0') + number + "\n";
+        if (data.size() > 100000 || i + 1 == nb_lines) {
+          // No assertion out of the test thread, the reader checks the lines
+          if (write(m_pipe[1], data.data(), data.size()) == -1) break;
+          data.clear();
+        }
+      }
+      (*this).close_pipe();
+    });
+    StreamBuffer buffer(m_pipe[0], "-");
+    while (buffer.load_more());
+    writer.join();
+    CPPUNIT_ASSERT_EQUAL ( nb_lines, buffer.get_number_of_line() );
+    for (lineno_t i = 0; i < nb_lines; i += 4999) {
+      std::string number = std::to_string(i);
+      CPPUNIT_ASSERT_EQUAL ( std::string(15 - number.size(), '0') + number,
+                             text(buffer.get_line(i)) );
+    }
+    CPPUNIT_ASSERT ( buffer.get_line(nb_lines - 1).text ==
+                     buffer.get_line(0).text + (nb_lines - 1) * 16 );
+  }
+
+  void test_named_pipe()
+  {
+    close(m_pipe[0]);
+    (*this).close_pipe();
+    char directory[] = "/tmp/ggrep_fifo_XXXXXX";
+    CPPUNIT_ASSERT ( mkdtemp(directory) != nullptr );
+    std::string path = std::string(directory) + "/fifo";
+    CPPUNIT_ASSERT ( mkfifo(path.c_str(), 0600) == 0 );
+    {
+      // Opened without waiting for a writer
+      StreamBuffer buffer(path);
+      CPPUNIT_ASSERT_EQUAL ( (lineno_t) 0, buffer.get_number_of_line() );
+      CPPUNIT_ASSERT_THROW ( StreamBuffer file(directory), OpenFileException );
+    }
+    unlink(path.c_str());
+    rmdir(directory);
+  }
+
+private:
+  int m_pipe[2];
+};